@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Batched serial reads, Linux only: wakeups per second and the latency
+// they add for several byte counts and latency bounds. A thread writes a
+// steady stream of frames into a pseudo terminal, the reader side waits
+// the way the reader does with --batch-latency and --batch-bytes.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "crossfire_stream.h"
+#include "frame_generator.h"
+#include "serial.h"
+#include "telemetry_clock.h"
+
+#define FRAME_RATE    500     // frames/s, telemetry and channels of a fast link
+#define RUN_TIME      2000000 // us per setting
+#define MAX_FRAMES    (FRAME_RATE * RUN_TIME / 1000000 + 100)
+
+struct BatchSetting
+{
+	uint32_t latency; // us, 0 reads every byte as it arrives
+	uint8_t minBytes;
+};
+
+struct BatchResult
+{
+	double wakeupsPerSecond;
+	double bytesPerWakeup;
+	uint64_t p50;
+	uint64_t p99;
+	uint64_t max;
+};
+
+// Latency of every frame from its write to its decode
+class LatencyRecorder : public CrossfireTelemetryHandler
+{
+public:
+	LatencyRecorder(const std::vector<uint64_t>& sent, std::vector<uint64_t>& latency) : sent(sent), latency(latency) {}
+
+	void processCrossfireFrame(const CrossfireFrameView&) override
+	{
+		if (count < sent.size())
+			latency.push_back(getTelemetryTime() - sent[count++]);
+	}
+	void processCrossfireTelemetryValue(uint8_t, int32_t) override {}
+
+private:
+	const std::vector<uint64_t>& sent;
+	std::vector<uint64_t>& latency;
+	size_t count = 0;
+};
+
+static void setTimer(int timer, uint64_t time)
+{
+	itimerspec spec = {};
+	spec.it_value.tv_sec = time / 1000000;
+	spec.it_value.tv_nsec = (time % 1000000) * 1000;
+	timerfd_settime(timer, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+static bool run(const BatchSetting& setting, BatchResult& result)
+{
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+		return false;
+	int port = openSerialPort(ptsname(master));
+	if (port < 0 || (setting.latency && setting.minBytes && !setSerialReadBatch(port, setting.minBytes)))
+		return false;
+
+	// Same clock as getTelemetryTime()
+	int epollFd = epoll_create1(0);
+	int timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+	epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.fd = port;
+	if (!setting.latency || setting.minBytes)
+		epoll_ctl(epollFd, EPOLL_CTL_ADD, port, &event);
+	event.data.fd = timer;
+	epoll_ctl(epollFd, EPOLL_CTL_ADD, timer, &event);
+
+	std::vector<uint64_t> sent(MAX_FRAMES);
+	std::vector<uint64_t> latency;
+	latency.reserve(MAX_FRAMES);
+	std::atomic<size_t> written(0);
+
+	std::thread writer([&]()
+	{
+		CrossfireFrameGenerator generator;
+		uint64_t start = getTelemetryTime();
+		for (size_t i = 0; i < MAX_FRAMES - 100; i++)
+		{
+			uint64_t due = start + i * 1000000 / FRAME_RATE;
+			while (getTelemetryTime() < due)
+				usleep((useconds_t)std::min<uint64_t>(due - getTelemetryTime(), 1000));
+
+			uint8_t frame[MAX_FRAME_SIZE];
+			size_t length = generator.generateMix(frame, sizeof(frame));
+			sent[i] = getTelemetryTime();
+			if (write(master, frame, length) != (ssize_t)length)
+				break;
+			written = i + 1;
+		}
+	});
+
+	LatencyRecorder recorder(sent, latency);
+	CrossfireStream stream(recorder);
+	uint64_t wakeups = 0;
+	uint64_t bytes = 0;
+	uint64_t start = getTelemetryTime();
+	if (setting.latency)
+		setTimer(timer, start + setting.latency);
+
+	while (getTelemetryTime() - start < RUN_TIME)
+	{
+		epoll_event ready[2];
+		if (epoll_wait(epollFd, ready, 2, 100) <= 0)
+			continue;
+		++wakeups;
+
+		for (;;)
+		{
+			size_t length;
+			uint8_t* buf = stream.writeBuffer(length);
+			ssize_t bytesRead = read(port, buf, length);
+			if (bytesRead <= 0)
+				break;
+			bytes += bytesRead;
+			stream.commit(bytesRead);
+			stream.process();
+		}
+
+		if (setting.latency)
+		{
+			uint64_t expirations;
+			read(timer, &expirations, sizeof(expirations));
+			setTimer(timer, getTelemetryTime() + setting.latency);
+		}
+	}
+
+	writer.join();
+	close(timer);
+	close(epollFd);
+	close(port);
+	close(master);
+	if (latency.empty())
+		return false;
+
+	std::sort(latency.begin(), latency.end());
+	double seconds = (getTelemetryTime() - start) / 1e6;
+	result.wakeupsPerSecond = wakeups / seconds;
+	result.bytesPerWakeup = wakeups ? (double)bytes / wakeups : 0;
+	result.p50 = latency[latency.size() / 2];
+	result.p99 = latency[latency.size() * 99 / 100];
+	result.max = latency.back();
+	return true;
+}
+
+int main()
+{
+	static const BatchSetting settings[] = {
+		{ 0, 1 }, { 5000, 32 }, { 10000, 64 }, { 20000, 64 }, { 20000, 0 }, { 50000, 128 }, { 100000, 255 },
+	};
+
+	printf("%d frames/s written to a pseudo terminal\n", FRAME_RATE);
+	printf("%-10s %-6s %10s %12s %10s %10s %10s %12s\n", "latency", "bytes", "wakeups/s", "bytes/wakeup", "p50 us", "p99 us", "max us", "added p50 us");
+
+	uint64_t baseline = 0;
+	for (const BatchSetting& setting : settings)
+	{
+		BatchResult result;
+		if (!run(setting, result))
+		{
+			perror("Pseudo terminal");
+			return 1;
+		}
+		if (!setting.latency)
+			baseline = result.p50;
+
+		char latency[16];
+		snprintf(latency, sizeof(latency), setting.latency ? "%u ms" : "none", setting.latency / 1000);
+		printf("%-10s %-6u %10.1f %12.1f %10llu %10llu %10llu %12lld\n", latency, setting.minBytes, result.wakeupsPerSecond,
+			result.bytesPerWakeup, (unsigned long long)result.p50, (unsigned long long)result.p99, (unsigned long long)result.max,
+			(long long)(result.p50 - baseline));
+	}
+	return 0;
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+// Keeps the optimizer from dropping computations whose result is unused
+template <typename T>
+inline void doNotOptimize(const T& value)
+{
+#if defined(__GNUC__)
+	asm volatile("" : : "r,m"(value) : "memory");
+#else
+	static volatile T sink;
+	sink = value;
+#endif
+}
+
+// Runs body(iteration) the given number of times, returns nanoseconds per iteration
+template <typename Body>
+double measureNs(uint64_t iterations, Body body)
+{
+	auto start = std::chrono::steady_clock::now();
+	for (uint64_t i = 0; i < iterations; i++)
+		body(i);
+	auto elapsed = std::chrono::steady_clock::now() - start;
+	return std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Shared memory telemetry bus: cost of publishing a frame, latency from the
+// end of a frame to a polling consumer on another core, and how a reader
+// which stops reading loses samples without slowing the producer down.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "benchmark.h"
+#include "crossfire.h"
+#include "telemetry_bus.h"
+#include "telemetry_clock.h"
+
+#define FRAME_COUNT    1000000
+#define LATENCY_FRAMES 100000
+#define FRAME_PERIOD   20000 // ns between frames in the latency test, a 50 kHz link
+
+static void publishFrame(TelemetryBusWriter& writer, int32_t value)
+{
+	writer.beginCrossfireTelemetryFrame(BATTERY_ID);
+	writer.processCrossfireTelemetryValue(BATT_VOLTAGE_INDEX, value);
+	writer.processCrossfireTelemetryValue(BATT_CURRENT_INDEX, value);
+	writer.processCrossfireTelemetryValue(BATT_CAPACITY_INDEX, value);
+	writer.processCrossfireTelemetryValue(BATT_REMAINING_INDEX, value);
+	writer.endCrossfireTelemetryFrame(BATTERY_ID);
+}
+
+int main()
+{
+	std::vector<uint64_t> memory((getTelemetryBusSize(TELEMETRY_BUS_CAPACITY) + 7) / 8);
+	TelemetryBusWriter writer(memory.data(), TELEMETRY_BUS_CAPACITY, 0);
+
+	double ns = measureNs(FRAME_COUNT, [&](uint64_t i) { publishFrame(writer, (int32_t)i); });
+	printf("Publish: %.1f ns/frame, %.1f ns/sample\n", ns, ns / 4);
+
+	// Frame i carries i in its values, the consumer looks up when it was sent
+	std::vector<uint64_t> sent(LATENCY_FRAMES);
+	std::vector<uint32_t> latency;
+	latency.reserve(LATENCY_FRAMES);
+	std::atomic<bool> ready(false);
+
+	std::thread consumer([&]()
+	{
+		TelemetryBusReader reader(memory.data(), memory.size() * 8);
+		TelemetryBusSample samples[256];
+		ready = true;
+		int32_t last = -1;
+		while (last != LATENCY_FRAMES - 1)
+		{
+			size_t count = reader.read(samples, 256);
+			uint64_t now = getTelemetryTimeNs();
+			if (count == 0)
+				std::this_thread::yield();
+			for (size_t i = 0; i < count; i++)
+			{
+				if (samples[i].value == last)
+					continue;
+				last = samples[i].value;
+				latency.push_back((uint32_t)(now - sent[last]));
+			}
+		}
+		printf("Lost by the polling consumer: %llu\n", (unsigned long long)reader.getLost());
+	});
+
+	while (!ready)
+		std::this_thread::yield();
+
+	for (int32_t i = 0; i < LATENCY_FRAMES; i++)
+	{
+		uint64_t start = getTelemetryTimeNs();
+		sent[i] = start;
+		publishFrame(writer, i);
+		// Yielding keeps the test meaningful when both threads share one core
+		while (getTelemetryTimeNs() - start < FRAME_PERIOD)
+			std::this_thread::yield();
+	}
+	consumer.join();
+
+	std::sort(latency.begin(), latency.end());
+	printf("Latency to a polling consumer: median %u ns, 99%% %u ns, 99.9%% %u ns, max %u ns\n",
+		latency[latency.size() / 2], latency[latency.size() * 99 / 100], latency[latency.size() * 999 / 1000], latency.back());
+
+	// A reader which stops reading does not hold the producer back
+	TelemetryBusReader slow(memory.data(), memory.size() * 8);
+	ns = measureNs(FRAME_COUNT, [&](uint64_t i) { publishFrame(writer, (int32_t)i); });
+	TelemetryBusSample sample;
+	slow.read(&sample, 1);
+	printf("Publish with a stalled reader: %.1f ns/frame, the reader lost %llu of %u samples\n",
+		ns, (unsigned long long)slow.getLost(), FRAME_COUNT * 4);
+
+	return 0;
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Cost of unpacking the 16 x 11 bit channels of a CHANNELS_ID frame: the
+// word-wide kernel against a bit by bit loop, and the whole path from bytes
+// to values delivered to a handler. At 1 kHz a link leaves 1 ms per frame.
+
+#include <cstdio>
+#include <vector>
+
+#include "benchmark.h"
+#include "crossfire.h"
+#include "crossfire_stream.h"
+#include "frame_generator.h"
+
+#define FRAME_COUNT 100000
+
+// Straightforward reference, one bit at a time
+static void unpackChannelsBitwise(const uint8_t* payload, uint16_t* channels)
+{
+	for (int i = 0; i < CROSSFIRE_CHANNEL_COUNT; i++)
+	{
+		uint16_t value = 0;
+		for (int bit = 0; bit < 11; bit++)
+		{
+			int position = i * 11 + bit;
+			if (payload[position / 8] & (1 << (position % 8)))
+				value |= 1 << bit;
+		}
+		channels[i] = value;
+	}
+}
+
+class ChannelSumHandler : public CrossfireTelemetryHandler
+{
+public:
+	int64_t sum = 0;
+
+	void processCrossfireTelemetryValue(uint8_t index, int32_t value) override
+	{
+		sum += value;
+	}
+};
+
+int main()
+{
+	CrossfireFrameGenerator generator;
+	std::vector<uint8_t> frames(FRAME_COUNT * MAX_FRAME_SIZE);
+	std::vector<size_t> offsets;
+	size_t used = 0;
+	for (int i = 0; i < FRAME_COUNT; i++)
+	{
+		offsets.push_back(used);
+		used += generator.generate(CHANNELS_ID, &frames[used]);
+	}
+	frames.resize(used);
+
+	// Both unpackers have to agree on every frame
+	for (size_t offset : offsets)
+	{
+		uint16_t expected[CROSSFIRE_CHANNEL_COUNT], actual[CROSSFIRE_CHANNEL_COUNT];
+		unpackChannelsBitwise(&frames[offset + 3], expected);
+		unpackCrossfireChannels(&frames[offset + 3], actual);
+		for (int i = 0; i < CROSSFIRE_CHANNEL_COUNT; i++)
+		{
+			if (expected[i] != actual[i])
+			{
+				printf("Mismatch in channel %d: %u != %u\n", i + 1, actual[i], expected[i]);
+				return 1;
+			}
+		}
+	}
+
+	const int repeats = 20;
+	uint16_t channels[CROSSFIRE_CHANNEL_COUNT];
+
+	double bitwise = measureNs(repeats, [&](uint64_t) {
+		for (size_t offset : offsets)
+		{
+			unpackChannelsBitwise(&frames[offset + 3], channels);
+			doNotOptimize(channels[0]);
+		}
+	}) / FRAME_COUNT;
+
+	double kernel = measureNs(repeats, [&](uint64_t) {
+		for (size_t offset : offsets)
+		{
+			unpackCrossfireChannels(&frames[offset + 3], channels);
+			doNotOptimize(channels[0]);
+		}
+	}) / FRAME_COUNT;
+
+	ChannelSumHandler handler;
+	double decode = measureNs(repeats, [&](uint64_t) {
+		for (size_t offset : offsets)
+			processCrossfireTelemetryFrame(&frames[offset], handler);
+	}) / FRAME_COUNT;
+
+	double stream = measureNs(repeats, [&](uint64_t) {
+		CrossfireStream crossfireStream(handler);
+		crossfireStream.push(frames.data(), frames.size());
+	}) / FRAME_COUNT;
+	doNotOptimize(handler.sum);
+
+	printf("%-36s %8.2f ns/frame\n", "unpack, bit by bit", bitwise);
+	printf("%-36s %8.2f ns/frame (%.1fx)\n", "unpack, word-wide", kernel, bitwise / kernel);
+	printf("%-36s %8.2f ns/frame\n", "decode to handler", decode);
+	printf("%-36s %8.2f ns/frame\n", "stream: framing, CRC, decode", stream);
+	return 0;
+}
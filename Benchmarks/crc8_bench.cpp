@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Compares the cost of CRC validation with the whole per-frame cost of
+// the stream: framing, CRC check and decoding
+
+#include <cstdio>
+
+#include "benchmark.h"
+#include "crc8.h"
+#include "crossfire.h"
+#include "crossfire_stream.h"
+
+static uint8_t crc8Bitwise(const uint8_t* ptr, uint32_t len)
+{
+	uint8_t crc = 0;
+	while (len--) {
+		crc ^= *ptr++;
+		for (int bit = 0; bit < 8; bit++)
+			crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0xD5) : (uint8_t)(crc << 1);
+	}
+	return crc;
+}
+
+class NullTelemetryHandler : public CrossfireTelemetryHandler
+{
+public:
+	void processCrossfireTelemetryValue(uint8_t index, int32_t value) override
+	{
+		doNotOptimize(index);
+		doNotOptimize(value);
+	}
+};
+
+struct BenchFrame
+{
+	const char* name;
+	uint8_t id;
+	uint8_t payloadLength;
+	uint8_t data[MAX_FRAME_SIZE];
+};
+
+static void fillFrame(BenchFrame& frame)
+{
+	frame.data[0] = RADIO_ADDRESS;
+	frame.data[1] = frame.payloadLength + 2; // id + payload + crc
+	frame.data[2] = frame.id;
+	for (int i = 0; i < frame.payloadLength; i++)
+		frame.data[3 + i] = (uint8_t)(i * 37 + 11);
+	frame.data[3 + frame.payloadLength] = crc8(&frame.data[2], frame.payloadLength + 1);
+}
+
+int main()
+{
+	const uint64_t iterations = 20000000;
+
+	BenchFrame frames[] = {
+		{ "LINK_ID", LINK_ID, 10, {} },
+		{ "GPS_ID", GPS_ID, 15, {} },
+		{ "BATTERY_ID", BATTERY_ID, 8, {} },
+		{ "ATTITUDE_ID", ATTITUDE_ID, 6, {} },
+		{ "FLIGHT_MODE_ID", FLIGHT_MODE_ID, 16, {} },
+		{ "max length", CHANNELS_ID, MAX_FRAME_LEN - 2, {} },
+	};
+
+	NullTelemetryHandler handler;
+	CrossfireStream stream(handler);
+
+	printf("%-16s %8s %10s %10s %10s %8s\n", "frame", "bytes", "bitwise", "crc8", "stream", "crc %");
+
+	for (BenchFrame& frame : frames) {
+		fillFrame(frame);
+		const uint8_t* data = frame.data;
+		uint32_t len = frame.data[1] - 1;
+
+		if (crc8Bitwise(&data[2], len) != crc8(&data[2], len)) {
+			printf("%s: crc8 mismatch\n", frame.name);
+			return 1;
+		}
+
+		double bitwiseNs = measureNs(iterations, [&](uint64_t) {
+			doNotOptimize(crc8Bitwise(&data[2], len));
+		});
+		double crcNs = measureNs(iterations, [&](uint64_t) {
+			doNotOptimize(crc8(&data[2], len));
+		});
+		double streamNs = measureNs(iterations, [&](uint64_t) {
+			stream.push(data, frame.data[1] + 2);
+		});
+
+		printf("%-16s %8u %8.2fns %8.2fns %8.2fns %7.1f%%\n", frame.name, frame.data[1] + 2,
+			bitwiseNs, crcNs, streamNs, 100.0 * crcNs / streamNs);
+	}
+
+	return 0;
+}
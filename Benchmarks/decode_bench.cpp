@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Throughput and per-frame latency of the whole decode path (framing,
+// CRC, decoding) for every frame type, realistic mixes and corrupted streams
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "benchmark.h"
+#include "crossfire.h"
+#include "crossfire_stream.h"
+#include "frame_generator.h"
+
+#define STREAM_SIZE (8 << 20)
+#define READ_SIZE   256 // Typical amount of data returned by a single read
+
+class CountingTelemetryHandler : public CrossfireTelemetryHandler
+{
+public:
+	uint64_t values = 0;
+
+	void processCrossfireTelemetryValue(uint8_t index, int32_t value) override
+	{
+		++values;
+		doNotOptimize(value);
+	}
+
+	void processCrossfireTelemetryText(uint8_t index, const char* text, uint8_t length) override
+	{
+		++values;
+		doNotOptimize(text);
+	}
+};
+
+static std::vector<uint8_t> makeStream(uint8_t id)
+{
+	CrossfireFrameGenerator generator;
+	std::vector<uint8_t> data(STREAM_SIZE + MAX_FRAME_SIZE);
+	size_t used = 0;
+	while (used < STREAM_SIZE)
+		used += generator.generate(id, &data[used]);
+	data.resize(used);
+	return data;
+}
+
+static std::vector<uint8_t> makeMix()
+{
+	CrossfireFrameGenerator generator;
+	std::vector<uint8_t> data(STREAM_SIZE);
+	data.resize(generator.generateMix(data.data(), data.size()));
+	return data;
+}
+
+// Flips random bits, about one per errorInterval bytes
+static std::vector<uint8_t> corrupt(std::vector<uint8_t> data, uint32_t errorInterval)
+{
+	std::mt19937 random(7);
+	for (size_t i = random() % errorInterval; i < data.size(); i += 1 + random() % (2 * errorInterval))
+		data[i] ^= (uint8_t)(1 << (random() % 8));
+	return data;
+}
+
+// Removes the tail of random frames, like a USB packet lost in the middle of a frame
+static std::vector<uint8_t> truncate(const std::vector<uint8_t>& data, uint32_t interval)
+{
+	std::mt19937 random(11);
+	std::vector<uint8_t> result;
+	result.reserve(data.size());
+	for (size_t i = 0; i < data.size(); )
+	{
+		size_t frameSize = data[i + 1] + 2;
+		size_t keep = (random() % interval == 0) ? 1 + random() % (frameSize - 1) : frameSize;
+		result.insert(result.end(), data.begin() + i, data.begin() + i + keep);
+		i += frameSize;
+	}
+	return result;
+}
+
+// Inserts a burst of random bytes every interval bytes
+static std::vector<uint8_t> addNoise(const std::vector<uint8_t>& data, size_t interval, size_t burst)
+{
+	std::mt19937 random(13);
+	std::vector<uint8_t> result;
+	result.reserve(data.size() + data.size() / interval * burst);
+	for (size_t i = 0; i < data.size(); )
+	{
+		// Keep frames whole, noise goes between them
+		size_t end = std::min(i + interval, data.size());
+		while (i < end)
+		{
+			size_t frameSize = data[i + 1] + 2;
+			result.insert(result.end(), data.begin() + i, data.begin() + i + frameSize);
+			i += frameSize;
+		}
+		for (size_t j = 0; j < burst; j++)
+			result.push_back((uint8_t)random());
+	}
+	return result;
+}
+
+static uint32_t countFrames(const std::vector<uint8_t>& clean)
+{
+	uint32_t frames = 0;
+	for (size_t i = 0; i < clean.size(); i += clean[i + 1] + 2)
+		++frames;
+	return frames;
+}
+
+static void run(const char* name, const std::vector<uint8_t>& data, uint32_t framesSent)
+{
+	const int repeats = 5;
+
+	CountingTelemetryHandler handler;
+	CrossfireStreamStats stats;
+
+	double ns = measureNs(repeats, [&](uint64_t) {
+		CrossfireStream stream(handler);
+		for (size_t offset = 0; offset < data.size(); offset += READ_SIZE)
+			stream.push(&data[offset], std::min<size_t>(READ_SIZE, data.size() - offset));
+		stats = stream.getStats();
+	});
+
+	// Per-frame latency: time to push a single complete frame
+	std::vector<double> latencies;
+	{
+		CrossfireStream stream(handler);
+		for (size_t i = 0; i + 1 < data.size() && latencies.size() < 100000; )
+		{
+			size_t frameSize = std::min<size_t>(data[i + 1] + 2, data.size() - i);
+			if (data[i] != RADIO_ADDRESS || frameSize < 2)
+				frameSize = 1;
+			latencies.push_back(measureNs(1, [&](uint64_t) { stream.push(&data[i], frameSize); }));
+			i += frameSize;
+		}
+	}
+	std::sort(latencies.begin(), latencies.end());
+
+	printf("%-26s %7.2f Mframes/s %8.1f MB/s %7.1f ns/frame %7.0f p50 %7.0f p99 %6.2f%% lost\n",
+		name, stats.frames * 1000.0 / ns, data.size() * 1000.0 / ns, ns / std::max<uint32_t>(stats.frames, 1),
+		latencies[latencies.size() / 2], latencies[latencies.size() * 99 / 100],
+		framesSent ? 100.0 * std::max<int64_t>(0, (int64_t)framesSent - stats.frames) / framesSent : 0.0);
+}
+
+int main()
+{
+	static const uint8_t ids[] = { LINK_ID, GPS_ID, LINK_RX_ID, LINK_TX_ID, BATTERY_ID, ATTITUDE_ID, FLIGHT_MODE_ID, CHANNELS_ID };
+
+	printf("Stream of %d MB pushed in %d byte reads, latency is ns to push one frame including reading the clock\n\n", STREAM_SIZE >> 20, READ_SIZE);
+
+	for (uint8_t id : ids)
+	{
+		std::vector<uint8_t> data = makeStream(id);
+		run(getCrossfireFrameName(id), data, countFrames(data));
+	}
+
+	printf("\n");
+
+	std::vector<uint8_t> mix = makeMix();
+	uint32_t mixFrames = countFrames(mix);
+
+	run("mix", mix, mixFrames);
+	run("mix, bit error / 10KB", corrupt(mix, 10000), mixFrames);
+	run("mix, bit error / 1KB", corrupt(mix, 1000), mixFrames);
+	run("mix, 1% frames truncated", truncate(mix, 100), mixFrames);
+	run("mix, 32B noise / 4KB", addNoise(mix, 4096, 32), mixFrames);
+	run("mix, 1KB noise / 64KB", addNoise(mix, 65536, 1024), mixFrames);
+
+	return 0;
+}
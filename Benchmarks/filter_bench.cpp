@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Output size and cost of unit scaling and change suppression on a
+// simulated 10 minute flight: raw values, calibrated imperial values, only
+// changes and deadbands, written as CSV. Sensor values drift and jitter
+// like a real link, so the reduction depends on how noisy each sensor is.
+// Slow sensors like satellites, capacity and flight mode are listed alone.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "benchmark.h"
+#include "crossfire.h"
+#include "telemetry_filter.h"
+#include "telemetry_sink.h"
+#include "telemetry_units.h"
+
+#define FLIGHT_TIME 600000000ull // us
+#define DEADBANDS   "1RSS=2,2RSS=2,TRSS=2,RQly=2,TQly=2,RSNR=1,TSNR=1,RxBt=0.1,Curr=1,Ptch=0.05,Roll=0.05,Yaw=0.05,Alt=1"
+
+struct Stream
+{
+	uint8_t id;
+	uint32_t period; // us
+	uint64_t due;
+};
+
+static double noise(double amplitude)
+{
+	return amplitude * (rand() / (double)RAND_MAX * 2 - 1);
+}
+
+static void sendFrame(CrossfireTelemetryHandler& handler, uint8_t id, double t)
+{
+	handler.beginCrossfireTelemetryFrame(id);
+	switch (id)
+	{
+	case LINK_ID:
+		handler.processCrossfireTelemetryValue(RX_RSSI1_INDEX, (int32_t)(-60 - 20 * sin(t / 40) + noise(3)));
+		handler.processCrossfireTelemetryValue(RX_RSSI2_INDEX, (int32_t)(-62 - 20 * sin(t / 40) + noise(3)));
+		handler.processCrossfireTelemetryValue(RX_QUALITY_INDEX, (int32_t)(100 - fabs(noise(4))));
+		handler.processCrossfireTelemetryValue(RX_SNR_INDEX, (int32_t)(8 + noise(2)));
+		handler.processCrossfireTelemetryValue(RX_ANTENNA_INDEX, rand() % 50 ? 0 : 1);
+		handler.processCrossfireTelemetryValue(RF_MODE_INDEX, 6);
+		handler.processCrossfireTelemetryValue(TX_POWER_INDEX, 100);
+		handler.processCrossfireTelemetryValue(TX_RSSI_INDEX, (int32_t)(-58 - 20 * sin(t / 40) + noise(3)));
+		handler.processCrossfireTelemetryValue(TX_QUALITY_INDEX, (int32_t)(100 - fabs(noise(4))));
+		handler.processCrossfireTelemetryValue(TX_SNR_INDEX, (int32_t)(9 + noise(2)));
+		break;
+	case BATTERY_ID:
+		handler.processCrossfireTelemetryValue(BATT_VOLTAGE_INDEX, (int32_t)(168 - t / 60 + noise(1)));
+		handler.processCrossfireTelemetryValue(BATT_CURRENT_INDEX, (int32_t)(150 + noise(40)));
+		handler.processCrossfireTelemetryValue(BATT_CAPACITY_INDEX, (int32_t)(t * 1.2));
+		handler.processCrossfireTelemetryValue(BATT_REMAINING_INDEX, (int32_t)(100 - t / 30));
+		break;
+	case GPS_ID:
+		handler.processCrossfireTelemetryValue(GPS_LATITUDE_INDEX, (int32_t)(47397700 + 2700 * sin(t / 12)));
+		handler.processCrossfireTelemetryValue(GPS_LONGITUDE_INDEX, (int32_t)(8546000 + 4000 * cos(t / 12)));
+		handler.processCrossfireTelemetryValue(GPS_GROUND_SPEED_INDEX, (int32_t)(900 + noise(30)));
+		handler.processCrossfireTelemetryValue(GPS_HEADING_INDEX, (int32_t)fmod(t / 12 * 5730 + 36000, 36000));
+		handler.processCrossfireTelemetryValue(GPS_ALTITUDE_INDEX, (int32_t)(100 + 30 * sin(t / 3)));
+		handler.processCrossfireTelemetryValue(GPS_SATELLITES_INDEX, 14);
+		break;
+	case ATTITUDE_ID:
+		handler.processCrossfireTelemetryValue(ATTITUDE_PITCH_INDEX, (int32_t)(100 * sin(t) + noise(20)));
+		handler.processCrossfireTelemetryValue(ATTITUDE_ROLL_INDEX, (int32_t)(300 * sin(t / 2) + noise(20)));
+		handler.processCrossfireTelemetryValue(ATTITUDE_YAW_INDEX, (int32_t)(3000 * sin(t / 12) + noise(20)));
+		break;
+	case FLIGHT_MODE_ID:
+		handler.processCrossfireTelemetryText(FLIGHT_MODE_INDEX, t < 300 ? "ANGL" : "HOR", t < 300 ? 4 : 3);
+		break;
+	}
+	handler.endCrossfireTelemetryFrame(id);
+}
+
+class NullHandler : public CrossfireTelemetryHandler
+{
+public:
+	void processCrossfireTelemetryValue(uint8_t index, int32_t value) override { doNotOptimize(value); }
+};
+
+// Counts the values of each sensor on their way to the output
+class CountingHandler : public CrossfireTelemetryHandler
+{
+public:
+	uint64_t values[CROSSFIRE_SENSOR_SLOTS] = {};
+
+	explicit CountingHandler(CrossfireTelemetryHandler& output) : output(output) {}
+
+	void beginCrossfireTelemetryFrame(uint8_t id) override { output.beginCrossfireTelemetryFrame(id); }
+	void endCrossfireTelemetryFrame(uint8_t id) override { output.endCrossfireTelemetryFrame(id); }
+
+	void processCrossfireTelemetryValue(uint8_t index, int32_t value) override
+	{
+		++values[index];
+		output.processCrossfireTelemetryValue(index, value);
+	}
+
+	void processCrossfireTelemetryText(uint8_t index, const char* text, uint8_t length) override
+	{
+		++values[index];
+		output.processCrossfireTelemetryText(index, text, length);
+	}
+
+private:
+	CrossfireTelemetryHandler& output;
+};
+
+// Runs the same flight into the handler, returns the number of values sent
+static uint64_t fly(CrossfireTelemetryHandler& handler)
+{
+	// Telemetry at the usual ELRS ratios
+	Stream streams[] = {
+		{ LINK_ID, 100000, 0 }, { ATTITUDE_ID, 40000, 0 }, { GPS_ID, 200000, 0 }, { BATTERY_ID, 200000, 0 }, { FLIGHT_MODE_ID, 1000000, 0 },
+	};
+
+	srand(1);
+	uint64_t values = 0;
+	for (uint64_t time = 0; time < FLIGHT_TIME; time += 1000)
+	{
+		for (Stream& stream : streams)
+		{
+			if (stream.due > time)
+				continue;
+			sendFrame(handler, stream.id, time / 1e6);
+			stream.due += stream.period;
+			values += stream.id == LINK_ID ? 10 : stream.id == GPS_ID ? 6 : stream.id == BATTERY_ID ? 4 : stream.id == ATTITUDE_ID ? 3 : 1;
+		}
+	}
+	return values;
+}
+
+static void run(const char* name, const TelemetryUnits* units, bool changes, const char* deadbands)
+{
+	FILE* file = tmpfile();
+	if (!file)
+		return;
+
+	CsvTelemetrySink sink(file, 100);
+	sink.setUnits(units);
+	TelemetryFilter filter(sink);
+	if (changes)
+		filter.setDeadbandAll(0);
+	if (deadbands)
+		parseTelemetryDeadbands(deadbands, filter);
+	CrossfireTelemetryHandler& handler = changes || deadbands ? (CrossfireTelemetryHandler&)filter : sink;
+
+	auto start = std::chrono::steady_clock::now();
+	uint64_t values = fly(handler);
+	sink.flush();
+	double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+	fflush(file);
+	long size = ftell(file);
+	fclose(file);
+	uint64_t output = changes || deadbands ? filter.getValuesOut() : values;
+	printf("%-20s %8llu %8llu %6.1f%% %10ld %8.1f\n", name, (unsigned long long)values, (unsigned long long)output,
+		100.0 * output / values, size, elapsed / values);
+}
+
+// Values of single sensors left by the change filter alone
+static void runSensors()
+{
+	static const uint8_t indexes[] = {
+		GPS_SATELLITES_INDEX, BATT_CAPACITY_INDEX, BATT_REMAINING_INDEX, FLIGHT_MODE_INDEX, RF_MODE_INDEX, TX_POWER_INDEX,
+		BATT_VOLTAGE_INDEX, RX_RSSI1_INDEX, ATTITUDE_PITCH_INDEX,
+	};
+
+	NullHandler none;
+	CountingHandler out(none);
+	TelemetryFilter filter(out);
+	filter.setDeadbandAll(0);
+	CountingHandler in(filter);
+	fly(in);
+
+	printf("\n%-20s %8s %8s\n", "Changes of", "Values", "Output");
+	for (uint8_t index : indexes)
+	{
+		printf("%-20s %8llu %8llu %6.1f%%\n", getCrossfireSensor(index).name, (unsigned long long)in.values[index],
+			(unsigned long long)out.values[index], 100.0 * out.values[index] / in.values[index]);
+	}
+}
+
+int main()
+{
+	TelemetryUnits imperial(UNITS_IMPERIAL);
+
+	// The generator alone, to take out of the per-value times below
+	NullHandler none;
+	auto start = std::chrono::steady_clock::now();
+	uint64_t values = fly(none);
+	double generate = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / values;
+	printf("Generating the flight: %.1f ns/value\n\n", generate);
+
+	printf("%-20s %8s %8s %7s %10s %8s\n", "Output", "Values", "Output", "", "Bytes", "ns/value");
+	run("raw", nullptr, false, nullptr);
+	run("imperial", &imperial, false, nullptr);
+	run("changes", nullptr, true, nullptr);
+	run("imperial, changes", &imperial, true, nullptr);
+	run("deadbands", nullptr, false, DEADBANDS);
+	run("changes, deadbands", nullptr, true, DEADBANDS);
+	runSensors();
+	return 0;
+}
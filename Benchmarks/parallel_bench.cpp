@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Scaling of the chunked parallel decode with the number of threads on a
+// large noisy stream, checked against one CrossfireStream over the same data.
+// Scan, reconciliation and decode run like in crsf-telemetry-reader --parallel.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "benchmark.h"
+#include "crossfire.h"
+#include "crossfire_parallel.h"
+#include "crossfire_stream.h"
+#include "frame_generator.h"
+
+#define STREAM_SIZE (256 * 1024 * 1024)
+
+class CountingTelemetryHandler : public CrossfireTelemetryHandler
+{
+public:
+	uint64_t values = 0;
+	int64_t sum = 0;
+
+	void processCrossfireTelemetryValue(uint8_t index, int32_t value) override
+	{
+		++values;
+		sum += value;
+	}
+};
+
+// Realistic frames with a corrupted byte now and then
+static std::vector<uint8_t> makeStream()
+{
+	CrossfireFrameGenerator generator;
+	std::vector<uint8_t> data(STREAM_SIZE);
+	data.resize(generator.generateMix(data.data(), data.size()));
+
+	std::mt19937 random(1);
+	for (size_t i = 0; i < data.size() / 4096; i++)
+		data[random() % data.size()] ^= 1 << (random() % 8);
+	return data;
+}
+
+static bool sameStats(const CrossfireStreamStats& a, const CrossfireStreamStats& b)
+{
+	return a.frames == b.frames && a.crcErrors == b.crcErrors && a.resyncs == b.resyncs &&
+		a.bytesSkipped == b.bytesSkipped && a.unknownIds == b.unknownIds;
+}
+
+int main()
+{
+	std::vector<uint8_t> data = makeStream();
+
+	CountingTelemetryHandler expected;
+	CrossfireStream stream(expected);
+	auto start = std::chrono::steady_clock::now();
+	stream.push(data.data(), data.size());
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("CrossfireStream: %.0f MB/s\n", data.size() / seconds / 1e6);
+
+	unsigned cores = std::max(std::thread::hardware_concurrency(), 1u);
+	for (unsigned threads = 1; threads <= cores * 2; threads *= 2)
+	{
+		std::vector<CrossfireChunkScan> scans(threads);
+		std::vector<CountingTelemetryHandler> handlers(threads);
+		std::vector<CrossfireStreamStats> decodeStats(threads);
+		std::vector<std::thread> workers;
+
+		start = std::chrono::steady_clock::now();
+		for (unsigned i = 0; i < threads; i++)
+		{
+			scans[i].begin = data.size() * i / threads;
+			scans[i].end = data.size() * (i + 1) / threads;
+			workers.emplace_back([&, i]() { scanCrossfireChunk(data.data(), data.size(), true, true, scans[i]); });
+		}
+		for (std::thread& worker : workers)
+			worker.join();
+		workers.clear();
+
+		reconcileCrossfireScans(data.data(), data.size(), true, scans.data(), threads);
+
+		for (unsigned i = 0; i < threads; i++)
+			workers.emplace_back([&, i]() { decodeCrossfireFrames(data.data(), scans[i], handlers[i], decodeStats[i]); });
+		for (std::thread& worker : workers)
+			worker.join();
+		seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		CrossfireStreamStats stats;
+		uint64_t values = 0;
+		int64_t sum = 0;
+		for (unsigned i = 0; i < threads; i++)
+		{
+			stats.frames += scans[i].stats.frames;
+			stats.crcErrors += scans[i].stats.crcErrors;
+			stats.resyncs += scans[i].stats.resyncs;
+			stats.bytesSkipped += scans[i].stats.bytesSkipped;
+			stats.unknownIds += decodeStats[i].unknownIds;
+			values += handlers[i].values;
+			sum += handlers[i].sum;
+		}
+
+		bool same = sameStats(stats, stream.getStats()) && values == expected.values && sum == expected.sum;
+		printf("%2u threads: %5.0f MB/s%s\n", threads, data.size() / seconds / 1e6, same ? "" : ", differs from the stream");
+	}
+
+	printf("%u cores\n", cores);
+	return 0;
+}
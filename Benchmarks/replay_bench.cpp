@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Parallel replay of a noisy capture in every output format and thread
+// count, checked byte by byte against a sequential replay which pushes the
+// records one by one like crsf-telemetry-reader --replay. Garbage bursts
+// start with a sync byte and a long length, so some frames come out with a
+// later record than the one holding their last byte. Exits with an error
+// if any output differs.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "capture.h"
+#include "crossfire.h"
+#include "crossfire_stream.h"
+#include "frame_generator.h"
+#include "parallel_replay.h"
+#include "telemetry_sink.h"
+
+#define CAPTURE_SIZE (16 * 1024 * 1024)
+#define START_TIME   1700000000000000ull // us
+
+static const char* formats[] = { "text", "csv", "json", "binary" };
+
+static TelemetrySink* createSink(const char* format, FILE* file)
+{
+	if (!strcmp(format, "json"))
+		return new JsonTelemetrySink(file, PARALLEL_FLUSH_INTERVAL);
+	if (!strcmp(format, "csv"))
+		return new CsvTelemetrySink(file, PARALLEL_FLUSH_INTERVAL);
+	if (!strcmp(format, "binary"))
+		return new BinaryTelemetrySink(file, PARALLEL_FLUSH_INTERVAL);
+	return new TextTelemetrySink(file, PARALLEL_FLUSH_INTERVAL);
+}
+
+// Realistic frames with flipped bits and garbage bursts, written as reads
+// of 1 to 512 bytes
+static bool writeCapture(const char* path)
+{
+	CrossfireFrameGenerator generator;
+	std::vector<uint8_t> frames(CAPTURE_SIZE);
+	frames.resize(generator.generateMix(frames.data(), frames.size()));
+
+	std::mt19937 random(1);
+	for (size_t i = 0; i < frames.size() / 4096; i++)
+		frames[random() % frames.size()] ^= 1 << (random() % 8);
+
+	std::vector<uint8_t> data;
+	data.reserve(frames.size() + frames.size() / 256);
+	for (size_t position = 0; position < frames.size(); )
+	{
+		size_t run = std::min<size_t>(random() % 16384, frames.size() - position);
+		data.insert(data.end(), frames.begin() + position, frames.begin() + position + run);
+		position += run;
+
+		// A frame start with a length reaching into the frames after it
+		data.push_back(RADIO_ADDRESS);
+		data.push_back(MAX_FRAME_LEN - random() % 16);
+		for (size_t i = random() % 8; i > 0; i--)
+			data.push_back((uint8_t)random());
+	}
+
+	CaptureWriter writer;
+	if (!writer.open(path, START_TIME))
+		return false;
+
+	uint64_t time = START_TIME;
+	for (size_t position = 0; position < data.size(); )
+	{
+		size_t length = std::min<size_t>(1 + random() % 512, data.size() - position);
+		time += 100 + random() % 2000;
+		if (!writer.write(time, &data[position], length))
+			return false;
+		position += length;
+	}
+	return writer.flush();
+}
+
+static bool readFile(const char* path, std::vector<uint8_t>& data)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return false;
+
+	uint8_t buffer[65536];
+	size_t read;
+	while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		data.insert(data.end(), buffer, buffer + read);
+	fclose(file);
+	return true;
+}
+
+// Output of one replay, the file has to be closed before data is read
+struct ReplayOutput
+{
+	char* data = nullptr;
+	size_t size = 0;
+	FILE* file = nullptr;
+
+	ReplayOutput() { file = open_memstream(&data, &size); }
+	~ReplayOutput() { free(data); }
+
+	bool operator==(const ReplayOutput& other) const
+	{
+		return size == other.size && !memcmp(data, other.data, size);
+	}
+};
+
+static bool sameStats(const CrossfireStreamStats& a, const CrossfireStreamStats& b)
+{
+	return a.frames == b.frames && a.crcErrors == b.crcErrors && a.resyncs == b.resyncs &&
+		a.bytesSkipped == b.bytesSkipped && a.unknownIds == b.unknownIds;
+}
+
+int main()
+{
+	char path[] = "/tmp/replay_bench_XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0 || !writeCapture(path))
+	{
+		fprintf(stderr, "Unable to write the capture\n");
+		return 1;
+	}
+	close(fd);
+
+	std::vector<uint8_t> capture;
+	readFile(path, capture);
+	printf("Capture: %zu bytes\n", capture.size());
+
+	unsigned cores = std::max(std::thread::hardware_concurrency(), 1u);
+	bool same = true;
+
+	for (const char* format : formats)
+	{
+		ReplayOutput expected;
+		CrossfireStreamStats expectedStats;
+		{
+			TelemetrySink* sink = createSink(format, expected.file);
+			CrossfireStream stream(*sink);
+			CaptureReader reader(capture.data(), capture.size());
+			CaptureRecord record;
+
+			auto start = std::chrono::steady_clock::now();
+			while (reader.next(record))
+			{
+				sink->setTime(record.timestamp);
+				stream.push(record.data, record.length);
+			}
+			delete sink;
+			fclose(expected.file);
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+			expectedStats = stream.getStats();
+			printf("%-6s  sequential: %5.0f MB/s, %zu bytes of output\n", format, capture.size() / seconds / 1e6, expected.size);
+		}
+
+		for (unsigned threads = 1; threads <= cores * 2; threads *= 2)
+		{
+			ReplayOutput output;
+			ParallelReplay replay(path, threads, [&](FILE* file) { return createSink(format, file); }, output.file);
+
+			auto start = std::chrono::steady_clock::now();
+			bool ran = replay.run();
+			fclose(output.file);
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+			CrossfireStreamStats stats = replay.getStats();
+			bool identical = ran && output == expected && sameStats(stats, expectedStats);
+			same = same && identical;
+			printf("%-6s %2u threads: %5.0f MB/s%s\n", format, threads, capture.size() / seconds / 1e6,
+				identical ? "" : ", output differs from the sequential replay");
+		}
+	}
+
+	unlink(path);
+	printf("%u cores\n", cores);
+	return same ? 0 : 1;
+}
@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Throughput of the stream on clean and noisy input and how quickly it
+// recovers after a burst of garbage, like the one a radio sends on USB reconnect
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "benchmark.h"
+#include "crossfire.h"
+#include "crossfire_stream.h"
+
+struct NoisyStream
+{
+	std::vector<uint8_t> data;
+	std::vector<size_t> offsets; // Of every frame sent, the payload starts with its number
+	uint32_t frames = 0;
+	uint32_t bursts = 0;
+};
+
+// Tells frames which were sent apart from noise which passed the CRC check by chance
+class CountingTelemetryHandler : public CrossfireTelemetryHandler
+{
+public:
+	const NoisyStream* input = nullptr;
+	uint64_t values = 0;
+	uint32_t sentFrames = 0;
+
+	void processCrossfireFrame(const CrossfireFrameView& frame) override
+	{
+		const uint8_t* payload = frame.getPayload();
+		uint32_t number = frame.getPayloadLength() >= 4 ? loadBigEndian<4>(payload) : UINT32_MAX;
+		if (number < input->offsets.size() && memcmp(&input->data[input->offsets[number]], frame.getData(), frame.getSize()) == 0)
+			++sentFrames;
+	}
+
+	void processCrossfireTelemetryValue(uint8_t index, int32_t value) override
+	{
+		++values;
+		doNotOptimize(value);
+	}
+};
+
+// frameCount frames, a burst of burstLength random bytes every burstInterval frames
+static NoisyStream makeStream(uint32_t frameCount, uint32_t burstInterval, uint32_t burstLength, uint32_t seed)
+{
+	static const uint8_t ids[] = { LINK_ID, GPS_ID, BATTERY_ID, ATTITUDE_ID, LINK_TX_ID, LINK_RX_ID };
+	static const uint8_t payloadLengths[] = { 10, 15, 8, 6, 9, 9 };
+
+	std::mt19937 random(seed);
+	NoisyStream stream;
+	uint8_t frame[MAX_FRAME_SIZE];
+	uint8_t payload[MAX_FRAME_LEN];
+
+	for (uint32_t i = 0; i < frameCount; i++)
+	{
+		if (burstInterval && i % burstInterval == burstInterval - 1)
+		{
+			for (uint32_t j = 0; j < burstLength; j++)
+				stream.data.push_back((uint8_t)random());
+			++stream.bursts;
+		}
+
+		unsigned type = i % DIM(ids);
+		for (uint8_t j = 4; j < payloadLengths[type]; j++)
+			payload[j] = (uint8_t)random();
+		payload[0] = (uint8_t)(i >> 24);
+		payload[1] = (uint8_t)(i >> 16);
+		payload[2] = (uint8_t)(i >> 8);
+		payload[3] = (uint8_t)i;
+
+		size_t size = buildCrossfireFrame(frame, RADIO_ADDRESS, ids[type], payload, payloadLengths[type]);
+		stream.offsets.push_back(stream.data.size());
+		stream.data.insert(stream.data.end(), frame, frame + size);
+		++stream.frames;
+	}
+
+	return stream;
+}
+
+// Pushes the input in chunks like reads from a device, returns ns per pass
+static double measure(const NoisyStream& input, CountingTelemetryHandler& handler, CrossfireStreamStats& stats)
+{
+	const size_t chunk = 256; // Typical amount of data returned by a single read
+	const int repeats = 20;
+
+	handler.input = &input;
+	return measureNs(repeats, [&](uint64_t) {
+		handler.sentFrames = 0;
+		CrossfireStream stream(handler);
+		for (size_t offset = 0; offset < input.data.size(); offset += chunk)
+			stream.push(&input.data[offset], std::min(chunk, input.data.size() - offset));
+		stats = stream.getStats();
+	});
+}
+
+// Returns ns per frame decoded
+static double run(const char* name, const NoisyStream& input, double cleanNsPerFrame = 0)
+{
+	CountingTelemetryHandler handler;
+	CrossfireStreamStats stats;
+	double ns = measure(input, handler, stats);
+
+	// Random noise passes the CRC8 check by chance (1 in 256 candidates),
+	// those frames are counted as false instead of hiding them in the lost frames
+	uint32_t falseFrames = stats.frames - handler.sentFrames;
+	printf("%-24s %9.1f MB/s %8.1f ns/frame %7u/%-7u frames %5u false %7u crc %6u resyncs",
+		name, input.data.size() * 1000.0 / ns, ns / std::max<uint32_t>(stats.frames, 1),
+		handler.sentFrames, input.frames, falseFrames, stats.crcErrors, stats.resyncs);
+
+	if (input.bursts)
+	{
+		// Time spent on a burst on top of decoding the sent frames, fed the same way
+		double recoveryNs = (ns - cleanNsPerFrame * handler.sentFrames) / input.bursts;
+		printf(" %6.2f lost/burst %8.0f ns/burst", ((double)input.frames - handler.sentFrames) / input.bursts, recoveryNs);
+	}
+
+	printf("\n");
+	return ns / std::max<uint32_t>(stats.frames, 1);
+}
+
+int main()
+{
+	const uint32_t frameCount = 200000;
+
+	double cleanNs = run("clean", makeStream(frameCount, 0, 0, 1));
+	run("burst 64B / 100 frames", makeStream(frameCount, 100, 64, 2), cleanNs);
+	run("burst 1KB / 100 frames", makeStream(frameCount, 100, 1024, 3), cleanNs);
+	run("burst 4KB / 1000 frames", makeStream(frameCount, 1000, 4096, 4), cleanNs);
+
+	// Nothing but garbage, measures raw scanning speed
+	NoisyStream noise;
+	std::mt19937 random(5);
+	noise.data.resize(16 << 20);
+	for (uint8_t& byte : noise.data)
+		byte = (uint8_t)random();
+	run("random noise", noise);
+
+	return 0;
+}
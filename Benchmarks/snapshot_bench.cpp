@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Cost of snapshot reads and writes and a check that reads never tear:
+// a writer thread decodes LINK_TX_ID frames while readers take the RX power,
+// which the sensor table files under LINK_RX_ID, alone and together with
+// the other sensors of the frame. Every frame carries one counter in all of
+// its fields, a read which mixes two frames is reported as torn.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+#include "benchmark.h"
+#include "crossfire.h"
+#include "telemetry_snapshot.h"
+
+#define RUN_TIME 1000 // ms per check
+
+// LINK_TX_ID payload: TX RSSI percent at 1, RX RF power at 4, TX fps / 10 at 5
+static size_t buildLinkTxFrame(uint8_t* frame, uint8_t counter)
+{
+	uint8_t payload[6] = { 0, counter, 0, 0, counter, counter };
+	return buildCrossfireFrame(frame, RADIO_ADDRESS, LINK_TX_ID, payload, sizeof(payload));
+}
+
+// Decodes frames until stopped, returns the number written
+static uint64_t write(TelemetrySnapshot& snapshot, const std::atomic<bool>& stop)
+{
+	uint8_t frames[100][MAX_FRAME_SIZE];
+	for (uint8_t i = 0; i < 100; i++)
+		buildLinkTxFrame(frames[i], i);
+
+	uint64_t count = 0;
+	while (!stop.load(std::memory_order_relaxed))
+	{
+		processCrossfireTelemetryFrame(frames[count % 100], snapshot);
+		count++;
+	}
+	return count;
+}
+
+template <typename Read>
+static bool check(const char* name, Read read)
+{
+	TelemetrySnapshot snapshot;
+	std::atomic<bool> stop{ false };
+	uint64_t frames = 0;
+	std::thread writer([&]() { frames = write(snapshot, stop); });
+
+	uint64_t reads = 0;
+	uint64_t torn = 0;
+	auto start = std::chrono::steady_clock::now();
+	auto end = start + std::chrono::milliseconds(RUN_TIME);
+	while (std::chrono::steady_clock::now() < end)
+	{
+		for (int i = 0; i < 1000; i++)
+		{
+			if (!read(snapshot))
+				torn++;
+		}
+		reads += 1000;
+	}
+	double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	stop = true;
+	writer.join();
+
+	printf("%-28s %12llu reads %8.1f ns/read %12llu frames %8llu torn\n", name, (unsigned long long)reads, ns / reads,
+		(unsigned long long)frames, (unsigned long long)torn);
+	return torn == 0;
+}
+
+int main()
+{
+	// The counter of a frame is also the update count of its sensors modulo 100,
+	// frames are written in order starting with 0
+	bool passed = check("RX power", [](const TelemetrySnapshot& snapshot) {
+		TelemetrySample sample;
+		snapshot.read(RX_RF_POWER_INDEX, sample);
+		return sample.sequence == 0 || (uint32_t)sample.value == (sample.sequence - 1) % 100;
+	});
+
+	passed = check("LINK_TX_ID, 3 sensors", [](const TelemetrySnapshot& snapshot) {
+		const uint8_t indexes[] = { TX_RSSI_PERC_INDEX, RX_RF_POWER_INDEX, TX_FPS_INDEX };
+		TelemetrySample samples[DIM(indexes)];
+		if (!snapshot.read(indexes, samples, DIM(indexes)))
+			return false;
+		return samples[0].value == samples[1].value && samples[2].value == samples[1].value * 10 &&
+			samples[0].timestamp == samples[1].timestamp && samples[1].timestamp == samples[2].timestamp &&
+			samples[0].sequence == samples[1].sequence && samples[1].sequence == samples[2].sequence;
+	}) && passed;
+
+	printf(passed ? "No torn reads\n" : "Torn reads\n");
+	return passed ? 0 : 1;
+}
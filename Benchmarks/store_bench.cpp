@@ -0,0 +1,292 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Size of a simulated 30 minute flight in the columnar store against the
+// text and CSV outputs, and the time to pull one sensor over a minute or
+// to summarize it, from the store and by scanning the CSV.
+// Sensor values drift and read times jitter like a real serial link.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "benchmark.h"
+#include "crossfire.h"
+#include "telemetry_dispatcher.h"
+#include "telemetry_sink.h"
+#include "telemetry_store.h"
+
+#define FLIGHT_TIME  1800000000ull // us
+#define STORE_PATH   "store_bench.sto"
+#define CSV_PATH     "store_bench.csv"
+#define TEXT_PATH    "store_bench.txt"
+
+struct Stream
+{
+	uint8_t id;
+	uint32_t period; // us
+	uint64_t due;
+};
+
+static uint64_t getFileSize(const char* path)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return 0;
+	fseek(file, 0, SEEK_END);
+	uint64_t size = ftell(file);
+	fclose(file);
+	return size;
+}
+
+static std::vector<uint8_t> readFile(const char* path)
+{
+	std::vector<uint8_t> data(getFileSize(path));
+	FILE* file = fopen(path, "rb");
+	if (file)
+	{
+		data.resize(fread(data.data(), 1, data.size(), file));
+		fclose(file);
+	}
+	return data;
+}
+
+// Keeps every sample of one sensor to check what the store gives back
+class SensorRecorder : public CrossfireTelemetryHandler
+{
+public:
+	uint8_t sensor;
+	uint64_t time = 0;
+	std::vector<std::pair<uint64_t, int32_t>> samples;
+
+	explicit SensorRecorder(uint8_t sensor) : sensor(sensor) {}
+
+	void processCrossfireTelemetryValue(uint8_t index, int32_t value) override
+	{
+		if (index == sensor)
+			samples.emplace_back(time, value);
+	}
+};
+
+static double noise(double amplitude)
+{
+	return amplitude * (rand() / (double)RAND_MAX * 2 - 1);
+}
+
+static void sendFrame(CrossfireTelemetryHandler& handler, uint8_t id, uint64_t time)
+{
+	double t = time / 1e6;
+	handler.beginCrossfireTelemetryFrame(id);
+	switch (id)
+	{
+	case LINK_ID:
+		handler.processCrossfireTelemetryValue(RX_RSSI1_INDEX, (int32_t)(-60 - 20 * sin(t / 40) + noise(3)));
+		handler.processCrossfireTelemetryValue(RX_RSSI2_INDEX, (int32_t)(-62 - 20 * sin(t / 40) + noise(3)));
+		handler.processCrossfireTelemetryValue(RX_QUALITY_INDEX, (int32_t)(100 - fabs(noise(4))));
+		handler.processCrossfireTelemetryValue(RX_SNR_INDEX, (int32_t)(8 + noise(2)));
+		handler.processCrossfireTelemetryValue(RX_ANTENNA_INDEX, rand() % 2);
+		handler.processCrossfireTelemetryValue(RF_MODE_INDEX, 6);
+		handler.processCrossfireTelemetryValue(TX_POWER_INDEX, 100);
+		handler.processCrossfireTelemetryValue(TX_RSSI_INDEX, (int32_t)(-58 - 20 * sin(t / 40) + noise(3)));
+		handler.processCrossfireTelemetryValue(TX_QUALITY_INDEX, (int32_t)(100 - fabs(noise(4))));
+		handler.processCrossfireTelemetryValue(TX_SNR_INDEX, (int32_t)(9 + noise(2)));
+		break;
+	case BATTERY_ID:
+		handler.processCrossfireTelemetryValue(BATT_VOLTAGE_INDEX, (int32_t)(168 - t / 60 + noise(1)));
+		handler.processCrossfireTelemetryValue(BATT_CURRENT_INDEX, (int32_t)(150 + noise(40)));
+		handler.processCrossfireTelemetryValue(BATT_CAPACITY_INDEX, (int32_t)(t * 1.2));
+		handler.processCrossfireTelemetryValue(BATT_REMAINING_INDEX, (int32_t)(100 - t / 30));
+		break;
+	case GPS_ID:
+		handler.processCrossfireTelemetryValue(GPS_LATITUDE_INDEX, (int32_t)(47397700 + 2700 * sin(t / 12)));
+		handler.processCrossfireTelemetryValue(GPS_LONGITUDE_INDEX, (int32_t)(8546000 + 4000 * cos(t / 12)));
+		handler.processCrossfireTelemetryValue(GPS_GROUND_SPEED_INDEX, (int32_t)(900 + noise(30)));
+		handler.processCrossfireTelemetryValue(GPS_HEADING_INDEX, (int32_t)fmod(t / 12 * 5730 + 36000, 36000));
+		handler.processCrossfireTelemetryValue(GPS_ALTITUDE_INDEX, (int32_t)(100 + 30 * sin(t / 3)));
+		handler.processCrossfireTelemetryValue(GPS_SATELLITES_INDEX, 14);
+		break;
+	case ATTITUDE_ID:
+		handler.processCrossfireTelemetryValue(ATTITUDE_PITCH_INDEX, (int32_t)(100 * sin(t) + noise(20)));
+		handler.processCrossfireTelemetryValue(ATTITUDE_ROLL_INDEX, (int32_t)(300 * sin(t / 2) + noise(20)));
+		handler.processCrossfireTelemetryValue(ATTITUDE_YAW_INDEX, (int32_t)(3000 * sin(t / 12) + noise(20)));
+		break;
+	case CHANNELS_ID:
+		for (uint8_t i = 0; i < CROSSFIRE_CHANNEL_COUNT; i++)
+		{
+			// Sticks move, switches mostly stay
+			int32_t value = i < 4 ? (int32_t)(1500 + 300 * sin(t * (i + 1) / 3) + noise(2)) : i < 8 ? 1000 + 500 * ((int)(t / 120 + i) % 3) : 1500;
+			handler.processCrossfireTelemetryValue(CHANNEL_FIRST_INDEX + i, value);
+		}
+		break;
+	}
+	handler.endCrossfireTelemetryFrame(id);
+}
+
+int main()
+{
+	FILE* csv = fopen(CSV_PATH, "wb");
+	FILE* text = fopen(TEXT_PATH, "wb");
+	if (!csv || !text)
+	{
+		printf("Unable to create the output files\n");
+		return 1;
+	}
+
+	CsvTelemetrySink csvSink(csv, 100);
+	TextTelemetrySink textSink(text, 100);
+	TelemetryStoreWriter store;
+	store.open(STORE_PATH);
+
+	TelemetryDispatcher dispatcher;
+	dispatcher.add(csvSink);
+	dispatcher.add(textSink);
+	dispatcher.add(store);
+	SensorRecorder recorder(CHANNEL_FIRST_INDEX);
+	dispatcher.add(recorder);
+
+	// Channels at 150 Hz, telemetry at the usual ELRS ratios
+	Stream streams[] = {
+		{ CHANNELS_ID, 6667, 0 }, { LINK_ID, 100000, 0 }, { ATTITUDE_ID, 40000, 0 }, { GPS_ID, 200000, 0 }, { BATTERY_ID, 200000, 0 },
+	};
+
+	const uint64_t start = 1700000000000000ull;
+	uint64_t frames = 0;
+	for (uint64_t time = 0; time < FLIGHT_TIME; time += 1000)
+	{
+		// Bytes arrive in reads about every millisecond
+		uint64_t readTime = start + time + rand() % 300;
+		for (Stream& stream : streams)
+		{
+			if (stream.due > time)
+				continue;
+			store.setTime(readTime);
+			recorder.time = readTime;
+			sendFrame(dispatcher, stream.id, readTime);
+			stream.due += stream.period;
+			frames++;
+		}
+	}
+
+	csvSink.flush();
+	textSink.flush();
+	fclose(csv);
+	fclose(text);
+	uint64_t samples = store.getSamples();
+	store.close();
+
+	uint64_t storeSize = getFileSize(STORE_PATH);
+	uint64_t csvSize = getFileSize(CSV_PATH);
+	uint64_t textSize = getFileSize(TEXT_PATH);
+	printf("%llu frames, %llu samples\n", (unsigned long long)frames, (unsigned long long)samples);
+	printf("Text:  %10llu bytes, %5.2f bytes/sample\n", (unsigned long long)textSize, (double)textSize / samples);
+	printf("CSV:   %10llu bytes, %5.2f bytes/sample\n", (unsigned long long)csvSize, (double)csvSize / samples);
+	printf("Store: %10llu bytes, %5.2f bytes/sample, %.1fx smaller than text, %.1fx than CSV\n", (unsigned long long)storeSize,
+		(double)storeSize / samples, (double)textSize / storeSize, (double)csvSize / storeSize);
+
+	std::vector<uint8_t> storeData = readFile(STORE_PATH);
+	std::vector<uint8_t> csvData = readFile(CSV_PATH);
+	csvData.push_back('\0');
+
+	TelemetryStoreReader reader(storeData.data(), storeData.size());
+
+	// Lossless, samples come back with their time
+	size_t matched = 0;
+	bool same = true;
+	bool valid = reader.query(CHANNEL_FIRST_INDEX, 0, UINT64_MAX, [&](const uint64_t* timestamps, const int32_t* values, size_t count)
+	{
+		for (size_t i = 0; i < count && same; i++)
+		{
+			same = matched < recorder.samples.size() && recorder.samples[matched] == std::make_pair(timestamps[i], values[i]);
+			matched += same;
+		}
+	});
+	if (!valid || !same || matched != recorder.samples.size())
+	{
+		printf("Store does not match the input at sample %zu\n", matched);
+		return 1;
+	}
+	uint64_t from = start + 600000000, to = from + 60000000;
+
+	// The CSV has the decode times of the simulation, the same share of it
+	uint64_t csvFirst = strtoull(strchr((const char*)csvData.data(), '\n') + 1, nullptr, 10);
+	uint64_t csvLast = csvFirst;
+	const char* lastLine = (const char*)csvData.data() + csvData.size() - 2;
+	while (lastLine[-1] != '\n')
+		lastLine--;
+	csvLast = strtoull(lastLine, nullptr, 10);
+	uint64_t csvFrom = csvFirst + (csvLast - csvFirst) * (from - start) / FLIGHT_TIME;
+	uint64_t csvTo = csvFirst + (csvLast - csvFirst) * (to - start) / FLIGHT_TIME;
+
+	// One minute of battery voltage
+	int64_t storeSum = 0;
+	double storeNs = measureNs(10, [&](uint64_t)
+	{
+		storeSum = 0;
+		reader.query(BATT_VOLTAGE_INDEX, from, to, [&](const uint64_t*, const int32_t* values, size_t count)
+		{
+			for (size_t i = 0; i < count; i++)
+				storeSum += values[i];
+		});
+	});
+
+	// The CSV has no index, every line is parsed
+	int64_t csvSum = 0;
+	double csvNs = measureNs(1, [&](uint64_t)
+	{
+		const char* line = strchr((const char*)csvData.data(), '\n') + 1; // Header
+		while (*line)
+		{
+			char* field;
+			uint64_t time = strtoull(line, &field, 10);
+			field = strchr(field + 1, ',') + 1;
+			long index = strtol(field, &field, 10);
+			field = strchr(field + 1, ',') + 1;
+			long value = strtol(field, &field, 10);
+			if (index == BATT_VOLTAGE_INDEX && time >= csvFrom && time < csvTo)
+				csvSum += value;
+			line = strchr(field, '\n') + 1;
+		}
+	});
+	doNotOptimize(storeSum);
+	doNotOptimize(csvSum);
+	printf("One minute of one sensor: store %.3f ms, CSV scan %.1f ms\n", storeNs / 1e6, csvNs / 1e6);
+
+	// Aggregates over the whole flight come mostly from the index
+	TelemetryStoreSummary summary;
+	double summaryNs = measureNs(10, [&](uint64_t) { reader.summarize(CHANNEL_FIRST_INDEX, start, start + FLIGHT_TIME, summary); });
+	printf("Summary of CH1 over the flight: %.3f ms, %u columns from the index, %u decoded\n",
+		summaryNs / 1e6, summary.indexedColumns, summary.decodedColumns);
+
+	double decodeNs = measureNs(10, [&](uint64_t)
+	{
+		storeSum = 0;
+		reader.query(CHANNEL_FIRST_INDEX, start, start + FLIGHT_TIME, [&](const uint64_t*, const int32_t* values, size_t count)
+		{
+			for (size_t i = 0; i < count; i++)
+				storeSum += values[i];
+		});
+	});
+	doNotOptimize(storeSum);
+	printf("Decode of CH1 over the flight: %.2f ns/sample\n", decodeNs / summary.count);
+
+	remove(STORE_PATH);
+	remove(CSV_PATH);
+	remove(TEXT_PATH);
+	return 0;
+}
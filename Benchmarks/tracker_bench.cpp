@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Pointing error of the antenna tracker against a simulated flight path,
+// with and without prediction, for several GPS rates and telemetry delays.
+// Frames are encoded and decoded like the real link, time is simulated.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "antenna_tracker.h"
+#include "crossfire.h"
+
+#define SIMULATION_TIME 120000000 // us
+#define TRACKER_RATE    50        // Hz
+#define SENSOR_RATE     10        // Hz, vario and barometer
+#define LINK_DELAY      20000     // us, also seen by vario and barometer
+#define BARO_REFERENCE  37.0      // m, barometer zero is not the GPS zero
+
+static const TrackerHome home = { 47397700, 8546000, 400 };
+
+static const double pi = 3.14159265358979;
+static const double metersPerMicrodegree = 0.1111949;
+
+struct Position
+{
+	double east, north, up; // m from home
+	double speed, heading, climb; // m/s, degree, m/s
+};
+
+// Circles 600 m north of home at 25 m/s while climbing and diving 30 m
+static Position getPosition(uint64_t time)
+{
+	const double radius = 300, speed = 25, period = 20;
+	double t = time / 1e6;
+	double angle = speed / radius * t;
+
+	Position position;
+	position.east = radius * sin(angle);
+	position.north = 600 + radius * cos(angle);
+	position.up = 100 + 30 * sin(2 * pi * t / period);
+	position.speed = speed;
+	position.heading = fmod(90 + angle * 180 / pi, 360); // Tangent of the clockwise circle
+	position.climb = 30 * 2 * pi / period * cos(2 * pi * t / period);
+	return position;
+}
+
+static void storeBigEndian(uint8_t* byte, int32_t value, int bytes)
+{
+	for (int i = bytes - 1; i >= 0; i--, value >>= 8)
+		byte[i] = (uint8_t)value;
+}
+
+static size_t buildGpsFrame(uint8_t* frame, const Position& position)
+{
+	double longitudeScale = cos(home.latitude / 1e6 * pi / 180);
+	uint8_t payload[15];
+	storeBigEndian(&payload[0], (int32_t)lround((home.latitude + position.north / metersPerMicrodegree) * 10), 4);
+	storeBigEndian(&payload[4], (int32_t)lround((home.longitude + position.east / metersPerMicrodegree / longitudeScale) * 10), 4);
+	storeBigEndian(&payload[8], (int32_t)lround(position.speed * 36), 2);
+	storeBigEndian(&payload[10], (int32_t)lround(position.heading * 100) % 36000, 2);
+	storeBigEndian(&payload[12], (int32_t)lround(home.altitude + position.up) + 1000, 2);
+	payload[14] = 12;
+	return buildCrossfireFrame(frame, RADIO_ADDRESS, GPS_ID, payload, sizeof(payload));
+}
+
+static size_t buildVarioFrame(uint8_t* frame, const Position& position)
+{
+	uint8_t payload[2];
+	storeBigEndian(payload, (int32_t)lround(position.climb * 100), 2);
+	return buildCrossfireFrame(frame, RADIO_ADDRESS, CF_VARIO_ID, payload, sizeof(payload));
+}
+
+static size_t buildBaroFrame(uint8_t* frame, const Position& position)
+{
+	uint8_t payload[2];
+	storeBigEndian(payload, (int32_t)lround((position.up + BARO_REFERENCE) * 10) + 10000, 2);
+	return buildCrossfireFrame(frame, RADIO_ADDRESS, BARO_ALT_ID, payload, sizeof(payload));
+}
+
+// Hands decoded frames to the tracker with the simulated receive time
+class TrackerFeed : public CrossfireTelemetryHandler
+{
+public:
+	AntennaTracker& tracker;
+	uint64_t time = 0;
+
+	explicit TrackerFeed(AntennaTracker& tracker) : tracker(tracker) {}
+
+	void processCrossfireTelemetryValue(uint8_t index, int32_t value) override
+	{
+		if (index < UNKNOWN_INDEX)
+			values[index] = value;
+	}
+
+	void endCrossfireTelemetryFrame(uint8_t id) override
+	{
+		if (id == GPS_ID)
+			tracker.updateGps(time, values[GPS_LATITUDE_INDEX], values[GPS_LONGITUDE_INDEX], values[GPS_ALTITUDE_INDEX],
+				values[GPS_GROUND_SPEED_INDEX], values[GPS_HEADING_INDEX]);
+		else if (id == CF_VARIO_ID)
+			tracker.updateVario(time, values[VERTICAL_SPEED_INDEX]);
+		else if (id == BARO_ALT_ID)
+			tracker.updateBaro(time, values[BARO_ALTITUDE_INDEX]);
+	}
+
+private:
+	int32_t values[UNKNOWN_INDEX] = {};
+};
+
+static void getDirection(const Position& position, double& azimuth, double& elevation)
+{
+	azimuth = atan2(position.east, position.north) * 180 / pi;
+	elevation = atan2(position.up, hypot(position.east, position.north)) * 180 / pi;
+}
+
+// Angle between two directions, degree
+static double getError(double azimuth1, double elevation1, double azimuth2, double elevation2)
+{
+	double a1 = azimuth1 * pi / 180, e1 = elevation1 * pi / 180;
+	double a2 = azimuth2 * pi / 180, e2 = elevation2 * pi / 180;
+	double c = sin(e1) * sin(e2) + cos(e1) * cos(e2) * cos(a1 - a2);
+	return acos(std::min(1.0, std::max(-1.0, c))) * 180 / pi;
+}
+
+static void run(uint32_t gpsRate, uint32_t gpsDelay, bool prediction)
+{
+	AntennaTracker tracker(home);
+	tracker.setPrediction(prediction);
+	tracker.setLead(gpsDelay); // What the GPS module and link add before the reader sees a fix
+
+	TrackerFeed feed(tracker);
+	uint8_t frame[MAX_FRAME_SIZE];
+
+	uint64_t gpsInterval = 1000000 / gpsRate;
+	uint64_t sensorInterval = 1000000 / SENSOR_RATE;
+	uint64_t tick = 1000000 / TRACKER_RATE;
+
+	uint64_t nextGps = gpsDelay;
+	uint64_t nextSensor = LINK_DELAY;
+	std::vector<double> errors;
+	double rate = 0; // Angular speed of the aircraft seen from home, degree/s
+
+	for (uint64_t now = 0; now < SIMULATION_TIME; now += tick)
+	{
+		// Frames received since the last tick, data is as old as its delay
+		while (nextGps <= now || nextSensor <= now)
+		{
+			if (nextGps <= nextSensor)
+			{
+				feed.time = nextGps;
+				buildGpsFrame(frame, getPosition(nextGps - gpsDelay));
+				processCrossfireTelemetryFrame(frame, feed);
+				nextGps += gpsInterval;
+			}
+			else
+			{
+				feed.time = nextSensor;
+				Position position = getPosition(nextSensor - LINK_DELAY);
+				buildVarioFrame(frame, position);
+				processCrossfireTelemetryFrame(frame, feed);
+				buildBaroFrame(frame, position);
+				processCrossfireTelemetryFrame(frame, feed);
+				nextSensor += sensorInterval;
+			}
+		}
+
+		TrackerTarget target;
+		if (!tracker.getTarget(now, target) || now < 5000000) // Let the filter settle
+			continue;
+
+		double azimuth, elevation, nextAzimuth, nextElevation;
+		getDirection(getPosition(now), azimuth, elevation);
+		getDirection(getPosition(now + tick), nextAzimuth, nextElevation);
+
+		errors.push_back(getError(target.azimuth, target.elevation, azimuth, elevation));
+		rate += getError(azimuth, elevation, nextAzimuth, nextElevation) * TRACKER_RATE;
+	}
+
+	double mean = 0;
+	for (double error : errors)
+		mean += error;
+	mean /= errors.size();
+	rate /= errors.size();
+	std::sort(errors.begin(), errors.end());
+
+	// Lag behind the true direction which causes the same mean error
+	printf("%3u Hz %5u ms  %-11s %7.3f %7.3f %7.3f %9.0f\n", gpsRate, gpsDelay / 1000, prediction ? "predicted" : "last fix",
+		mean, errors[errors.size() * 95 / 100], errors.back(), mean / rate * 1000);
+}
+
+int main()
+{
+	static const uint32_t rates[] = { 5, 10 };
+	static const uint32_t delays[] = { 0, 100000, 250000, 500000 };
+
+	printf("Tracker at %d Hz, aircraft circling 300 m radius at 25 m/s, 300-900 m away, climbing and diving 30 m\n\n", TRACKER_RATE);
+	printf("   GPS  delay  target      mean deg p95 deg max deg  lag ms\n");
+
+	for (uint32_t rate : rates)
+	{
+		for (uint32_t delay : delays)
+		{
+			run(rate, delay, false);
+			run(rate, delay, true);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "antenna_tracker.h"
+
+#include <algorithm>
+#include <cmath>
+
+#define METERS_PER_MICRODEGREE  0.1111949f // Earth radius * pi / 180 / 10^6
+#define PI                      3.14159265f
+
+#define MAX_PREDICTION          2000000 // us, the link is probably lost beyond
+#define ACCELERATION_VARIANCE   4.0f    // (m/s^2)^2, how hard the aircraft climbs and dives
+#define GPS_ALTITUDE_VARIANCE   9.0f    // m^2
+#define BARO_ALTITUDE_VARIANCE  0.25f   // m^2
+#define VARIO_VARIANCE          0.09f   // (m/s)^2
+#define BARO_OFFSET_RATE        0.05f   // Share of the GPS - baro difference learned per fix
+
+static float wrapAngle(float angle) // to -180..180
+{
+	angle = fmodf(angle + 180, 360);
+	return (angle < 0 ? angle + 360 : angle) - 180;
+}
+
+AntennaTracker::AntennaTracker(const TrackerHome& home) :
+	home(home),
+	metersPerLongitude(METERS_PER_MICRODEGREE * cosf(home.latitude / 1e6f * PI / 180))
+{
+}
+
+void AntennaTracker::predictFilter(uint64_t time)
+{
+	// Measurements of different frames may arrive slightly out of order
+	if (time <= filterTime)
+		return;
+
+	float dt = (time - filterTime) / 1e6f;
+	filterTime = time;
+
+	altitude += verticalSpeed * dt;
+
+	// P = F P F' + Q for a constant velocity model driven by random acceleration
+	float p01 = p[0][1] + dt * p[1][1];
+	p[0][0] += dt * (p[1][0] + p[0][1]) + dt * dt * p[1][1] + ACCELERATION_VARIANCE * dt * dt * dt * dt / 4;
+	p[0][1] = p01 + ACCELERATION_VARIANCE * dt * dt * dt / 2;
+	p[1][0] = p[0][1];
+	p[1][1] += ACCELERATION_VARIANCE * dt * dt;
+}
+
+void AntennaTracker::correctFilter(int state, float measurement, float variance)
+{
+	float innovation = measurement - (state == 0 ? altitude : verticalSpeed);
+	float s = p[state][state] + variance;
+	float k0 = p[0][state] / s;
+	float k1 = p[1][state] / s;
+
+	altitude += k0 * innovation;
+	verticalSpeed += k1 * innovation;
+
+	float row[2] = { p[state][0], p[state][1] };
+	p[0][0] -= k0 * row[0];
+	p[0][1] -= k0 * row[1];
+	p[1][0] -= k1 * row[0];
+	p[1][1] -= k1 * row[1];
+}
+
+void AntennaTracker::updateGps(uint64_t time, int32_t latitude, int32_t longitude, int32_t altitude, int32_t groundSpeed, int32_t heading)
+{
+	// Longitude difference across the date line
+	int64_t longitudeDelta = (int64_t)longitude - home.longitude;
+	if (longitudeDelta > 180000000)
+		longitudeDelta -= 360000000;
+	else if (longitudeDelta < -180000000)
+		longitudeDelta += 360000000;
+
+	float speed = groundSpeed / 36.0f; // km/h / 10 to m/s
+	float course = heading / 100.0f * PI / 180;
+
+	hasFix = true;
+	fixTime = time;
+	east = longitudeDelta * metersPerLongitude;
+	north = ((int64_t)latitude - home.latitude) * METERS_PER_MICRODEGREE;
+	velocityEast = speed * sinf(course);
+	velocityNorth = speed * cosf(course);
+	gpsAltitude = (float)(altitude - home.altitude);
+
+	if (hasBaro)
+	{
+		float offset = gpsAltitude - baroAltitude;
+		baroOffset = hasBaroOffset ? baroOffset + BARO_OFFSET_RATE * (offset - baroOffset) : offset;
+		hasBaroOffset = true;
+	}
+
+	if (!hasAltitude)
+	{
+		hasAltitude = true;
+		filterTime = time;
+		this->altitude = gpsAltitude;
+		verticalSpeed = 0;
+		p[0][0] = GPS_ALTITUDE_VARIANCE;
+		p[0][1] = p[1][0] = 0;
+		p[1][1] = 4;
+		return;
+	}
+
+	predictFilter(time);
+	correctFilter(0, gpsAltitude, GPS_ALTITUDE_VARIANCE);
+}
+
+void AntennaTracker::updateVario(uint64_t time, int32_t verticalSpeed)
+{
+	if (!hasAltitude)
+		return;
+
+	predictFilter(time);
+	correctFilter(1, verticalSpeed / 100.0f, VARIO_VARIANCE);
+}
+
+void AntennaTracker::updateBaro(uint64_t time, int32_t altitude)
+{
+	hasBaro = true;
+	baroAltitude = altitude / 100.0f;
+
+	if (!hasAltitude || !hasBaroOffset)
+		return;
+
+	predictFilter(time);
+	correctFilter(0, baroAltitude + baroOffset, BARO_ALTITUDE_VARIANCE);
+}
+
+void AntennaTracker::update(const TelemetrySnapshot& snapshot)
+{
+	static const uint8_t gpsIndexes[] = {
+		GPS_LATITUDE_INDEX, GPS_LONGITUDE_INDEX, GPS_ALTITUDE_INDEX, GPS_GROUND_SPEED_INDEX, GPS_HEADING_INDEX,
+	};
+
+	TelemetrySample gps[DIM(gpsIndexes)];
+	TelemetrySample vario, baro;
+	snapshot.read(gpsIndexes, gps, DIM(gpsIndexes));
+	snapshot.read(VERTICAL_SPEED_INDEX, vario);
+	snapshot.read(BARO_ALTITUDE_INDEX, baro);
+
+	// Feed the new measurements oldest first
+	const TelemetrySample* updates[3];
+	size_t count = 0;
+	if (gps[0].sequence != gpsSequence)
+		updates[count++] = &gps[0];
+	if (vario.sequence != varioSequence)
+		updates[count++] = &vario;
+	if (baro.sequence != baroSequence)
+		updates[count++] = &baro;
+
+	std::sort(updates, updates + count, [](const TelemetrySample* a, const TelemetrySample* b) { return a->timestamp < b->timestamp; });
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (updates[i] == &gps[0])
+			updateGps(gps[0].timestamp, gps[0].value, gps[1].value, gps[2].value, gps[3].value, gps[4].value);
+		else if (updates[i] == &vario)
+			updateVario(vario.timestamp, vario.value);
+		else
+			updateBaro(baro.timestamp, baro.value);
+	}
+
+	gpsSequence = gps[0].sequence;
+	varioSequence = vario.sequence;
+	baroSequence = baro.sequence;
+}
+
+bool AntennaTracker::getTarget(uint64_t time, TrackerTarget& target) const
+{
+	if (!hasFix)
+		return false;
+
+	target.age = time > fixTime ? time - fixTime : 0;
+
+	float x = east, y = north, z = gpsAltitude;
+	if (prediction)
+	{
+		float horizon = std::min<uint64_t>(target.age + lead, MAX_PREDICTION) / 1e6f;
+		x += velocityEast * horizon;
+		y += velocityNorth * horizon;
+
+		uint64_t due = time + lead;
+		float climb = due > filterTime ? std::min<uint64_t>(due - filterTime, MAX_PREDICTION) / 1e6f : 0;
+		z = altitude + verticalSpeed * climb;
+	}
+
+	float horizontal = sqrtf(x * x + y * y);
+	float azimuth = atan2f(x, y) * 180 / PI;
+	target.azimuth = azimuth < 0 ? azimuth + 360 : azimuth;
+	target.elevation = atan2f(z, horizontal) * 180 / PI;
+	target.distance = sqrtf(horizontal * horizontal + z * z);
+	return true;
+}
+
+void AntennaTracker::getServoPulses(const TrackerTarget& target, const TrackerServos& servos, uint16_t& pan, uint16_t& tilt)
+{
+	float panAngle = wrapAngle(target.azimuth - servos.panCenter);
+	float tiltAngle = std::min(std::max(target.elevation, 0.0f), 90.0f);
+
+	// Behind the tracker: turn around and look back over the top
+	if (fabsf(panAngle) > servos.panRange / 2 && servos.tiltRange >= 180)
+	{
+		panAngle = wrapAngle(panAngle + 180);
+		tiltAngle = 180 - tiltAngle;
+	}
+
+	panAngle = std::min(std::max(panAngle, -servos.panRange / 2), servos.panRange / 2);
+	tiltAngle = std::min(tiltAngle, servos.tiltRange);
+
+	float span = (float)(servos.maxPulse - servos.minPulse);
+	pan = (uint16_t)lroundf((servos.minPulse + servos.maxPulse) / 2.0f + panAngle / servos.panRange * span);
+	tilt = (uint16_t)lroundf(servos.minPulse + tiltAngle / servos.tiltRange * span);
+}
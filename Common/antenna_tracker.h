@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "telemetry_snapshot.h"
+
+// Tracker position, in the units the GPS sensors are decoded to
+struct TrackerHome
+{
+	int32_t latitude;  // degree / 10^6
+	int32_t longitude; // degree / 10^6
+	int32_t altitude;  // m
+};
+
+struct TrackerTarget
+{
+	float azimuth;   // degree clockwise from north, 0..360
+	float elevation; // degree above the horizon
+	float distance;  // m, straight line
+	uint64_t age;    // us since the newest GPS fix was received
+};
+
+// Pan and tilt servos. Pan covers panRange degree centered on panCenter,
+// positions behind the tracker are reached by flipping tilt over the top
+// when tiltRange allows it (180).
+struct TrackerServos
+{
+	float panCenter = 0;   // degree, direction the tracker faces at center pulse
+	float panRange = 360;  // degree
+	float tiltRange = 90;  // degree, 90 or 180
+	uint16_t minPulse = 1000; // us
+	uint16_t maxPulse = 2000; // us
+};
+
+// Points an antenna at the aircraft. Telemetry arrives late and at a few Hz,
+// so the position is predicted to the time the servos get there: horizontally
+// by dead reckoning from the last fix with GPS speed and heading, vertically
+// by a small Kalman filter of altitude and vertical speed fed by GPS altitude,
+// barometric altitude and the variometer.
+class AntennaTracker
+{
+public:
+	explicit AntennaTracker(const TrackerHome& home);
+
+	// lead is added to the age of the telemetry: GPS and link delay not seen
+	// by the reader plus the time the servos need to move
+	void setLead(uint32_t lead) { this->lead = lead; } // us
+
+	// Without prediction the target is the last reported position
+	void setPrediction(bool enabled) { prediction = enabled; }
+
+	// Measurements with the time they were received, in time order
+	void updateGps(uint64_t time, int32_t latitude, int32_t longitude, int32_t altitude, int32_t groundSpeed, int32_t heading);
+	void updateVario(uint64_t time, int32_t verticalSpeed); // cm/s
+	void updateBaro(uint64_t time, int32_t altitude);       // cm
+
+	// Takes the sensors updated since the last call
+	void update(const TelemetrySnapshot& snapshot);
+
+	// Direction at the given time, false until the first GPS fix
+	bool getTarget(uint64_t time, TrackerTarget& target) const;
+
+	static void getServoPulses(const TrackerTarget& target, const TrackerServos& servos, uint16_t& pan, uint16_t& tilt);
+
+private:
+	TrackerHome home;
+	float metersPerLongitude; // at home latitude, per degree / 10^6
+	uint32_t lead = 0;
+	bool prediction = true;
+
+	// Last fix, east and north of home
+	bool hasFix = false;
+	uint64_t fixTime = 0;
+	float east = 0, north = 0; // m
+	float velocityEast = 0, velocityNorth = 0; // m/s
+	float gpsAltitude = 0; // m above home
+
+	// Vertical Kalman filter, state is altitude above home and vertical speed
+	bool hasAltitude = false;
+	uint64_t filterTime = 0;
+	float altitude = 0, verticalSpeed = 0;
+	float p[2][2] = {};
+
+	// Barometric altitude is relative to an unknown reference, the offset to
+	// GPS altitude is learned slowly
+	bool hasBaro = false;
+	bool hasBaroOffset = false;
+	float baroAltitude = 0; // m, last reading
+	float baroOffset = 0;
+
+	uint32_t gpsSequence = 0;
+	uint32_t varioSequence = 0;
+	uint32_t baroSequence = 0;
+
+	void predictFilter(uint64_t time);
+	void correctFilter(int state, float measurement, float variance);
+};
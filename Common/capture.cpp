@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "capture.h"
+#include "varint.h"
+
+#include <cstring>
+
+bool CaptureWriter::open(const char* path, uint64_t startTime)
+{
+	close();
+
+	file = fopen(path, "wb");
+	if (!file)
+		return false;
+
+	uint8_t header[CAPTURE_HEADER_SIZE];
+	memcpy(header, CAPTURE_MAGIC, 7);
+	header[7] = CAPTURE_VERSION;
+	for (int i = 0; i < 8; i++)
+		header[8 + i] = (uint8_t)(startTime >> (8 * i));
+
+	memcpy(buffer, header, sizeof(header));
+	used = sizeof(header);
+	lastTimestamp = startTime;
+	return true;
+}
+
+bool CaptureWriter::write(uint64_t timestamp, const uint8_t* data, size_t length)
+{
+	if (!file)
+		return false;
+
+	if (used + 2 * VARINT_MAX_SIZE + length > sizeof(buffer) && !flush())
+		return false;
+
+	// Clock going backwards is stored as no delay
+	uint64_t delta = timestamp > lastTimestamp ? timestamp - lastTimestamp : 0;
+	lastTimestamp += delta;
+
+	used += writeVarint(&buffer[used], delta);
+	used += writeVarint(&buffer[used], length);
+
+	if (length > sizeof(buffer) - used)
+	{
+		// Larger than the buffer, write straight through
+		return flush() && fwrite(data, 1, length, file) == length;
+	}
+
+	memcpy(&buffer[used], data, length);
+	used += length;
+	return true;
+}
+
+bool CaptureWriter::flush()
+{
+	if (!file)
+		return false;
+
+	bool result = fwrite(buffer, 1, used, file) == used;
+	used = 0;
+	return result && fflush(file) == 0;
+}
+
+void CaptureWriter::close()
+{
+	if (!file)
+		return;
+
+	flush();
+	fclose(file);
+	file = nullptr;
+}
+
+CaptureReader::CaptureReader(const uint8_t* data, size_t size) :
+	position(data),
+	end(data + size)
+{
+	if (size < CAPTURE_HEADER_SIZE || memcmp(data, CAPTURE_MAGIC, 7) != 0 || data[7] != CAPTURE_VERSION)
+		return;
+
+	for (int i = 0; i < 8; i++)
+		startTime |= (uint64_t)data[8 + i] << (8 * i);
+
+	timestamp = startTime;
+	position += CAPTURE_HEADER_SIZE;
+	valid = true;
+}
+
+bool CaptureReader::next(CaptureRecord& record)
+{
+	if (!valid || position >= end)
+		return false;
+
+	uint64_t delta, length;
+	if (!readVarint(position, end, delta) || !readVarint(position, end, length) ||
+		length > (uint64_t)(end - position))
+	{
+		valid = false; // Truncated, e.g. the recorder was killed
+		return false;
+	}
+
+	timestamp += delta;
+	record.timestamp = timestamp;
+	record.data = position;
+	record.length = (size_t)length;
+	position += length;
+	return true;
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+// Capture file layout
+//   header: "CRSFCAP" magic, version byte, start time (8 bytes little endian, us since epoch)
+//   records: varint time since the previous record (us), varint length, raw bytes
+// Each record is one read from the device exactly as it arrived.
+
+#define CAPTURE_MAGIC          "CRSFCAP"
+#define CAPTURE_VERSION        1
+#define CAPTURE_HEADER_SIZE    16
+#define CAPTURE_BUFFER_SIZE    65536
+
+struct CaptureRecord
+{
+	uint64_t timestamp;   // us since epoch
+	const uint8_t* data;  // points into the capture, valid as long as it is
+	size_t length;
+};
+
+class CaptureWriter
+{
+public:
+	~CaptureWriter() { close(); }
+
+	bool open(const char* path, uint64_t startTime);
+	bool write(uint64_t timestamp, const uint8_t* data, size_t length);
+	bool flush();
+	void close();
+
+private:
+	FILE* file = nullptr;
+	uint64_t lastTimestamp = 0;
+	size_t used = 0;
+	uint8_t buffer[CAPTURE_BUFFER_SIZE];
+};
+
+// Walks the records of a capture held in memory, does not copy the data
+class CaptureReader
+{
+public:
+	CaptureReader(const uint8_t* data, size_t size);
+
+	bool isValid() const { return valid; }
+	uint64_t getStartTime() const { return startTime; }
+
+	// Returns false at the end of the capture or if it is truncated
+	bool next(CaptureRecord& record);
+
+private:
+	const uint8_t* position;
+	const uint8_t* end;
+	uint64_t startTime = 0;
+	uint64_t timestamp = 0;
+	bool valid = false;
+};
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * Based on code named
+ *   edgetx - https://github.com/EdgeTX/edgetx
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "crc8.h"
+
+#define CRC8_POLY_DVB_S2 0xD5
+#define CRC8_POLY_COMMAND 0xBA
+
+// crc8tab[k][x] is the CRC of byte x followed by k zero bytes.
+// CRC is linear, so eight input bytes can be folded with eight independent
+// lookups instead of eight dependent ones (slice-by-8).
+struct Crc8Tables
+{
+	uint8_t tab[8][256];
+};
+
+static constexpr Crc8Tables makeCrc8Tables()
+{
+	Crc8Tables tables = {};
+
+	for (int i = 0; i < 256; i++) {
+		uint8_t crc = (uint8_t)i;
+		for (int bit = 0; bit < 8; bit++)
+			crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ CRC8_POLY_DVB_S2) : (uint8_t)(crc << 1);
+		tables.tab[0][i] = crc;
+	}
+
+	for (int k = 1; k < 8; k++) {
+		for (int i = 0; i < 256; i++)
+			tables.tab[k][i] = tables.tab[0][tables.tab[k - 1][i]];
+	}
+
+	return tables;
+}
+
+static constexpr Crc8Tables crc8tab = makeCrc8Tables();
+
+uint8_t crc8(const uint8_t* ptr, uint32_t len)
+{
+	uint8_t crc = 0;
+
+	for (; len >= 8; len -= 8, ptr += 8) {
+		crc = crc8tab.tab[7][crc ^ ptr[0]] ^
+			crc8tab.tab[6][ptr[1]] ^
+			crc8tab.tab[5][ptr[2]] ^
+			crc8tab.tab[4][ptr[3]] ^
+			crc8tab.tab[3][ptr[4]] ^
+			crc8tab.tab[2][ptr[5]] ^
+			crc8tab.tab[1][ptr[6]] ^
+			crc8tab.tab[0][ptr[7]];
+	}
+
+	while (len--)
+		crc = crc8tab.tab[0][crc ^ *ptr++];
+
+	return crc;
+}
+
+// Commands are rare, bit by bit is fast enough
+uint8_t crc8Command(const uint8_t* ptr, uint32_t len)
+{
+	uint8_t crc = 0;
+
+	while (len--) {
+		crc ^= *ptr++;
+		for (int bit = 0; bit < 8; bit++)
+			crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ CRC8_POLY_COMMAND) : (uint8_t)(crc << 1);
+	}
+
+	return crc;
+}
@@ -0,0 +1,27 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * Based on code named
+ *   edgetx - https://github.com/EdgeTX/edgetx
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+// CRC8 DVB-S2 (polynomial 0xD5) as used by Crossfire
+uint8_t crc8(const uint8_t* ptr, uint32_t len);
+
+// CRC8 polynomial 0xBA, the inner checksum of COMMAND_ID frames
+uint8_t crc8Command(const uint8_t* ptr, uint32_t len);
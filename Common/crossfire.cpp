@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * Based on code named
+ *   edgetx - https://github.com/EdgeTX/edgetx
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "crossfire.h"
+#include "crc8.h"
+#include "crossfire_registry.h"
+
+static inline uint64_t loadLittleEndian64(const uint8_t* data)
+{
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	uint64_t value;
+	memcpy(&value, data, sizeof(value));
+	return value;
+#else
+	uint64_t value = 0;
+	for (int i = 7; i >= 0; i--)
+		value = value << 8 | data[i];
+	return value;
+#endif
+}
+
+// 8 channels in 11 bytes: one 64 bit load covers the first five channels
+// and most of the sixth, the remaining 24 bits hold the rest
+static inline void unpackChannelGroup(const uint8_t* data, uint16_t* channels)
+{
+	uint64_t low = loadLittleEndian64(data);
+	uint32_t high = data[8] | data[9] << 8 | data[10] << 16;
+
+	channels[0] = (uint16_t)(low & 0x7ff);
+	channels[1] = (uint16_t)(low >> 11 & 0x7ff);
+	channels[2] = (uint16_t)(low >> 22 & 0x7ff);
+	channels[3] = (uint16_t)(low >> 33 & 0x7ff);
+	channels[4] = (uint16_t)(low >> 44 & 0x7ff);
+	channels[5] = (uint16_t)((low >> 55 | high << 9) & 0x7ff);
+	channels[6] = (uint16_t)(high >> 2 & 0x7ff);
+	channels[7] = (uint16_t)(high >> 13 & 0x7ff);
+}
+
+void unpackCrossfireChannels(const uint8_t* payload, uint16_t* channels)
+{
+	unpackChannelGroup(payload, channels);
+	unpackChannelGroup(payload + 11, channels + 8);
+}
+
+void packCrossfireChannels(const uint16_t* channels, uint8_t* payload)
+{
+	uint32_t bits = 0;
+	int count = 0;
+	for (int i = 0; i < CROSSFIRE_CHANNEL_COUNT; i++)
+	{
+		bits |= (uint32_t)(channels[i] & 0x7ff) << count;
+		count += 11;
+		while (count >= 8)
+		{
+			*payload++ = (uint8_t)bits;
+			bits >>= 8;
+			count -= 8;
+		}
+	}
+}
+
+const char* getCrossfireFrameName(uint8_t id)
+{
+	return crossfireRegistry.getFrameName(id);
+}
+
+bool processCrossfireTelemetryFrame(const uint8_t* rxBuffer, CrossfireTelemetryHandler& handler)
+{
+	// rxBuffer structure
+	// 0 - RADIO_ADDRESS
+	// 1 - len
+	// 2 - id
+	// (len + 1) - crc, crc8(&rxBuffer[2], len - 1);
+
+	return crossfireRegistry.decode(rxBuffer, handler);
+}
+
+size_t buildCrossfireFrame(uint8_t* frame, uint8_t address, uint8_t id, const uint8_t* payload, uint8_t payloadLength)
+{
+	frame[0] = address;
+	frame[1] = payloadLength + 2; // id + payload + crc
+	frame[2] = id;
+	memcpy(&frame[3], payload, payloadLength);
+	frame[3 + payloadLength] = crc8(&frame[2], payloadLength + 1);
+	return payloadLength + 4;
+}
@@ -18,9 +18,16 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
  // Device address
 #define BROADCAST_ADDRESS              0x00
+#define FLIGHT_CONTROLLER_ADDRESS      0xC8
 #define RADIO_ADDRESS                  0xEA
+#define RECEIVER_ADDRESS               0xEC
 #define MODULE_ADDRESS                 0xEE
 
 // Frame id
@@ -37,6 +44,8 @@
 #define PING_DEVICES_ID                0x28
 #define DEVICE_INFO_ID                 0x29
 #define REQUEST_SETTINGS_ID            0x2A
+#define PARAMETER_SETTINGS_ENTRY_ID    0x2B
+#define PARAMETER_READ_ID              0x2C
 #define COMMAND_ID                     0x32
 #define RADIO_ID                       0x3A
 
@@ -45,6 +54,12 @@
 #define COMMAND_MODEL_SELECT_ID        0x05
 
 #define MIN_FRAME_LEN 3
+#define MAX_FRAME_LEN 62
+#define MAX_FRAME_SIZE (MAX_FRAME_LEN + 2) // +1 for address, +1 for len
+
+#define CROSSFIRE_CHANNEL_COUNT   16
+#define CROSSFIRE_CHANNELS_SIZE   22 // 16 channels of 11 bits
+#define CROSSFIRE_CHANNEL_CENTER  992
 
 enum CrossfireSensorIndexes {
 	RX_RSSI1_INDEX,
@@ -78,6 +93,8 @@ enum CrossfireSensorIndexes {
 	FLIGHT_MODE_INDEX,
 	VERTICAL_SPEED_INDEX,
 	BARO_ALTITUDE_INDEX,
+	CHANNEL_FIRST_INDEX,
+	CHANNEL_LAST_INDEX = CHANNEL_FIRST_INDEX + CROSSFIRE_CHANNEL_COUNT - 1,
 	UNKNOWN_INDEX,
 };
 
@@ -141,10 +158,10 @@ enum TelemetryUnit {
 };
 
 struct CrossfireSensor {
-	const uint8_t id;
-	const uint8_t subId;
-	const TelemetryUnit unit;
-	const uint8_t precision;
+	uint8_t id;
+	uint8_t subId;
+	TelemetryUnit unit;
+	uint8_t precision;
 	const char* name;
 };
 
@@ -315,6 +332,7 @@ struct CrossfireSensor {
 #define STR_SENSOR_SERVO_TEMPERATURE         "SrvT"
 #define STR_SENSOR_SERVO_STATUS              "SrvS"
 #define STR_SENSOR_SPECIAL                   "Spcl"
+#define STR_SENSOR_CHANNEL                   "CH"
 
 #define CS(id,subId,name,unit,precision) {id,subId,unit,precision,name}
 
@@ -350,26 +368,315 @@ const CrossfireSensor crossfireSensors[] = {
   CS(FLIGHT_MODE_ID, 0, STR_SENSOR_FLIGHT_MODE,   UNIT_TEXT,              0),
   CS(CF_VARIO_ID,    0, STR_SENSOR_VSPD,          UNIT_METERS_PER_SECOND, 2),
   CS(BARO_ALT_ID,    0, STR_SENSOR_ALT,           UNIT_METERS,            2),
+  CS(CHANNELS_ID,    0, STR_SENSOR_CHANNEL "1",   UNIT_US,                0),
+  CS(CHANNELS_ID,    1, STR_SENSOR_CHANNEL "2",   UNIT_US,                0),
+  CS(CHANNELS_ID,    2, STR_SENSOR_CHANNEL "3",   UNIT_US,                0),
+  CS(CHANNELS_ID,    3, STR_SENSOR_CHANNEL "4",   UNIT_US,                0),
+  CS(CHANNELS_ID,    4, STR_SENSOR_CHANNEL "5",   UNIT_US,                0),
+  CS(CHANNELS_ID,    5, STR_SENSOR_CHANNEL "6",   UNIT_US,                0),
+  CS(CHANNELS_ID,    6, STR_SENSOR_CHANNEL "7",   UNIT_US,                0),
+  CS(CHANNELS_ID,    7, STR_SENSOR_CHANNEL "8",   UNIT_US,                0),
+  CS(CHANNELS_ID,    8, STR_SENSOR_CHANNEL "9",   UNIT_US,                0),
+  CS(CHANNELS_ID,    9, STR_SENSOR_CHANNEL "10",  UNIT_US,                0),
+  CS(CHANNELS_ID,   10, STR_SENSOR_CHANNEL "11",  UNIT_US,                0),
+  CS(CHANNELS_ID,   11, STR_SENSOR_CHANNEL "12",  UNIT_US,                0),
+  CS(CHANNELS_ID,   12, STR_SENSOR_CHANNEL "13",  UNIT_US,                0),
+  CS(CHANNELS_ID,   13, STR_SENSOR_CHANNEL "14",  UNIT_US,                0),
+  CS(CHANNELS_ID,   14, STR_SENSOR_CHANNEL "15",  UNIT_US,                0),
+  CS(CHANNELS_ID,   15, STR_SENSOR_CHANNEL "16",  UNIT_US,                0),
   CS(0,              0, "UNKNOWN",          UNIT_RAW,               0),
 };
 
+// How a raw field value is converted before it is reported
+enum CrossfireFieldConversion {
+	CONVERT_LINEAR,         // value * multiplier / divider + bias
+	CONVERT_TX_POWER,       // power level index to mW
+	CONVERT_BARO_ALTITUDE,  // dm + 10000, or meters when bit 15 is set
+};
+
+// Telemetry field inside a frame
+struct CrossfireField {
+	const uint8_t offset;   // from the start of the frame (address byte)
+	const uint8_t width;    // big endian, sign extended, all 0xff when not available
+	const CrossfireSensorIndexes index;
+	const CrossfireFieldConversion conversion;
+	const int32_t multiplier;
+	const int32_t divider;
+	const int32_t bias;
+};
+
+#define CF(offset,width,index,multiplier,divider,bias) {offset,width,index,CONVERT_LINEAR,multiplier,divider,bias}
+#define CF_CONVERT(offset,width,index,conversion) {offset,width,index,conversion,1,1,0}
+
+// Field layout of every decoded frame id
+template <uint8_t id>
+struct CrossfireFrameLayout;
+
+template <>
+struct CrossfireFrameLayout<LINK_ID> {
+	static constexpr CrossfireField fields[] = {
+		CF(3,          1, RX_RSSI1_INDEX,          1,  1,     0),
+		CF(4,          1, RX_RSSI2_INDEX,          1,  1,     0),
+		CF(5,          1, RX_QUALITY_INDEX,        1,  1,     0),
+		CF(6,          1, RX_SNR_INDEX,            1,  1,     0),
+		CF(7,          1, RX_ANTENNA_INDEX,        1,  1,     0),
+		CF(8,          1, RF_MODE_INDEX,           1,  1,     0),
+		CF_CONVERT(9,  1, TX_POWER_INDEX,          CONVERT_TX_POWER),
+		CF(10,         1, TX_RSSI_INDEX,           1,  1,     0),
+		CF(11,         1, TX_QUALITY_INDEX,        1,  1,     0),
+		CF(12,         1, TX_SNR_INDEX,            1,  1,     0),
+	};
+};
+
+template <>
+struct CrossfireFrameLayout<GPS_ID> {
+	static constexpr CrossfireField fields[] = {
+		CF(3,          4, GPS_LATITUDE_INDEX,      1,  10,    0),
+		CF(7,          4, GPS_LONGITUDE_INDEX,     1,  10,    0),
+		CF(11,         2, GPS_GROUND_SPEED_INDEX,  1,  1,     0),
+		CF(13,         2, GPS_HEADING_INDEX,       1,  1,     0),
+		CF(15,         2, GPS_ALTITUDE_INDEX,      1,  1,     -1000),
+		CF(17,         1, GPS_SATELLITES_INDEX,    1,  1,     0),
+	};
+};
+
+template <>
+struct CrossfireFrameLayout<LINK_RX_ID> {
+	static constexpr CrossfireField fields[] = {
+		CF(4,          1, RX_RSSI_PERC_INDEX,      1,  1,     0),
+		CF(7,          1, TX_RF_POWER_INDEX,       1,  1,     0),
+	};
+};
+
+template <>
+struct CrossfireFrameLayout<LINK_TX_ID> {
+	static constexpr CrossfireField fields[] = {
+		CF(4,          1, TX_RSSI_PERC_INDEX,      1,  1,     0),
+		CF(7,          1, RX_RF_POWER_INDEX,       1,  1,     0),
+		CF(8,          1, TX_FPS_INDEX,            10, 1,     0),
+	};
+};
+
+template <>
+struct CrossfireFrameLayout<BATTERY_ID> {
+	static constexpr CrossfireField fields[] = {
+		CF(3,          2, BATT_VOLTAGE_INDEX,      1,  1,     0),
+		CF(5,          2, BATT_CURRENT_INDEX,      1,  1,     0),
+		CF(7,          3, BATT_CAPACITY_INDEX,     1,  1,     0),
+		CF(10,         1, BATT_REMAINING_INDEX,    1,  1,     0),
+	};
+};
+
+template <>
+struct CrossfireFrameLayout<ATTITUDE_ID> {
+	static constexpr CrossfireField fields[] = {
+		CF(3,          2, ATTITUDE_PITCH_INDEX,    1,  10,    0),
+		CF(5,          2, ATTITUDE_ROLL_INDEX,     1,  10,    0),
+		CF(7,          2, ATTITUDE_YAW_INDEX,      1,  10,    0),
+	};
+};
+
+template <>
+struct CrossfireFrameLayout<CF_VARIO_ID> {
+	static constexpr CrossfireField fields[] = {
+		CF(3,          2, VERTICAL_SPEED_INDEX,    1,  1,     0),
+	};
+};
+
+template <>
+struct CrossfireFrameLayout<BARO_ALT_ID> {
+	static constexpr CrossfireField fields[] = {
+		CF_CONVERT(3,  2, BARO_ALTITUDE_INDEX,     CONVERT_BARO_ALTITUDE),
+	};
+};
+
 #if !defined(DIM)
 #define DIM(__arr) (sizeof((__arr)) / sizeof((__arr)[0]))
 #endif
 
+#if defined(_MSC_VER)
+#include <stdlib.h>
+#define bswap16(x) _byteswap_ushort(x)
+#define bswap32(x) _byteswap_ulong(x)
+#else
+#define bswap16(x) __builtin_bswap16(x)
+#define bswap32(x) __builtin_bswap32(x)
+#endif
+
+template <int N>
+inline uint32_t loadBigEndian(const uint8_t* byte);
+
+template <>
+inline uint32_t loadBigEndian<1>(const uint8_t* byte)
+{
+	return *byte;
+}
+
+template <>
+inline uint32_t loadBigEndian<2>(const uint8_t* byte)
+{
+	uint16_t value;
+	memcpy(&value, byte, sizeof(value));
+	return bswap16(value);
+}
+
+template <>
+inline uint32_t loadBigEndian<3>(const uint8_t* byte)
+{
+	return (loadBigEndian<2>(byte) << 8) | byte[2];
+}
+
+template <>
+inline uint32_t loadBigEndian<4>(const uint8_t* byte)
+{
+	uint32_t value;
+	memcpy(&value, byte, sizeof(value));
+	return bswap32(value);
+}
+
 template <int N>
 bool getCrossfireTelemetryValue(uint8_t index, int32_t& value,
-	uint8_t* rxBuffer)
+	const uint8_t* rxBuffer)
 {
-	bool result = false;
-	uint8_t* byte = &rxBuffer[index];
-	value = (*byte & 0x80) ? -1 : 0;
-	for (uint8_t i = 0; i < N; i++) {
-		value <<= 8;
-		if (*byte != 0xff) {
-			result = true;
-		}
-		value += *byte++;
-	}
-	return result;
+	constexpr uint32_t missing = 0xffffffffu >> (32 - 8 * N);
+
+	uint32_t raw = loadBigEndian<N>(&rxBuffer[index]);
+	value = (int32_t)(raw << (32 - 8 * N)) >> (32 - 8 * N);
+	return raw != missing;
 }
+
+static const int32_t crossfireTxPowerValues[] = { 0, 10, 25, 100, 500, 1000, 2000, 250, 50 };
+
+template <CrossfireFieldConversion conversion>
+inline int32_t convertCrossfireValue(int32_t value, int32_t multiplier, int32_t divider, int32_t bias)
+{
+	if (conversion == CONVERT_TX_POWER)
+		return (unsigned)value < DIM(crossfireTxPowerValues) ? crossfireTxPowerValues[value] : 0;
+
+	if (conversion == CONVERT_BARO_ALTITUDE)
+		return (value & 0x8000) ? (value & 0x7fff) * 100 : (value & 0xffff) * 10 - 100000; // cm
+
+	return value * multiplier / divider + bias;
+}
+
+// Converted value of field i of the frame layout, false if it is not set
+template <uint8_t id, size_t i>
+inline bool readCrossfireField(const uint8_t* rxBuffer, int32_t& value)
+{
+	constexpr CrossfireField field = CrossfireFrameLayout<id>::fields[i];
+
+	// Field is cut off by a short frame, byte len + 1 is the crc
+	if (field.offset + field.width > rxBuffer[1] + 1)
+		return false;
+
+	if (!getCrossfireTelemetryValue<field.width>(field.offset, value, rxBuffer))
+		return false;
+
+	value = convertCrossfireValue<field.conversion>(value, field.multiplier, field.divider, field.bias);
+	return true;
+}
+
+template <uint8_t id, size_t i, typename Handler>
+inline void decodeCrossfireField(const uint8_t* rxBuffer, Handler& handler)
+{
+	int32_t value;
+	if (readCrossfireField<id, i>(rxBuffer, value))
+		handler.processCrossfireTelemetryValue(CrossfireFrameLayout<id>::fields[i].index, value);
+}
+
+template <uint8_t id, typename Handler, size_t... i>
+inline void decodeCrossfireFields(const uint8_t* rxBuffer, Handler& handler, std::index_sequence<i...>)
+{
+	(decodeCrossfireField<id, i>(rxBuffer, handler), ...);
+}
+
+// Decoder specialized for one frame id, every field extraction is unrolled
+template <uint8_t id, typename Handler>
+void decodeCrossfireFrame(const uint8_t* rxBuffer, Handler& handler)
+{
+	handler.beginCrossfireTelemetryFrame(id);
+	decodeCrossfireFields<id>(rxBuffer, handler, std::make_index_sequence<DIM(CrossfireFrameLayout<id>::fields)>());
+	handler.endCrossfireTelemetryFrame(id);
+}
+
+// 16 channels of 11 bits packed LSB first into CROSSFIRE_CHANNELS_SIZE bytes
+void unpackCrossfireChannels(const uint8_t* payload, uint16_t* channels);
+void packCrossfireChannels(const uint16_t* channels, uint8_t* payload);
+
+// 172..1811 to 988..2012 us, 992 is center
+inline int32_t getCrossfireChannelUs(uint16_t channel)
+{
+	return 1500 + ((int32_t)channel - CROSSFIRE_CHANNEL_CENTER) * 5 / 8;
+}
+
+// Complete, CRC checked frame as it was received. Points into the receive
+// buffer without copying, valid only while the callback runs.
+class CrossfireFrameView
+{
+public:
+	explicit CrossfireFrameView(const uint8_t* frame) : frame(frame) {}
+
+	uint8_t getAddress() const { return frame[0]; }
+	uint8_t getId() const { return frame[2]; }
+	const uint8_t* getPayload() const { return frame + 3; }
+	uint8_t getPayloadLength() const { return frame[1] - 2; } // Without id and crc
+	const uint8_t* getData() const { return frame; }
+	size_t getSize() const { return frame[1] + 2; }
+
+	// Field i of CrossfireFrameLayout<id>, e.g. getField<GPS_ID, 0>() for the
+	// latitude. False if the frame has another id or the field is not set.
+	template <uint8_t id, size_t i>
+	bool getField(int32_t& value) const
+	{
+		return getId() == id && readCrossfireField<id, i>(frame, value);
+	}
+
+	// Raw channel values of a CHANNELS_ID frame
+	bool getChannels(uint16_t* channels) const
+	{
+		if (getId() != CHANNELS_ID || getPayloadLength() < CROSSFIRE_CHANNELS_SIZE)
+			return false;
+
+		unpackCrossfireChannels(getPayload(), channels);
+		return true;
+	}
+
+	// Text payload up to the first NUL, it is not terminated inside the frame
+	const char* getText(uint8_t& length) const
+	{
+		const uint8_t* payload = getPayload();
+		length = 0;
+		while (length < getPayloadLength() && payload[length] != '\0')
+			++length;
+		return (const char*)payload;
+	}
+
+private:
+	const uint8_t* frame;
+};
+
+// Receives decoded telemetry, implemented by the application
+class CrossfireTelemetryHandler
+{
+public:
+	virtual ~CrossfireTelemetryHandler() = default;
+
+	// Every valid frame before it is decoded, including ids the decoder does not know
+	virtual void processCrossfireFrame(const CrossfireFrameView& /*frame*/) {}
+
+	virtual void beginCrossfireTelemetryFrame(uint8_t /*id*/) {}
+	virtual void processCrossfireTelemetryValue(uint8_t index, int32_t value) = 0;
+	virtual void processCrossfireTelemetryText(uint8_t /*index*/, const char* /*text*/, uint8_t /*length*/) {}
+	virtual void endCrossfireTelemetryFrame(uint8_t /*id*/) {}
+};
+
+// Name of a decoded frame id, also of frames registered in crossfireRegistry
+const char* getCrossfireFrameName(uint8_t id);
+
+// rxBuffer points to a complete frame starting with the device address,
+// returns false if the frame id is not known. Decodes through the
+// decoder table of crossfireRegistry.
+bool processCrossfireTelemetryFrame(const uint8_t* rxBuffer, CrossfireTelemetryHandler& handler);
+
+// Writes a complete frame including the CRC, returns its size
+size_t buildCrossfireFrame(uint8_t* frame, uint8_t address, uint8_t id, const uint8_t* payload, uint8_t payloadLength);
@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "crossfire_commands.h"
+#include "crc8.h"
+#include "telemetry_clock.h"
+
+#include <cstring>
+
+static uint32_t loadBigEndian32(const uint8_t* data)
+{
+	return (uint32_t)data[0] << 24 | data[1] << 16 | data[2] << 8 | data[3];
+}
+
+bool parseCrossfireDeviceInfo(const CrossfireFrameView& frame, CrossfireDeviceInfo& info)
+{
+	// Destination, origin, name, serial number, hardware and software version,
+	// parameter count and parameter protocol version
+	const uint8_t* payload = frame.getPayload();
+	size_t length = frame.getPayloadLength();
+	if (frame.getId() != DEVICE_INFO_ID || length < EXTENDED_HEADER_SIZE)
+		return false;
+
+	const uint8_t* name = payload + EXTENDED_HEADER_SIZE;
+	const uint8_t* end = (const uint8_t*)memchr(name, '\0', length - EXTENDED_HEADER_SIZE);
+	if (!end || (size_t)(payload + length - end) < 1 + 14)
+		return false;
+
+	info.address = payload[1];
+	memcpy(info.name, name, end - name + 1);
+	const uint8_t* fields = end + 1;
+	info.serialNumber = loadBigEndian32(fields);
+	info.hardwareVersion = loadBigEndian32(fields + 4);
+	info.softwareVersion = loadBigEndian32(fields + 8);
+	info.parameterCount = fields[12];
+	info.protocolVersion = fields[13];
+	return true;
+}
+
+bool CrossfireCommandChannel::queueFrame(uint8_t device, uint8_t id, const uint8_t* payload, uint8_t payloadLength)
+{
+	uint8_t length = EXTENDED_HEADER_SIZE + payloadLength;
+	if (length > MAX_FRAME_LEN - 2 || used + length + 4 > sizeof(buffer))
+		return false;
+
+	uint8_t extended[MAX_FRAME_LEN];
+	extended[0] = device;
+	extended[1] = origin;
+	if (payloadLength)
+		memcpy(&extended[EXTENDED_HEADER_SIZE], payload, payloadLength);
+	used += buildCrossfireFrame(&buffer[used], UART_SYNC, id, extended, length);
+	return true;
+}
+
+uint16_t CrossfireCommandChannel::addRequest(uint8_t responseId, uint8_t device, int16_t field,
+	CrossfireRequestHandler& handler, uint32_t timeout)
+{
+	Request& request = requests[requestCount++];
+	request.id = nextId;
+	request.responseId = responseId;
+	request.device = device;
+	request.field = field;
+	request.deadline = getTelemetryTime() + timeout;
+	request.answered = false;
+	request.handler = &handler;
+
+	// 0 means failure
+	if (++nextId == 0)
+		nextId = 1;
+	return request.id;
+}
+
+uint16_t CrossfireCommandChannel::pingDevices(CrossfireRequestHandler& handler, uint32_t timeout)
+{
+	if (requestCount == MAX_PENDING_REQUESTS || !queueFrame(BROADCAST_ADDRESS, PING_DEVICES_ID, nullptr, 0))
+		return 0;
+	return addRequest(DEVICE_INFO_ID, BROADCAST_ADDRESS, -1, handler, timeout);
+}
+
+uint16_t CrossfireCommandChannel::requestDeviceInfo(uint8_t device, CrossfireRequestHandler& handler, uint32_t timeout)
+{
+	if (requestCount == MAX_PENDING_REQUESTS || !queueFrame(device, PING_DEVICES_ID, nullptr, 0))
+		return 0;
+	return addRequest(DEVICE_INFO_ID, device, -1, handler, timeout);
+}
+
+uint16_t CrossfireCommandChannel::readParameter(uint8_t device, uint8_t field, uint8_t chunk,
+	CrossfireRequestHandler& handler, uint32_t timeout)
+{
+	uint8_t payload[] = { field, chunk };
+	if (requestCount == MAX_PENDING_REQUESTS || !queueFrame(device, PARAMETER_READ_ID, payload, sizeof(payload)))
+		return 0;
+	return addRequest(PARAMETER_SETTINGS_ENTRY_ID, device, field, handler, timeout);
+}
+
+bool CrossfireCommandChannel::requestSettings(uint8_t device)
+{
+	return queueFrame(device, REQUEST_SETTINGS_ID, nullptr, 0);
+}
+
+bool CrossfireCommandChannel::selectModel(uint8_t device, uint8_t model)
+{
+	// Commands carry their own CRC over the frame id, the addresses and the command
+	uint8_t command[] = { COMMAND_ID, device, origin, SUBCOMMAND_CRSF, COMMAND_MODEL_SELECT_ID, model };
+	uint8_t payload[] = { SUBCOMMAND_CRSF, COMMAND_MODEL_SELECT_ID, model, crc8Command(command, sizeof(command)) };
+	return queueFrame(device, COMMAND_ID, payload, sizeof(payload));
+}
+
+void CrossfireCommandChannel::consumeWrite(size_t length)
+{
+	if (length >= used)
+	{
+		used = 0;
+		return;
+	}
+
+	memmove(buffer, buffer + length, used - length);
+	used -= length;
+}
+
+uint64_t CrossfireCommandChannel::getNextTimeout() const
+{
+	uint64_t next = 0;
+	for (size_t i = 0; i < requestCount; i++)
+	{
+		if (!next || requests[i].deadline < next)
+			next = requests[i].deadline;
+	}
+	return next;
+}
+
+// Handlers may make new requests, the table is updated before the call
+void CrossfireCommandChannel::endRequest(size_t index, bool answered)
+{
+	Request request = requests[index];
+	requests[index] = requests[--requestCount];
+	request.handler->endCrossfireRequest(request.id, answered || request.answered);
+}
+
+void CrossfireCommandChannel::expire(uint64_t now)
+{
+	size_t i = 0;
+	while (i < requestCount)
+	{
+		if (requests[i].deadline <= now)
+		{
+			endRequest(i, false);
+			i = 0; // The table may have changed
+		}
+		else
+			i++;
+	}
+}
+
+void CrossfireCommandChannel::reset()
+{
+	used = 0;
+	while (requestCount > 0)
+		endRequest(requestCount - 1, false);
+}
+
+void CrossfireCommandChannel::processCrossfireFrame(const CrossfireFrameView& frame)
+{
+	if (requestCount == 0 || frame.getId() < PING_DEVICES_ID || frame.getPayloadLength() < EXTENDED_HEADER_SIZE)
+		return;
+
+	const uint8_t* payload = frame.getPayload();
+	uint8_t destination = payload[0];
+	uint8_t device = payload[1];
+	if (destination != origin && destination != BROADCAST_ADDRESS)
+		return;
+
+	for (size_t i = 0; i < requestCount; i++)
+	{
+		Request& request = requests[i];
+		if (request.responseId != frame.getId() || (request.device != BROADCAST_ADDRESS && request.device != device))
+			continue;
+		if (request.field >= 0 && (frame.getPayloadLength() <= EXTENDED_HEADER_SIZE || payload[2] != request.field))
+			continue;
+
+		if (request.device == BROADCAST_ADDRESS)
+		{
+			request.answered = true;
+			request.handler->processCrossfireResponse(request.id, frame);
+		}
+		else
+		{
+			Request answered = request;
+			requests[i] = requests[--requestCount];
+			answered.handler->processCrossfireResponse(answered.id, frame);
+			answered.handler->endCrossfireRequest(answered.id, true);
+		}
+		return;
+	}
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "crossfire.h"
+
+#define COMMAND_BUFFER_SIZE  1024 // Bytes of frames waiting to be written
+#define MAX_PENDING_REQUESTS 32
+
+// Extended frames, ids from PING_DEVICES_ID on, start their payload with
+// the destination and the origin address
+#define EXTENDED_HEADER_SIZE 2
+
+struct CrossfireDeviceInfo
+{
+	uint8_t address;
+	char name[MAX_FRAME_LEN];
+	uint32_t serialNumber;
+	uint32_t hardwareVersion;
+	uint32_t softwareVersion;
+	uint8_t parameterCount;
+	uint8_t protocolVersion;
+};
+
+// Payload of a DEVICE_INFO_ID frame, false if it is malformed
+bool parseCrossfireDeviceInfo(const CrossfireFrameView& frame, CrossfireDeviceInfo& info);
+
+// Receives the answers to requests of a CrossfireCommandChannel
+class CrossfireRequestHandler
+{
+public:
+	virtual ~CrossfireRequestHandler() = default;
+
+	// A frame answering the request
+	virtual void processCrossfireResponse(uint16_t request, const CrossfireFrameView& frame) = 0;
+
+	// Last call for a request: answered is false if nothing came back in
+	// time. Requests to one device end with their answer, broadcasts
+	// collect answers until their timeout.
+	virtual void endCrossfireRequest(uint16_t /*request*/, bool /*answered*/) {}
+};
+
+// Write side of the link. Requests build their frame with the CRC into a
+// fixed buffer, so frames queued together go out in one write, and any
+// number of requests up to MAX_PENDING_REQUESTS can wait for an answer
+// at the same time. Answers are matched by frame id, the device which sent
+// them and, for parameters, the field number.
+//
+// Add the channel to the handlers of the stream reading the port. It is
+// not thread safe, requests are made on the thread which reads the port.
+// Timeouts are in us and start when the request is queued.
+class CrossfireCommandChannel : public CrossfireTelemetryHandler
+{
+public:
+	explicit CrossfireCommandChannel(uint8_t origin = RADIO_ADDRESS) : origin(origin) {}
+
+	// Requests return their id, 0 if the buffer or the request table is full
+
+	// Every device on the bus answers with DEVICE_INFO_ID
+	uint16_t pingDevices(CrossfireRequestHandler& handler, uint32_t timeout);
+
+	// DEVICE_INFO_ID of one device
+	uint16_t requestDeviceInfo(uint8_t device, CrossfireRequestHandler& handler, uint32_t timeout);
+
+	// One chunk of a parameter, answered by PARAMETER_SETTINGS_ENTRY_ID
+	uint16_t readParameter(uint8_t device, uint8_t field, uint8_t chunk, CrossfireRequestHandler& handler, uint32_t timeout);
+
+	// Commands without an answer, false if the buffer is full
+	bool requestSettings(uint8_t device);
+	bool selectModel(uint8_t device, uint8_t model);
+
+	// Frames waiting to be written, in one piece
+	const uint8_t* getWriteBuffer(size_t& length) const { length = used; return buffer; }
+	void consumeWrite(size_t length);
+
+	bool hasPendingRequests() const { return requestCount > 0; }
+
+	// Earliest deadline of the pending requests in getTelemetryTime() us, 0 without any
+	uint64_t getNextTimeout() const;
+
+	// Ends the requests whose time is up
+	void expire(uint64_t now);
+
+	// Drops queued frames and ends all requests, e.g. when the port is closed
+	void reset();
+
+	void processCrossfireFrame(const CrossfireFrameView& frame) override;
+	void processCrossfireTelemetryValue(uint8_t /*index*/, int32_t /*value*/) override {}
+
+private:
+	struct Request
+	{
+		uint16_t id;
+		uint8_t responseId;
+		uint8_t device;   // BROADCAST_ADDRESS collects answers of all devices
+		int16_t field;    // -1 if the answer has no field number
+		uint64_t deadline;
+		bool answered;
+		CrossfireRequestHandler* handler;
+	};
+
+	uint8_t origin;
+	uint8_t buffer[COMMAND_BUFFER_SIZE];
+	size_t used = 0;
+	Request requests[MAX_PENDING_REQUESTS];
+	size_t requestCount = 0;
+	uint16_t nextId = 1;
+
+	bool queueFrame(uint8_t device, uint8_t id, const uint8_t* payload, uint8_t payloadLength);
+	uint16_t addRequest(uint8_t responseId, uint8_t device, int16_t field, CrossfireRequestHandler& handler, uint32_t timeout);
+	void endRequest(size_t index, bool answered);
+};
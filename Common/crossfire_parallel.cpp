@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "crossfire_parallel.h"
+#include "crc8.h"
+#include "crossfire_sync.h"
+
+#include <algorithm>
+
+// Same decisions as CrossfireStream::process over contiguous data.
+// accept(offset, stats) is called before a frame is counted and stops
+// the walk in front of the frame by returning false.
+template <typename Accept>
+static size_t walkFrames(const uint8_t* data, size_t size, size_t position, size_t end, bool final,
+	bool& synchronized, CrossfireStreamStats& stats, Accept accept)
+{
+	while (position < end && size - position >= 2)
+	{
+		size_t skipped = 0;
+		if (!isCrossfireSync(data[position]))
+			skipped = findCrossfireSync(data + position, size - position);
+		else
+		{
+			uint8_t len = data[position + 1];
+			size_t frameSize = len + 2;
+			if (len < MIN_FRAME_LEN || len > MAX_FRAME_LEN)
+				skipped = 1;
+			else if (size - position < frameSize)
+			{
+				if (final)
+					break; // Incomplete frame at the end, the stream keeps it
+				skipped = 1; // Can not happen with the data the caller guarantees
+			}
+			else if (crc8(&data[position + 2], len - 1) != data[position + len + 1])
+			{
+				++stats.crcErrors;
+				skipped = 1;
+			}
+			else
+			{
+				if (!accept(position, stats))
+					return position;
+
+				synchronized = true;
+				++stats.frames;
+				position += frameSize;
+				continue;
+			}
+		}
+
+		if (synchronized)
+		{
+			synchronized = false;
+			++stats.resyncs;
+		}
+		stats.bytesSkipped += skipped;
+		position += skipped;
+	}
+
+	return position;
+}
+
+void scanCrossfireChunk(const uint8_t* data, size_t size, bool final, bool synchronized, CrossfireChunkScan& scan)
+{
+	scan.frames.clear();
+	scan.stats = CrossfireStreamStats();
+	scan.exit = walkFrames(data, size, scan.begin, scan.end, final, synchronized, scan.stats,
+		[&](size_t offset, const CrossfireStreamStats& stats)
+		{
+			if (scan.frames.size() < CROSSFIRE_SCAN_CHECKPOINTS)
+				scan.checkpoints[scan.frames.size()] = stats;
+			scan.frames.push_back((uint32_t)offset);
+			return true;
+		});
+	scan.synchronized = synchronized;
+}
+
+static void addStats(CrossfireStreamStats& stats, const CrossfireStreamStats& add, const CrossfireStreamStats& subtract)
+{
+	stats.frames += add.frames - subtract.frames;
+	stats.crcErrors += add.crcErrors - subtract.crcErrors;
+	stats.resyncs += add.resyncs - subtract.resyncs;
+	stats.bytesSkipped += add.bytesSkipped - subtract.bytesSkipped;
+}
+
+void reconcileCrossfireScans(const uint8_t* data, size_t size, bool final, CrossfireChunkScan* scans, size_t count)
+{
+	for (size_t i = 1; i < count; i++)
+	{
+		const CrossfireChunkScan& previous = scans[i - 1];
+		CrossfireChunkScan& scan = scans[i];
+
+		// Continue the previous walk until it accepts a frame this scan has
+		std::vector<uint32_t> frames;
+		CrossfireStreamStats stats;
+		bool synchronized = previous.synchronized;
+		size_t checkpoints = std::min<size_t>(scan.frames.size(), CROSSFIRE_SCAN_CHECKPOINTS);
+		size_t next = 0;
+		size_t joined = SIZE_MAX;
+
+		size_t position = walkFrames(data, size, previous.exit, scan.end, final, synchronized, stats,
+			[&](size_t offset, const CrossfireStreamStats&)
+			{
+				while (next < checkpoints && scan.frames[next] < offset)
+					next++;
+				if (next < checkpoints && scan.frames[next] == offset)
+				{
+					joined = next;
+					return false;
+				}
+				frames.push_back((uint32_t)offset);
+				return true;
+			});
+
+		if (joined == SIZE_MAX)
+		{
+			// No common frame, the chunk is what the continued walk found
+			scan.frames.swap(frames);
+			scan.stats = stats;
+			scan.exit = position;
+			scan.synchronized = synchronized;
+			continue;
+		}
+
+		addStats(stats, scan.stats, scan.checkpoints[joined]);
+		frames.insert(frames.end(), scan.frames.begin() + joined, scan.frames.end());
+		scan.frames.swap(frames);
+		scan.stats = stats;
+	}
+}
+
+void decodeCrossfireFrames(const uint8_t* data, const CrossfireChunkScan& scan,
+	CrossfireTelemetryHandler& handler, CrossfireStreamStats& stats)
+{
+	for (uint32_t offset : scan.frames)
+	{
+		const uint8_t* frame = data + offset;
+		handler.processCrossfireFrame(CrossfireFrameView(frame));
+		if (!processCrossfireTelemetryFrame(frame, handler))
+			++stats.unknownIds;
+	}
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "crossfire.h"
+#include "crossfire_stream.h"
+
+// Decoding a large recording on several cores. The data is cut into
+// chunks which are scanned for frames independently. A chunk starts at an
+// arbitrary byte, so its scan resynchronizes like the stream does after
+// garbage, with the same sync byte, length and CRC checks. The scans are
+// then reconciled in order: the walk of the chunk before continues into
+// the next chunk until it accepts a frame the scan of that chunk accepted
+// too, from there on both walks are the same. Frames and counters come
+// out exactly as CrossfireStream finds them in the whole data at once.
+
+// Frames at the start of a chunk where the walk of the chunk before may
+// join, later joins rescan the chunk. Misaligned scans realign at the
+// first real frame after a garbage frame or two.
+#define CROSSFIRE_SCAN_CHECKPOINTS 16
+
+struct CrossfireChunkScan
+{
+	size_t begin = 0;
+	size_t end = 0;
+	std::vector<uint32_t> frames; // Offsets of valid frames starting before end
+	CrossfireStreamStats stats;   // Frames, CRC errors, resyncs and bytes skipped
+	CrossfireStreamStats checkpoints[CROSSFIRE_SCAN_CHECKPOINTS]; // Counters before the first frames
+	size_t exit = 0;              // First position of the walk at or after end
+	bool synchronized = true;     // Stream state at exit
+};
+
+// Walks data from scan.begin like CrossfireStream::process. Data has to
+// be valid up to size, which is at least end + MAX_FRAME_SIZE - 1 unless
+// final is set and nothing follows it.
+void scanCrossfireChunk(const uint8_t* data, size_t size, bool final, bool synchronized, CrossfireChunkScan& scan);
+
+// Makes scans[1..count) continue the walk of the scan before,
+// scans[0] has to start at a known stream position
+void reconcileCrossfireScans(const uint8_t* data, size_t size, bool final, CrossfireChunkScan* scans, size_t count);
+
+// Delivers the frames of a scan, counts unknown ids in stats
+void decodeCrossfireFrames(const uint8_t* data, const CrossfireChunkScan& scan,
+	CrossfireTelemetryHandler& handler, CrossfireStreamStats& stats);
@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "crossfire_registry.h"
+
+#include <cstdlib>
+#include <cstring>
+
+CrossfireSensorRegistry crossfireRegistry;
+
+CrossfireSensorRegistry::CrossfireSensorRegistry()
+{
+	for (size_t index = 0; index < CROSSFIRE_SENSOR_SLOTS; index++)
+		sensors[index] = &crossfireSensors[UNKNOWN_INDEX];
+	for (size_t index = 0; index < UNKNOWN_INDEX; index++)
+		sensors[index] = &crossfireSensors[index];
+
+	for (size_t id = 0; id < 256; id++)
+		setFrame((uint8_t)id, decodeUnknown, "UNKNOWN");
+	setFrame(LINK_ID, decodeLayout<LINK_ID>, "LINK_ID");
+	setFrame(GPS_ID, decodeLayout<GPS_ID>, "GPS_ID");
+	setFrame(LINK_RX_ID, decodeLayout<LINK_RX_ID>, "LINK_RX_ID");
+	setFrame(LINK_TX_ID, decodeLayout<LINK_TX_ID>, "LINK_TX_ID");
+	setFrame(BATTERY_ID, decodeLayout<BATTERY_ID>, "BATTERY_ID");
+	setFrame(ATTITUDE_ID, decodeLayout<ATTITUDE_ID>, "ATTITUDE_ID");
+	setFrame(CF_VARIO_ID, decodeLayout<CF_VARIO_ID>, "CF_VARIO_ID");
+	setFrame(BARO_ALT_ID, decodeLayout<BARO_ALT_ID>, "BARO_ALT_ID");
+	setFrame(CHANNELS_ID, decodeChannels, "CHANNELS_ID");
+	setFrame(FLIGHT_MODE_ID, decodeFlightMode, "FLIGHT_MODE_ID");
+}
+
+void CrossfireSensorRegistry::setFrame(uint8_t id, Decoder decoder, const char* name)
+{
+	Frame& frame = frames[id];
+	frame.decoder = decoder;
+	frame.name = name;
+	frame.firstSensor = NO_CROSSFIRE_SENSOR;
+	frame.fieldCount = 0;
+	frame.fields = nullptr;
+}
+
+uint8_t CrossfireSensorRegistry::registerFrame(uint8_t id, const char* name, const CrossfireCustomField* fields, uint8_t count)
+{
+	if (isDecoded(id) || count == 0 || count > MAX_CROSSFIRE_SUBIDS || customSensorCount + count > MAX_CUSTOM_SENSORS ||
+		strlen(name) >= CROSSFIRE_NAME_SIZE)
+		return NO_CROSSFIRE_SENSOR;
+
+	for (uint8_t i = 0; i < count; i++)
+	{
+		// Field has to fit into the longest frame, before the crc
+		if (fields[i].width < 1 || fields[i].width > 4 || fields[i].divider == 0 ||
+			fields[i].offset + fields[i].width > MAX_FRAME_LEN - 2 || strlen(fields[i].name) >= CROSSFIRE_NAME_SIZE)
+			return NO_CROSSFIRE_SENSOR;
+	}
+
+	uint8_t firstSensor = (uint8_t)getSensorCount();
+	CrossfireCustomField* frameFields = &customFields[customSensorCount];
+	for (uint8_t i = 0; i < count; i++)
+	{
+		char* sensorName = sensorNames[customSensorCount];
+		memcpy(sensorName, fields[i].name, strlen(fields[i].name) + 1);
+
+		CrossfireSensor& sensor = customSensors[customSensorCount];
+		sensor = { id, i, fields[i].unit, fields[i].precision, sensorName };
+
+		CrossfireCustomField& field = customFields[customSensorCount];
+		field = fields[i];
+		field.name = sensorName;
+		field.offset += 3; // From the start of the frame like CrossfireField
+
+		sensors[firstSensor + i] = &sensor;
+		customSensorCount++;
+	}
+
+	char* frameName = frameNames[customFrameCount++];
+	memcpy(frameName, name, strlen(name) + 1);
+	setFrame(id, decodeCustom, frameName);
+	frames[id].firstSensor = firstSensor;
+	frames[id].fieldCount = count;
+	frames[id].fields = frameFields;
+	return firstSensor;
+}
+
+template <uint8_t id>
+bool CrossfireSensorRegistry::decodeLayout(const uint8_t* rxBuffer, CrossfireTelemetryHandler& handler, const Frame& /*frame*/)
+{
+	decodeCrossfireFrame<id>(rxBuffer, handler);
+	return true;
+}
+
+bool CrossfireSensorRegistry::decodeChannels(const uint8_t* rxBuffer, CrossfireTelemetryHandler& handler, const Frame& /*frame*/)
+{
+	uint16_t channels[CROSSFIRE_CHANNEL_COUNT];
+	if (!CrossfireFrameView(rxBuffer).getChannels(channels))
+		return true; // Too short, nothing to decode
+
+	handler.beginCrossfireTelemetryFrame(CHANNELS_ID);
+	for (int i = 0; i < CROSSFIRE_CHANNEL_COUNT; i++)
+		handler.processCrossfireTelemetryValue(CHANNEL_FIRST_INDEX + i, getCrossfireChannelUs(channels[i]));
+	handler.endCrossfireTelemetryFrame(CHANNELS_ID);
+	return true;
+}
+
+bool CrossfireSensorRegistry::decodeFlightMode(const uint8_t* rxBuffer, CrossfireTelemetryHandler& handler, const Frame& /*frame*/)
+{
+	// Text is not NUL terminated inside the frame, pass its length instead
+	uint8_t textLength;
+	const char* text = CrossfireFrameView(rxBuffer).getText(textLength);
+
+	handler.beginCrossfireTelemetryFrame(FLIGHT_MODE_ID);
+	handler.processCrossfireTelemetryText(FLIGHT_MODE_INDEX, text, textLength);
+	handler.endCrossfireTelemetryFrame(FLIGHT_MODE_ID);
+	return true;
+}
+
+bool CrossfireSensorRegistry::decodeCustom(const uint8_t* rxBuffer, CrossfireTelemetryHandler& handler, const Frame& frame)
+{
+	uint8_t id = rxBuffer[2];
+	handler.beginCrossfireTelemetryFrame(id);
+	for (uint8_t i = 0; i < frame.fieldCount; i++)
+	{
+		const CrossfireCustomField& field = frame.fields[i];
+
+		// Field is cut off by a short frame, byte len + 1 is the crc
+		if (field.offset + field.width > rxBuffer[1] + 1)
+			continue;
+
+		int32_t value;
+		bool set;
+		switch (field.width)
+		{
+		case 1:  set = getCrossfireTelemetryValue<1>(field.offset, value, rxBuffer); break;
+		case 2:  set = getCrossfireTelemetryValue<2>(field.offset, value, rxBuffer); break;
+		case 3:  set = getCrossfireTelemetryValue<3>(field.offset, value, rxBuffer); break;
+		default: set = getCrossfireTelemetryValue<4>(field.offset, value, rxBuffer); break;
+		}
+		if (set)
+		{
+			value = convertCrossfireValue<CONVERT_LINEAR>(value, field.multiplier, field.divider, field.bias);
+			handler.processCrossfireTelemetryValue(frame.firstSensor + i, value);
+		}
+	}
+	handler.endCrossfireTelemetryFrame(id);
+	return true;
+}
+
+bool CrossfireSensorRegistry::decodeUnknown(const uint8_t* /*rxBuffer*/, CrossfireTelemetryHandler& /*handler*/, const Frame& /*frame*/)
+{
+	return false;
+}
+
+static bool parseNumber(const char*& text, long& number, int base = 10)
+{
+	char* end;
+	number = strtol(text, &end, base);
+	if (end == text)
+		return false;
+	text = end;
+	return true;
+}
+
+// Copies a name of the given length, which has to be shorter than CROSSFIRE_NAME_SIZE
+static bool copyName(char* name, const char* text, size_t length)
+{
+	if (length == 0 || length >= CROSSFIRE_NAME_SIZE)
+		return false;
+	memcpy(name, text, length);
+	name[length] = '\0';
+	return true;
+}
+
+bool parseCrossfireCustomFrame(const char* text, CrossfireSensorRegistry& registry)
+{
+	long id;
+	if (!parseNumber(text, id, 0) || id < 0 || id > 0xff || *text != ',')
+		return false;
+
+	const char* name = ++text;
+	const char* comma = strchr(name, ',');
+	char frameName[CROSSFIRE_NAME_SIZE];
+	if (!comma || !copyName(frameName, name, comma - name))
+		return false;
+	text = comma + 1;
+
+	CrossfireCustomField fields[MAX_CROSSFIRE_SUBIDS];
+	char sensorNames[MAX_CROSSFIRE_SUBIDS][CROSSFIRE_NAME_SIZE];
+	uint8_t count = 0;
+	while (*text)
+	{
+		const char* colon = strpbrk(text, ":,");
+		if (!colon || *colon != ':' || count == MAX_CROSSFIRE_SUBIDS || !copyName(sensorNames[count], text, colon - text))
+			return false;
+		text = colon + 1;
+
+		long offset, width, precision = 0;
+		if (!parseNumber(text, offset) || *text++ != ':' || !parseNumber(text, width))
+			return false;
+		if (*text == ':' && !parseNumber(++text, precision))
+			return false;
+		if (*text && *text != ',')
+			return false;
+		if (offset < 0 || offset > MAX_FRAME_LEN || width < 1 || width > 4 || precision < 0 || precision > 9)
+			return false;
+
+		fields[count] = { (uint8_t)offset, (uint8_t)width, sensorNames[count], UNIT_RAW, (uint8_t)precision, 1, 1, 0 };
+		count++;
+
+		// A comma has to be followed by another field
+		if (*text && !*++text)
+			return false;
+	}
+
+	return registry.registerFrame((uint8_t)id, frameName, fields, count) != NO_CROSSFIRE_SENSOR;
+}
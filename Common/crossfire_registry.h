@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "crossfire.h"
+
+#define CROSSFIRE_SENSOR_SLOTS  256  // Sensor indexes are uint8_t
+#define MAX_CROSSFIRE_SUBIDS    16   // Sensors of one frame id, CHANNELS_ID has the most
+#define NO_CROSSFIRE_SENSOR     0xff // Not a sensor index
+#define MAX_CUSTOM_SENSORS      (NO_CROSSFIRE_SENSOR - UNKNOWN_INDEX - 1)
+#define CROSSFIRE_NAME_SIZE     16   // Longest name of a registered frame or sensor, with the NUL
+
+// Field of a frame registered at runtime, decoded like a CrossfireField:
+// big endian, sign extended, all 0xff when not available
+struct CrossfireCustomField
+{
+	uint8_t offset;    // from the start of the payload
+	uint8_t width;     // 1 to 4 bytes
+	const char* name;  // copied by the registry, shorter than CROSSFIRE_NAME_SIZE
+	TelemetryUnit unit;
+	uint8_t precision;
+	int32_t multiplier;
+	int32_t divider;
+	int32_t bias;
+};
+
+// Sensors and decoders of every frame id. A sensor is found by its index
+// in a table with a slot for every uint8_t, a frame is decoded through a
+// table of decoders indexed by its id, so neither walks a list nor
+// branches on the id.
+//
+// The built-in sensors keep their CrossfireSensorIndexes, sensors of
+// frames registered at runtime get the indexes after UNKNOWN_INDEX.
+// Registered frames are kept in fixed arrays, nothing is allocated.
+// Frames are registered before decoding starts; decoding only reads the
+// tables and is safe from several threads.
+class CrossfireSensorRegistry
+{
+public:
+	CrossfireSensorRegistry();
+
+	// UNKNOWN for an index without a sensor, e.g. one read from another
+	// process, every uint8_t has a slot
+	const CrossfireSensor& getSensor(uint8_t index) const { return *sensors[index]; }
+
+	// Indexes in use, built-in ones, UNKNOWN_INDEX and then custom ones
+	size_t getSensorCount() const { return UNKNOWN_INDEX + 1 + customSensorCount; }
+
+	const char* getFrameName(uint8_t id) const { return frames[id].name; }
+	bool isDecoded(uint8_t id) const { return frames[id].decoder != decodeUnknown; }
+
+	// Decodes the fields of a frame id the built-in decoder does not know.
+	// Returns the index of the first field's sensor, the others follow, or
+	// NO_CROSSFIRE_SENSOR if the id is decoded already, a name is too long
+	// or there is no room.
+	uint8_t registerFrame(uint8_t id, const char* name, const CrossfireCustomField* fields, uint8_t count);
+
+	// rxBuffer points to a complete frame, returns false if its id is not decoded
+	bool decode(const uint8_t* rxBuffer, CrossfireTelemetryHandler& handler) const
+	{
+		const Frame& frame = frames[rxBuffer[2]];
+		return frame.decoder(rxBuffer, handler, frame);
+	}
+
+private:
+	struct Frame;
+	typedef bool (*Decoder)(const uint8_t* rxBuffer, CrossfireTelemetryHandler& handler, const Frame& frame);
+
+	struct Frame
+	{
+		Decoder decoder;
+		const char* name;
+		uint8_t firstSensor; // Custom frames
+		uint8_t fieldCount;
+		const CrossfireCustomField* fields;
+	};
+
+	Frame frames[256];
+	const CrossfireSensor* sensors[CROSSFIRE_SENSOR_SLOTS];
+
+	// Storage of registered frames, a frame has at least one sensor
+	CrossfireSensor customSensors[MAX_CUSTOM_SENSORS];
+	CrossfireCustomField customFields[MAX_CUSTOM_SENSORS];
+	char sensorNames[MAX_CUSTOM_SENSORS][CROSSFIRE_NAME_SIZE];
+	char frameNames[MAX_CUSTOM_SENSORS][CROSSFIRE_NAME_SIZE];
+	uint8_t customSensorCount = 0;
+	uint8_t customFrameCount = 0;
+
+	void setFrame(uint8_t id, Decoder decoder, const char* name);
+
+	template <uint8_t id>
+	static bool decodeLayout(const uint8_t* rxBuffer, CrossfireTelemetryHandler& handler, const Frame& frame);
+	static bool decodeChannels(const uint8_t* rxBuffer, CrossfireTelemetryHandler& handler, const Frame& frame);
+	static bool decodeFlightMode(const uint8_t* rxBuffer, CrossfireTelemetryHandler& handler, const Frame& frame);
+	static bool decodeCustom(const uint8_t* rxBuffer, CrossfireTelemetryHandler& handler, const Frame& frame);
+	static bool decodeUnknown(const uint8_t* rxBuffer, CrossfireTelemetryHandler& handler, const Frame& frame);
+};
+
+// Used by processCrossfireTelemetryFrame() and the output
+extern CrossfireSensorRegistry crossfireRegistry;
+
+inline const CrossfireSensor& getCrossfireSensor(uint8_t index)
+{
+	return crossfireRegistry.getSensor(index);
+}
+
+// Registers a frame described as ID,NAME,SENSOR:OFFSET:WIDTH[:PRECISION],...
+// e.g. 0x40,ESC_ID,ERPM:0:2,ETmp:2:1:1 with offsets into the payload.
+// Returns false if the text is invalid or the frame could not be registered.
+bool parseCrossfireCustomFrame(const char* text, CrossfireSensorRegistry& registry);
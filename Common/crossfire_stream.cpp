@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "crossfire_stream.h"
+#include "crc8.h"
+#include "crossfire_sync.h"
+
+void CrossfireStream::push(const uint8_t* data, size_t length)
+{
+	while (length > 0)
+	{
+		size_t written = rx.write(data, length);
+		data += written;
+		length -= written;
+		stats.bytes += written;
+		if (metrics)
+			readTime = getTelemetryTimeNs();
+		process();
+	}
+}
+
+void CrossfireStream::reset()
+{
+	rx.consume(rx.size());
+	synchronized = true;
+}
+
+void CrossfireStream::skip(size_t length)
+{
+	if (synchronized)
+	{
+		synchronized = false;
+		++stats.resyncs;
+	}
+
+	stats.bytesSkipped += length;
+	rx.consume(length);
+}
+
+void CrossfireStream::MeasuringHandler::processCrossfireTelemetryValue(uint8_t index, int32_t value)
+{
+	if (!firstValueTime)
+		firstValueTime = getTelemetryTimeNs();
+	handler->processCrossfireTelemetryValue(index, value);
+}
+
+void CrossfireStream::MeasuringHandler::processCrossfireTelemetryText(uint8_t index, const char* text, uint8_t length)
+{
+	if (!firstValueTime)
+		firstValueTime = getTelemetryTimeNs();
+	handler->processCrossfireTelemetryText(index, text, length);
+}
+
+// Same as the end of process() with a timestamp after every stage
+void CrossfireStream::processMeasured(const uint8_t* frame, uint64_t assembledTime)
+{
+	uint64_t times[STAGE_COUNT];
+	times[STAGE_ASSEMBLED] = assembledTime;
+	times[STAGE_CRC_CHECKED] = getTelemetryTimeNs();
+
+	measuringHandler.firstValueTime = 0;
+	measuringHandler.processCrossfireFrame(CrossfireFrameView(frame));
+	bool known = processCrossfireTelemetryFrame(frame, measuringHandler);
+	times[STAGE_DELIVERED] = getTelemetryTimeNs();
+
+	// A frame without valid fields is decoded when it is delivered
+	times[STAGE_DECODED] = measuringHandler.firstValueTime ? measuringHandler.firstValueTime : times[STAGE_DELIVERED];
+
+	if (!known)
+		countUnknown(frame[2]);
+	metrics->recordFrame(frame[2], readTime, times, known ? STAGE_COUNT : STAGE_DECODED);
+}
+
+void CrossfireStream::process()
+{
+	uint8_t copy[MAX_FRAME_SIZE];
+
+	while (rx.size() >= 2)
+	{
+		if (!isCrossfireSync(rx[0]))
+		{
+			// Jump to the next sync byte instead of walking byte by byte
+			size_t length;
+			const uint8_t* data = rx.readBuffer(length);
+			skip(findCrossfireSync(data, length));
+			continue;
+		}
+
+		uint8_t len = rx[1];
+
+		if (len < MIN_FRAME_LEN || len > MAX_FRAME_LEN)
+		{
+			// Not a frame start, keep looking from the next byte
+			skip(1);
+			continue;
+		}
+
+		size_t frameSize = len + 2; // +1 for address, +1 for len
+		if (rx.size() < frameSize)
+			break; // The rest of the frame comes with the next read
+
+		// Frames are used in place unless they wrap around the end of the buffer
+		size_t contiguous;
+		const uint8_t* frame = rx.readBuffer(contiguous);
+		if (contiguous < frameSize)
+		{
+			rx.copy(copy, 0, frameSize);
+			frame = copy;
+		}
+		uint64_t assembledTime = metrics ? getTelemetryTimeNs() : 0;
+
+		if (crc8(&frame[2], len - 1) != frame[len + 1])
+		{
+			// Either a corrupted frame or a sync byte inside garbage,
+			// a real frame may start anywhere after this byte
+			++stats.crcErrors;
+			skip(1);
+			continue;
+		}
+
+		synchronized = true;
+
+		++stats.frames;
+		if (metrics)
+			processMeasured(frame, assembledTime);
+		else
+		{
+			handler.processCrossfireFrame(CrossfireFrameView(frame));
+			if (!processCrossfireTelemetryFrame(frame, handler))
+				countUnknown(frame[2]);
+		}
+
+		// Only now, the frame may point into the buffer
+		rx.consume(frameSize);
+	}
+
+	if (metrics)
+		metrics->publish(stats);
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include "crossfire.h"
+#include "ringbuffer.h"
+#include "telemetry_clock.h"
+#include "telemetry_metrics.h"
+
+// Bounds all memory used by a stream, has to be a power of two and hold
+// at least one frame. Embedded builds may define a smaller size.
+#ifndef RX_BUFFER_SIZE
+#define RX_BUFFER_SIZE 4096
+#endif
+
+struct CrossfireStreamStats
+{
+	uint64_t bytes = 0;
+	uint32_t frames = 0;
+	uint32_t unknownIds = 0;   // Valid frames the decoder does not know
+	uint32_t crcErrors = 0;    // Frame candidates dropped because of a bad checksum
+	uint32_t resyncs = 0;      // Times the stream lost frame alignment
+	uint64_t bytesSkipped = 0; // Bytes which were not part of a valid frame
+};
+
+// Splits a continuous byte stream into frames. Bytes of a frame which is
+// not complete yet stay in the buffer until the next read delivers the rest.
+// A frame is accepted only after its length and CRC are checked, otherwise
+// the stream resynchronizes at the next sync byte.
+//
+// The stream never allocates and never modifies the data pushed into it,
+// valid frames are handed to the handler straight out of its buffer.
+class CrossfireStream
+{
+public:
+	explicit CrossfireStream(CrossfireTelemetryHandler& handler) : handler(handler) { measuringHandler.handler = &handler; }
+
+	// Zero-copy: read from the device straight into the stream, then commit
+	uint8_t* writeBuffer(size_t& length) { return rx.writeBuffer(length); }
+	void commit(size_t length)
+	{
+		rx.commit(length);
+		stats.bytes += length;
+		if (metrics)
+			readTime = getTelemetryTimeNs();
+	}
+
+	// Copies and processes data of any length
+	void push(const uint8_t* data, size_t length);
+
+	// Decodes all complete frames
+	void process();
+
+	// Drops everything buffered, e.g. after the device was reopened
+	void reset();
+
+	const CrossfireStreamStats& getStats() const { return stats; }
+
+	// Valid frames of an id the decoder does not know, to discover vendor frames
+	uint32_t getUnknownFrames(uint8_t id) const { return unknownFrames[id]; }
+
+	// Measures every frame while set, costs a clock read per stage
+	void setMetrics(TelemetryMetrics* metrics) { this->metrics = metrics; }
+
+private:
+	CrossfireTelemetryHandler& handler;
+	RingBuffer<RX_BUFFER_SIZE> rx;
+	CrossfireStreamStats stats;
+	uint32_t unknownFrames[256] = {};
+	bool synchronized = true;
+	TelemetryMetrics* metrics = nullptr;
+	uint64_t readTime = 0; // ns, completion of the last read
+
+	// Notes when the first value of a frame reaches the consumer
+	class MeasuringHandler : public CrossfireTelemetryHandler
+	{
+	public:
+		CrossfireTelemetryHandler* handler = nullptr;
+		uint64_t firstValueTime = 0;
+
+		void processCrossfireFrame(const CrossfireFrameView& frame) override { handler->processCrossfireFrame(frame); }
+		void beginCrossfireTelemetryFrame(uint8_t id) override { handler->beginCrossfireTelemetryFrame(id); }
+		void processCrossfireTelemetryValue(uint8_t index, int32_t value) override;
+		void processCrossfireTelemetryText(uint8_t index, const char* text, uint8_t length) override;
+		void endCrossfireTelemetryFrame(uint8_t id) override { handler->endCrossfireTelemetryFrame(id); }
+	};
+
+	MeasuringHandler measuringHandler;
+
+	void skip(size_t length);
+	void countUnknown(uint8_t id)
+	{
+		++stats.unknownIds;
+		++unknownFrames[id];
+	}
+	void processMeasured(const uint8_t* frame, uint64_t assembledTime);
+};
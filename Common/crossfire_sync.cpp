@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "crossfire_sync.h"
+#include "crc8.h"
+
+#include <cstring>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#define BYTES_0x01 0x0101010101010101ull
+#define BYTES_0x80 0x8080808080808080ull
+
+// Sets the high bit of every byte which is zero. Bits above the first zero
+// byte may be false positives, the lowest set bit is always exact.
+static inline uint64_t zeroBytes(uint64_t word)
+{
+	return (word - BYTES_0x01) & ~word & BYTES_0x80;
+}
+
+static inline unsigned lowestSetBit(uint64_t mask)
+{
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward64(&index, mask);
+	return index;
+#else
+	return __builtin_ctzll(mask);
+#endif
+}
+
+size_t findCrossfireSync(const uint8_t* data, size_t length)
+{
+	size_t offset = 0;
+
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	for (; offset + sizeof(uint64_t) <= length; offset += sizeof(uint64_t))
+	{
+		uint64_t word;
+		memcpy(&word, data + offset, sizeof(word));
+
+		uint64_t mask = zeroBytes(word ^ (RADIO_ADDRESS * BYTES_0x01)) |
+			zeroBytes(word ^ (UART_SYNC * BYTES_0x01)) |
+			zeroBytes(word ^ (MODULE_ADDRESS * BYTES_0x01));
+
+		if (mask)
+			return offset + lowestSetBit(mask) / 8;
+	}
+#endif
+
+	for (; offset < length; offset++)
+	{
+		if (isCrossfireSync(data[offset]))
+			return offset;
+	}
+
+	return length;
+}
+
+bool isValidCrossfireFrame(const uint8_t* frame)
+{
+	uint8_t len = frame[1];
+	if (len < MIN_FRAME_LEN || len > MAX_FRAME_LEN)
+		return false;
+
+	return crc8(&frame[2], len - 1) == frame[len + 1];
+}
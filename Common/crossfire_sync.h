@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "crossfire.h"
+
+// Bytes a frame can start with
+inline bool isCrossfireSync(uint8_t byte)
+{
+	return byte == RADIO_ADDRESS || byte == UART_SYNC || byte == MODULE_ADDRESS;
+}
+
+// Offset of the first sync byte in data, or length if there is none.
+// Scans a machine word at a time.
+size_t findCrossfireSync(const uint8_t* data, size_t length);
+
+// Checks that a complete frame candidate has a sane length and a valid CRC
+bool isValidCrossfireFrame(const uint8_t* frame);
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "frame_generator.h"
+
+#include <cstring>
+
+static const char* const flightModes[] = { "ACRO", "ANGL", "HOR", "AIR", "!FS!", "RTH", "WAIT" };
+
+template <int N>
+static void storeBigEndian(uint8_t* byte, int32_t value)
+{
+	for (int i = N - 1; i >= 0; i--) {
+		byte[i] = (uint8_t)value;
+		value >>= 8;
+	}
+}
+
+// xorshift32, fast and deterministic for a given seed
+uint32_t CrossfireFrameGenerator::random()
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed;
+}
+
+int32_t CrossfireFrameGenerator::wander(int32_t value, int32_t step, int32_t min, int32_t max)
+{
+	value += (int32_t)(random() % (2 * step + 1)) - step;
+	return value < min ? min : (value > max ? max : value);
+}
+
+size_t CrossfireFrameGenerator::generate(uint8_t id, uint8_t* frame)
+{
+	uint8_t payload[MAX_FRAME_LEN];
+	uint8_t length;
+
+	switch (id)
+	{
+	case LINK_ID:
+		payload[0] = (uint8_t)(60 + random() % 40);  // uplink RSSI ant 1, -dBm
+		payload[1] = (uint8_t)(60 + random() % 40);  // uplink RSSI ant 2, -dBm
+		payload[2] = (uint8_t)(90 + random() % 11);  // uplink link quality
+		payload[3] = (uint8_t)(int8_t)(random() % 20 - 5); // uplink SNR
+		payload[4] = (uint8_t)(random() % 2);        // active antenna
+		payload[5] = 2;                              // RF mode
+		payload[6] = (uint8_t)(random() % 9);        // uplink TX power level
+		payload[7] = (uint8_t)(60 + random() % 40);  // downlink RSSI
+		payload[8] = (uint8_t)(90 + random() % 11);  // downlink link quality
+		payload[9] = (uint8_t)(int8_t)(random() % 20 - 5); // downlink SNR
+		length = 10;
+		break;
+
+	case GPS_ID:
+		latitude = wander(latitude, 50, -900000000, 900000000);
+		longitude = wander(longitude, 50, -1800000000, 1800000000);
+		altitude = wander(altitude, 1, 0, 65534);
+		heading = wander(heading, 100, 0, 35999);
+		storeBigEndian<4>(&payload[0], latitude);
+		storeBigEndian<4>(&payload[4], longitude);
+		storeBigEndian<2>(&payload[8], 300 + random() % 200);   // ground speed, km/h / 10
+		storeBigEndian<2>(&payload[10], heading);
+		storeBigEndian<2>(&payload[12], altitude);
+		payload[14] = (uint8_t)(8 + random() % 10);              // satellites
+		length = 15;
+		break;
+
+	case LINK_RX_ID:
+		payload[0] = (uint8_t)(60 + random() % 40);  // RSSI, -dBm
+		payload[1] = (uint8_t)(random() % 101);      // RSSI %
+		payload[2] = (uint8_t)(90 + random() % 11);  // link quality
+		payload[3] = (uint8_t)(int8_t)(random() % 20 - 5); // SNR
+		payload[4] = (uint8_t)(random() % 30);       // RF power, dBm
+		length = 5;
+		break;
+
+	case LINK_TX_ID:
+		payload[0] = (uint8_t)(60 + random() % 40);  // RSSI, -dBm
+		payload[1] = (uint8_t)(random() % 101);      // RSSI %
+		payload[2] = (uint8_t)(90 + random() % 11);  // link quality
+		payload[3] = (uint8_t)(int8_t)(random() % 20 - 5); // SNR
+		payload[4] = (uint8_t)(random() % 30);       // RF power, dBm
+		payload[5] = 50;                             // FPS / 10
+		length = 6;
+		break;
+
+	case BATTERY_ID:
+		capacity += random() % 2;
+		storeBigEndian<2>(&payload[0], 160 + random() % 8);      // voltage, V / 10
+		storeBigEndian<2>(&payload[2], random() % 300);          // current, A / 10
+		storeBigEndian<3>(&payload[4], capacity);
+		payload[7] = (uint8_t)(100 - (capacity / 50) % 100);     // remaining %
+		length = 8;
+		break;
+
+	case ATTITUDE_ID:
+		storeBigEndian<2>(&payload[0], (int32_t)(random() % 20000) - 10000); // pitch, rad / 10000
+		storeBigEndian<2>(&payload[2], (int32_t)(random() % 20000) - 10000); // roll
+		storeBigEndian<2>(&payload[4], (int32_t)(random() % 62832) - 31416); // yaw
+		length = 6;
+		break;
+
+	case CHANNELS_ID:
+		// Sticks move, switches sit at one end or the other
+		for (int i = 0; i < CROSSFIRE_CHANNEL_COUNT; i++)
+			channels[i] = (uint16_t)(i < 4 ? wander(channels[i], 20, 172, 1811) : (random() % 64 ? channels[i] : (channels[i] == 172 ? 1811 : 172)));
+		packCrossfireChannels(channels, payload);
+		length = CROSSFIRE_CHANNELS_SIZE;
+		break;
+
+	case FLIGHT_MODE_ID:
+	{
+		const char* mode = flightModes[(counter / 500) % DIM(flightModes)];
+		length = (uint8_t)strlen(mode) + 1; // Radios send the terminating NUL
+		memcpy(payload, mode, length);
+		break;
+	}
+
+	default:
+		return 0;
+	}
+
+	++counter;
+	return buildCrossfireFrame(frame, RADIO_ADDRESS, id, payload, length);
+}
+
+size_t CrossfireFrameGenerator::generateMix(uint8_t* buffer, size_t size)
+{
+	// Link statistics are sent every cycle, sensors share the remaining slots
+	static const uint8_t schedule[] = {
+		LINK_ID, GPS_ID, LINK_ID, ATTITUDE_ID, LINK_ID, BATTERY_ID, LINK_ID, ATTITUDE_ID,
+		LINK_ID, LINK_RX_ID, LINK_ID, ATTITUDE_ID, LINK_ID, LINK_TX_ID, LINK_ID, FLIGHT_MODE_ID,
+	};
+
+	size_t used = 0;
+	while (size - used >= MAX_FRAME_SIZE)
+		used += generate(schedule[counter % DIM(schedule)], buffer + used);
+
+	return used;
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "crossfire.h"
+
+// Produces valid telemetry frames with plausible, slowly changing values
+// encoded the same way a radio sends them
+class CrossfireFrameGenerator
+{
+public:
+	explicit CrossfireFrameGenerator(uint32_t seed = 1) : seed(seed ? seed : 1) {}
+
+	// Writes one frame of the given id, returns its size or 0 if the id is not supported
+	size_t generate(uint8_t id, uint8_t* frame);
+
+	// Writes frames in the order a typical ELRS link sends them, returns the total size
+	size_t generateMix(uint8_t* buffer, size_t size);
+
+private:
+	uint32_t seed;
+	uint32_t counter = 0;
+
+	int32_t latitude = 473977000;  // degree / 10^7
+	int32_t longitude = 85460000;
+	int32_t altitude = 1100;       // m + 1000
+	int32_t heading = 9000;        // degree / 100
+	int32_t capacity = 0;          // mAh
+	uint16_t channels[CROSSFIRE_CHANNEL_COUNT] = {
+		992, 992, 172, 992, 172, 172, 172, 172, 172, 172, 172, 172, 172, 172, 172, 172,
+	};
+
+	uint32_t random();
+	int32_t wander(int32_t value, int32_t step, int32_t min, int32_t max);
+};
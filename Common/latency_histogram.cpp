@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "latency_histogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+uint32_t LatencyHistogram::getPercentile(double percentile) const
+{
+	// The writer may count while we walk, the total read first stays consistent enough
+	uint32_t count = getCount();
+	if (count == 0)
+		return 0;
+
+	uint64_t rank = std::max<uint64_t>(1, (uint64_t)ceil(count * percentile / 100));
+	uint64_t seen = 0;
+	for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+	{
+		seen += counts[i].load(std::memory_order_relaxed);
+		if (seen >= rank)
+			return std::min(getValue(i), getMax());
+	}
+
+	return getMax();
+}
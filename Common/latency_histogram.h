@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#define HISTOGRAM_SUB_BITS    5  // 32 buckets per power of two, about 3% resolution
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_MAX_BITS    32 // Values up to 4.29 s in ns, larger ones are clamped
+#define HISTOGRAM_BUCKETS     ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+// Log-linear histogram in the style of HdrHistogram: exact below 32, then
+// 32 linear buckets for every power of two. Written by one thread, read by
+// any thread at any time without locks; a reader may see a value counted
+// a moment before the maximum is updated.
+class LatencyHistogram
+{
+public:
+	void record(uint64_t value)
+	{
+		if (value >= (1ull << HISTOGRAM_MAX_BITS))
+			value = (1ull << HISTOGRAM_MAX_BITS) - 1;
+
+		// Single writer, no read-modify-write needed
+		std::atomic<uint32_t>& count = counts[getIndex((uint32_t)value)];
+		count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		total.store(total.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		if (value > max.load(std::memory_order_relaxed))
+			max.store((uint32_t)value, std::memory_order_relaxed);
+	}
+
+	uint32_t getCount() const { return total.load(std::memory_order_relaxed); }
+	uint32_t getMax() const { return max.load(std::memory_order_relaxed); }
+
+	// Upper bound of the bucket holding the given percentile (0..100)
+	uint32_t getPercentile(double percentile) const;
+
+	static size_t getIndex(uint32_t value)
+	{
+		if (value < HISTOGRAM_SUB_BUCKETS)
+			return value;
+
+		unsigned shift = highestSetBit(value) - HISTOGRAM_SUB_BITS;
+		return (shift + 1) * HISTOGRAM_SUB_BUCKETS + (value >> shift) - HISTOGRAM_SUB_BUCKETS;
+	}
+
+	// Largest value counted in the bucket
+	static uint32_t getValue(size_t index)
+	{
+		if (index < HISTOGRAM_SUB_BUCKETS)
+			return (uint32_t)index;
+
+		unsigned shift = (unsigned)(index / HISTOGRAM_SUB_BUCKETS - 1);
+		return (uint32_t)((((uint64_t)(index % HISTOGRAM_SUB_BUCKETS) + HISTOGRAM_SUB_BUCKETS + 1) << shift) - 1);
+	}
+
+private:
+	std::atomic<uint32_t> counts[HISTOGRAM_BUCKETS] = {};
+	std::atomic<uint32_t> total{ 0 }; // 64 bit atomics are not lock-free everywhere
+	std::atomic<uint32_t> max{ 0 };
+
+	static unsigned highestSetBit(uint32_t value)
+	{
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanReverse(&index, value);
+		return index;
+#else
+		return 31 - __builtin_clz(value);
+#endif
+	}
+};
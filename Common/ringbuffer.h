@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Fixed size byte FIFO. Head and tail are free running counters,
+// N has to be a power of two so that they can be masked.
+template <size_t N>
+class RingBuffer
+{
+	static_assert(N != 0 && (N & (N - 1)) == 0, "RingBuffer size must be a power of two");
+
+public:
+	size_t size() const { return head - tail; }
+	size_t space() const { return N - size(); }
+	bool empty() const { return head == tail; }
+
+	uint8_t operator[](size_t offset) const { return data[(tail + offset) & (N - 1)]; }
+
+	// Largest contiguous free block, lets read() write straight into the buffer
+	uint8_t* writeBuffer(size_t& length)
+	{
+		size_t offset = head & (N - 1);
+		length = std::min(space(), N - offset);
+		return &data[offset];
+	}
+
+	void commit(size_t length) { head += length; }
+
+	size_t write(const uint8_t* src, size_t length)
+	{
+		length = std::min(length, space());
+		size_t offset = head & (N - 1);
+		size_t first = std::min(length, N - offset);
+		memcpy(&data[offset], src, first);
+		memcpy(&data[0], src + first, length - first);
+		head += length;
+		return length;
+	}
+
+	// Largest contiguous block of unread data
+	const uint8_t* readBuffer(size_t& length) const
+	{
+		size_t offset = tail & (N - 1);
+		length = std::min(size(), N - offset);
+		return &data[offset];
+	}
+
+	void copy(uint8_t* dst, size_t offset, size_t length) const
+	{
+		size_t start = (tail + offset) & (N - 1);
+		size_t first = std::min(length, N - start);
+		memcpy(dst, &data[start], first);
+		memcpy(dst + first, &data[0], length - first);
+	}
+
+	void consume(size_t length) { tail += length; }
+
+private:
+	uint8_t data[N];
+	size_t head = 0;
+	size_t tail = 0;
+};
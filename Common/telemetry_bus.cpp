@@ -0,0 +1,222 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "telemetry_bus.h"
+
+#include "telemetry_clock.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+size_t getTelemetryBusSize(uint32_t capacity)
+{
+	return offsetof(TelemetryBusLayout, entries) + capacity * sizeof(TelemetryBusEntry);
+}
+
+TelemetryBusWriter::TelemetryBusWriter(void* memory, uint32_t capacity, uint8_t source) :
+	bus((TelemetryBusLayout*)memory),
+	mask(capacity - 1),
+	source(source)
+{
+	// Zero filled memory is a valid initial state of every atomic
+	position = bus->header.writePosition.load(std::memory_order_relaxed);
+	bus->header.version = TELEMETRY_BUS_VERSION;
+	bus->header.capacity = capacity;
+
+	// Consumers check the magic last
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(bus->header.magic, TELEMETRY_BUS_MAGIC, sizeof(bus->header.magic));
+}
+
+void TelemetryBusWriter::beginCrossfireTelemetryFrame(uint8_t id)
+{
+	frameTimestamp = getTelemetryTime();
+	frameId = id;
+}
+
+void TelemetryBusWriter::processCrossfireTelemetryValue(uint8_t index, int32_t value)
+{
+	if (index >= UNKNOWN_INDEX)
+		return;
+
+	// Single writer, plain increments of the sequences are enough
+	TelemetryBusEntry& entry = bus->entries[position & mask];
+	entry.sequence.store(2 * position + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	entry.timestampLow.store((uint32_t)frameTimestamp, std::memory_order_relaxed);
+	entry.timestampHigh.store((uint32_t)(frameTimestamp >> 32), std::memory_order_relaxed);
+	entry.value.store(value, std::memory_order_relaxed);
+	entry.sensor.store(frameId | index << 8 | source << 16, std::memory_order_relaxed);
+	entry.sequence.store(2 * position + 2, std::memory_order_release);
+	++position;
+
+	TelemetryBusValue& latest = bus->latest[index];
+	uint32_t sequence = latest.sequence.load(std::memory_order_relaxed);
+	latest.sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	latest.value.store(value, std::memory_order_relaxed);
+	latest.timestampLow.store((uint32_t)frameTimestamp, std::memory_order_relaxed);
+	latest.timestampHigh.store((uint32_t)(frameTimestamp >> 32), std::memory_order_relaxed);
+	latest.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+void TelemetryBusWriter::processCrossfireTelemetryText(uint8_t index, const char* text, uint8_t length)
+{
+	uint32_t words[TELEMETRY_TEXT_SIZE / 4] = {};
+	length = std::min<uint8_t>(length, TELEMETRY_TEXT_SIZE);
+	memcpy(words, text, length);
+
+	TelemetryBusText& busText = bus->text;
+	uint32_t sequence = busText.sequence.load(std::memory_order_relaxed);
+	busText.sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	busText.length.store(length, std::memory_order_relaxed);
+	for (size_t i = 0; i < DIM(words); i++)
+		busText.words[i].store(words[i], std::memory_order_relaxed);
+	busText.sequence.store(sequence + 2, std::memory_order_release);
+
+	// The value of a text sensor is its length
+	processCrossfireTelemetryValue(index, length);
+}
+
+void TelemetryBusWriter::endCrossfireTelemetryFrame(uint8_t id)
+{
+	bus->header.writePosition.store(position, std::memory_order_release);
+	bus->header.frames.store(bus->header.frames.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+TelemetryBusReader::TelemetryBusReader(const void* memory, size_t size)
+{
+	const TelemetryBusLayout* layout = (const TelemetryBusLayout*)memory;
+	if (size < getTelemetryBusSize(0) || memcmp(layout->header.magic, TELEMETRY_BUS_MAGIC, sizeof(layout->header.magic)) != 0)
+		return;
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+	uint32_t capacity = layout->header.capacity;
+	if (layout->header.version != TELEMETRY_BUS_VERSION || capacity == 0 || (capacity & (capacity - 1)) != 0 ||
+		size < getTelemetryBusSize(capacity))
+		return;
+
+	bus = layout;
+	mask = capacity - 1;
+
+	// Only what is published from now on
+	cursor = bus->header.writePosition.load(std::memory_order_acquire);
+}
+
+size_t TelemetryBusReader::read(TelemetryBusSample* samples, size_t count)
+{
+	uint32_t end = bus->header.writePosition.load(std::memory_order_acquire);
+
+	// Lapped by the producer, skip to the oldest sample still in the ring
+	if (end - cursor > mask + 1)
+	{
+		lost += end - cursor - (mask + 1);
+		cursor = end - (mask + 1);
+	}
+
+	size_t copied = 0;
+	while (cursor != end && copied < count)
+	{
+		const TelemetryBusEntry& entry = bus->entries[cursor & mask];
+		uint32_t sequence = entry.sequence.load(std::memory_order_acquire);
+
+		TelemetryBusSample& sample = samples[copied];
+		sample.timestamp = (uint64_t)entry.timestampHigh.load(std::memory_order_relaxed) << 32 |
+			entry.timestampLow.load(std::memory_order_relaxed);
+		sample.value = entry.value.load(std::memory_order_relaxed);
+		uint32_t sensor = entry.sensor.load(std::memory_order_relaxed);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (sequence != 2 * cursor + 2 || entry.sequence.load(std::memory_order_relaxed) != sequence)
+		{
+			// Overwritten while we were behind, the rest of the ring is newer
+			++lost;
+			++cursor;
+			continue;
+		}
+
+		sample.frameId = (uint8_t)sensor;
+		sample.index = (uint8_t)(sensor >> 8);
+		sample.source = (uint8_t)(sensor >> 16);
+		++copied;
+		++cursor;
+	}
+
+	return copied;
+}
+
+bool TelemetryBusReader::readLatest(uint8_t index, TelemetrySample& sample) const
+{
+	if (index >= UNKNOWN_INDEX)
+		return false;
+
+	const TelemetryBusValue& latest = bus->latest[index];
+	uint32_t sequence;
+	for (;;)
+	{
+		sequence = latest.sequence.load(std::memory_order_acquire);
+		if (sequence & 1)
+		{
+			// The writer is in the middle of an update, it takes nanoseconds
+			std::this_thread::yield();
+			continue;
+		}
+
+		sample.value = latest.value.load(std::memory_order_relaxed);
+		sample.timestamp = (uint64_t)latest.timestampHigh.load(std::memory_order_relaxed) << 32 |
+			latest.timestampLow.load(std::memory_order_relaxed);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (latest.sequence.load(std::memory_order_relaxed) == sequence)
+			break;
+	}
+
+	sample.sequence = sequence / 2;
+	return sequence != 0;
+}
+
+bool TelemetryBusReader::readText(char* text, size_t size) const
+{
+	if (size == 0)
+		return false;
+
+	uint32_t words[TELEMETRY_TEXT_SIZE / 4];
+	uint32_t length;
+	uint32_t sequence;
+	for (;;)
+	{
+		sequence = bus->text.sequence.load(std::memory_order_acquire);
+		if (sequence & 1)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		length = bus->text.length.load(std::memory_order_relaxed);
+		for (size_t i = 0; i < DIM(words); i++)
+			words[i] = bus->text.words[i].load(std::memory_order_relaxed);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (bus->text.sequence.load(std::memory_order_relaxed) == sequence)
+			break;
+	}
+
+	length = std::min<uint32_t>(length, (uint32_t)size - 1);
+	memcpy(text, words, length);
+	text[length] = '\0';
+	return sequence != 0;
+}
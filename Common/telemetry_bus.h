@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "crossfire.h"
+#include "telemetry_snapshot.h"
+
+#define TELEMETRY_BUS_MAGIC    "CRSFBUS"
+#define TELEMETRY_BUS_VERSION  1
+#define TELEMETRY_BUS_CAPACITY 65536 // Samples kept in the ring, a power of two
+
+// Memory shared by the producer and the consumer processes. Everything
+// is a 32 bit atomic: positions wrap around, a reader only compares them
+// with each other, and the layout is the same for 32 and 64 bit processes.
+struct TelemetryBusHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t capacity;
+	std::atomic<uint32_t> writePosition; // Samples written so far
+	std::atomic<uint32_t> frames;
+	uint32_t reserved[10];
+};
+
+// Latest value of a sensor, seqlock per sensor
+struct TelemetryBusValue
+{
+	std::atomic<uint32_t> sequence; // Odd while the value is written
+	std::atomic<int32_t> value;
+	std::atomic<uint32_t> timestampLow;
+	std::atomic<uint32_t> timestampHigh;
+};
+
+struct TelemetryBusText
+{
+	std::atomic<uint32_t> sequence;
+	std::atomic<uint32_t> length;
+	std::atomic<uint32_t> words[TELEMETRY_TEXT_SIZE / 4];
+};
+
+// One slot of the ring. sequence is 2 * position + 1 while the slot is
+// written and 2 * position + 2 when it holds the sample of that position.
+struct TelemetryBusEntry
+{
+	std::atomic<uint32_t> sequence;
+	std::atomic<uint32_t> timestampLow;
+	std::atomic<uint32_t> timestampHigh;
+	std::atomic<int32_t> value;
+	std::atomic<uint32_t> sensor; // frame id | index << 8 | source << 16
+};
+
+struct TelemetryBusLayout
+{
+	TelemetryBusHeader header;
+	TelemetryBusValue latest[UNKNOWN_INDEX];
+	TelemetryBusText text;
+	TelemetryBusEntry entries[1]; // capacity entries
+};
+
+struct TelemetryBusSample
+{
+	uint64_t timestamp; // us, steady clock of the producer
+	int32_t value;
+	uint8_t frameId;
+	uint8_t index;
+	uint8_t source;
+};
+
+// Bytes of shared memory needed for the given number of ring entries
+size_t getTelemetryBusSize(uint32_t capacity);
+
+// Publishes decoded telemetry. The producer never waits for consumers:
+// old samples are overwritten and readers which fall behind notice it.
+// Samples of a frame become visible together at the end of the frame.
+class TelemetryBusWriter : public CrossfireTelemetryHandler
+{
+public:
+	// memory has to be zero filled and getTelemetryBusSize(capacity) long
+	TelemetryBusWriter(void* memory, uint32_t capacity, uint8_t source);
+
+	void beginCrossfireTelemetryFrame(uint8_t id) override;
+	void processCrossfireTelemetryValue(uint8_t index, int32_t value) override;
+	void processCrossfireTelemetryText(uint8_t index, const char* text, uint8_t length) override;
+	void endCrossfireTelemetryFrame(uint8_t id) override;
+
+private:
+	TelemetryBusLayout* bus;
+	uint32_t mask;
+	uint8_t source;
+	uint32_t position;
+	uint64_t frameTimestamp = 0;
+	uint8_t frameId = 0;
+};
+
+// Consumer side. Every reader has its own cursor in its own memory,
+// so readers do not write to the shared memory at all.
+class TelemetryBusReader
+{
+public:
+	TelemetryBusReader(const void* memory, size_t size);
+
+	bool isValid() const { return bus != nullptr; }
+
+	// Copies up to count samples published since the last call, oldest
+	// first. Samples overwritten before they were read are counted as lost.
+	size_t read(TelemetryBusSample* samples, size_t count);
+	uint64_t getLost() const { return lost; }
+
+	// Frames published so far, wraps around
+	uint32_t getFrames() const { return bus->header.frames.load(std::memory_order_relaxed); }
+
+	bool readLatest(uint8_t index, TelemetrySample& sample) const;
+	bool readText(char* text, size_t size) const;
+
+private:
+	const TelemetryBusLayout* bus = nullptr;
+	uint32_t mask = 0;
+	uint32_t cursor = 0;
+	uint64_t lost = 0;
+};
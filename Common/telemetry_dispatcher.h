@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include "crossfire.h"
+
+#define MAX_TELEMETRY_HANDLERS 8
+
+// Forwards decoded telemetry to several handlers in the order they were added
+class TelemetryDispatcher : public CrossfireTelemetryHandler
+{
+public:
+	bool add(CrossfireTelemetryHandler& handler)
+	{
+		if (count == MAX_TELEMETRY_HANDLERS)
+			return false;
+
+		handlers[count++] = &handler;
+		return true;
+	}
+
+	// Puts another handler in the place of one added before, e.g. a filter in front of it
+	bool replace(CrossfireTelemetryHandler& handler, CrossfireTelemetryHandler& replacement)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			if (handlers[i] == &handler)
+			{
+				handlers[i] = &replacement;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void processCrossfireFrame(const CrossfireFrameView& frame) override
+	{
+		for (size_t i = 0; i < count; i++)
+			handlers[i]->processCrossfireFrame(frame);
+	}
+
+	void beginCrossfireTelemetryFrame(uint8_t id) override
+	{
+		for (size_t i = 0; i < count; i++)
+			handlers[i]->beginCrossfireTelemetryFrame(id);
+	}
+
+	void processCrossfireTelemetryValue(uint8_t index, int32_t value) override
+	{
+		for (size_t i = 0; i < count; i++)
+			handlers[i]->processCrossfireTelemetryValue(index, value);
+	}
+
+	void processCrossfireTelemetryText(uint8_t index, const char* text, uint8_t length) override
+	{
+		for (size_t i = 0; i < count; i++)
+			handlers[i]->processCrossfireTelemetryText(index, text, length);
+	}
+
+	void endCrossfireTelemetryFrame(uint8_t id) override
+	{
+		for (size_t i = 0; i < count; i++)
+			handlers[i]->endCrossfireTelemetryFrame(id);
+	}
+
+private:
+	CrossfireTelemetryHandler* handlers[MAX_TELEMETRY_HANDLERS];
+	size_t count = 0;
+};
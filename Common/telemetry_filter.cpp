@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "telemetry_filter.h"
+#include "telemetry_clock.h"
+#include "telemetry_units.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+TelemetryFilter::TelemetryFilter(CrossfireTelemetryHandler& output) :
+	output(output)
+{
+}
+
+void TelemetryFilter::setDeadband(uint8_t index, int32_t deadband)
+{
+	sensors[index].deadband = deadband;
+}
+
+void TelemetryFilter::setDeadbandAll(int32_t deadband)
+{
+	for (Sensor& sensor : sensors)
+		sensor.deadband = deadband;
+}
+
+void TelemetryFilter::beginCrossfireTelemetryFrame(uint8_t id)
+{
+	// Passed on with the first value which gets through
+	frameTime = getTelemetryTime();
+	frameId = id;
+	frameBegun = false;
+}
+
+void TelemetryFilter::beginOutput()
+{
+	if (!frameBegun)
+	{
+		output.beginCrossfireTelemetryFrame(frameId);
+		frameBegun = true;
+	}
+}
+
+bool TelemetryFilter::pass(Sensor& sensor, bool changed)
+{
+	++valuesIn;
+	if (sensor.deadband != FILTER_PASS_ALL && sensor.timestamp && !changed &&
+		(!keepalive || frameTime - sensor.timestamp < keepalive))
+		return false;
+
+	sensor.timestamp = frameTime;
+	++valuesOut;
+	beginOutput();
+	return true;
+}
+
+void TelemetryFilter::processCrossfireTelemetryValue(uint8_t index, int32_t value)
+{
+	Sensor& sensor = sensors[index];
+	int64_t change = (int64_t)value - sensor.value;
+	if (pass(sensor, change > sensor.deadband || -change > sensor.deadband))
+	{
+		sensor.value = value;
+		output.processCrossfireTelemetryValue(index, value);
+	}
+}
+
+void TelemetryFilter::processCrossfireTelemetryText(uint8_t index, const char* text, uint8_t length)
+{
+	// The only text sensor is the flight mode
+	Sensor& sensor = sensors[index];
+	if (length > sizeof(this->text))
+		length = sizeof(this->text);
+	bool changed = length != textLength || memcmp(text, this->text, length) != 0;
+	if (pass(sensor, changed))
+	{
+		memcpy(this->text, text, length);
+		textLength = length;
+		output.processCrossfireTelemetryText(index, text, length);
+	}
+}
+
+void TelemetryFilter::endCrossfireTelemetryFrame(uint8_t id)
+{
+	if (frameBegun)
+		output.endCrossfireTelemetryFrame(id);
+}
+
+bool parseTelemetryDeadbands(const char* text, TelemetryFilter& filter)
+{
+	while (*text)
+	{
+		const char* equals = strchr(text, '=');
+		if (!equals)
+			return false;
+
+		size_t nameLength = equals - text;
+		char* end;
+		double deadband = strtod(equals + 1, &end);
+		if (end == equals + 1 || (*end && *end != ','))
+			return false;
+
+		bool found = false;
+		for (size_t index = 0; index < crossfireRegistry.getSensorCount(); index++)
+		{
+			const char* name = getCrossfireSensor((uint8_t)index).name;
+			if (strlen(name) != nameLength || strncmp(name, text, nameLength) != 0)
+				continue;
+
+			filter.setDeadband((uint8_t)index, (int32_t)std::lround(deadband * std::pow(10.0, getCrossfireSensorDecimals((uint8_t)index))));
+			found = true;
+		}
+		if (!found)
+			return false;
+
+		text = *end ? end + 1 : end;
+	}
+	return true;
+}
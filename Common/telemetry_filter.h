@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "crossfire.h"
+#include "crossfire_registry.h"
+#include "telemetry_snapshot.h"
+
+#define FILTER_PASS_ALL -1 // Deadband of sensors which are not filtered
+
+// Passes on only values which changed by more than the deadband of their
+// sensor since the last value passed on, and texts which changed. Frames
+// without any value left are dropped entirely. A sensor which stays the
+// same is still passed on every keepalive us, if set, so consumers can tell
+// a steady value from a lost link. Sits in front of one consumer, e.g. a
+// sink, the other handlers of a source still see every value.
+class TelemetryFilter : public CrossfireTelemetryHandler
+{
+public:
+	explicit TelemetryFilter(CrossfireTelemetryHandler& output);
+
+	// Deadband in raw units of the sensor, 0 passes every change
+	void setDeadband(uint8_t index, int32_t deadband);
+	void setDeadbandAll(int32_t deadband);
+	void setKeepalive(uint32_t keepalive) { this->keepalive = keepalive; }
+
+	uint64_t getValuesIn() const { return valuesIn; }
+	uint64_t getValuesOut() const { return valuesOut; }
+
+	void processCrossfireFrame(const CrossfireFrameView& frame) override { output.processCrossfireFrame(frame); }
+	void beginCrossfireTelemetryFrame(uint8_t id) override;
+	void processCrossfireTelemetryValue(uint8_t index, int32_t value) override;
+	void processCrossfireTelemetryText(uint8_t index, const char* text, uint8_t length) override;
+	void endCrossfireTelemetryFrame(uint8_t id) override;
+
+private:
+	struct Sensor
+	{
+		int32_t deadband = FILTER_PASS_ALL;
+		int32_t value = 0;
+		uint64_t timestamp = 0; // us when the value was passed on, 0 never
+	};
+
+	CrossfireTelemetryHandler& output;
+	Sensor sensors[CROSSFIRE_SENSOR_SLOTS];
+	char text[TELEMETRY_TEXT_SIZE];
+	uint8_t textLength = 0;
+	uint32_t keepalive = 0; // us, 0 passes unchanged values never
+	uint64_t frameTime = 0;
+	uint8_t frameId = 0;
+	bool frameBegun = false;
+	uint64_t valuesIn = 0;
+	uint64_t valuesOut = 0;
+
+	bool pass(Sensor& sensor, bool changed);
+	void beginOutput();
+};
+
+// Parses NAME=VALUE[,NAME=VALUE...] with values in the units of the sensor
+// definition, e.g. RxBt=0.2,Sats=1, and sets the deadbands of all sensors
+// of that name. Returns false at the first unknown name.
+bool parseTelemetryDeadbands(const char* text, TelemetryFilter& filter);
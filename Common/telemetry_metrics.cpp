@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "telemetry_metrics.h"
+
+#include "crossfire_stream.h"
+
+static const uint8_t frameTypeIds[METRICS_FRAME_TYPES - 1] = {
+	LINK_ID, LINK_RX_ID, LINK_TX_ID, BATTERY_ID, GPS_ID, ATTITUDE_ID, FLIGHT_MODE_ID, CF_VARIO_ID, BARO_ALT_ID, CHANNELS_ID,
+};
+
+static const char* const stageNames[STAGE_COUNT] = { "assembled", "crc", "decoded", "delivered" };
+
+size_t TelemetryMetrics::getFrameType(uint8_t id)
+{
+	for (size_t i = 0; i < DIM(frameTypeIds); i++)
+	{
+		if (frameTypeIds[i] == id)
+			return i;
+	}
+	return METRICS_FRAME_TYPES - 1;
+}
+
+void TelemetryMetrics::recordFrame(uint8_t id, uint64_t readTime, const uint64_t* stageTimes, int stageCount)
+{
+	LatencyHistogram* frameHistograms = histograms[getFrameType(id)];
+	for (int stage = 0; stage < stageCount; stage++)
+		frameHistograms[stage].record(stageTimes[stage] - readTime);
+}
+
+void TelemetryMetrics::publish(const CrossfireStreamStats& stats)
+{
+	bytesLow.store((uint32_t)stats.bytes, std::memory_order_relaxed);
+	bytesHigh.store((uint32_t)(stats.bytes >> 32), std::memory_order_relaxed);
+	frames.store(stats.frames, std::memory_order_relaxed);
+	crcErrors.store(stats.crcErrors, std::memory_order_relaxed);
+	resyncs.store(stats.resyncs, std::memory_order_relaxed);
+	unknownIds.store(stats.unknownIds, std::memory_order_relaxed);
+}
+
+void TelemetryMetrics::getCounters(TelemetryCounters& counters) const
+{
+	counters.bytes = (uint64_t)bytesHigh.load(std::memory_order_relaxed) << 32 | bytesLow.load(std::memory_order_relaxed);
+	counters.wakeups = wakeups.load(std::memory_order_relaxed);
+	counters.frames = frames.load(std::memory_order_relaxed);
+	counters.crcErrors = crcErrors.load(std::memory_order_relaxed);
+	counters.resyncs = resyncs.load(std::memory_order_relaxed);
+	counters.unknownIds = unknownIds.load(std::memory_order_relaxed);
+}
+
+void TelemetryMetrics::print(FILE* file, const char* name) const
+{
+	TelemetryCounters counters;
+	getCounters(counters);
+
+	fprintf(file, "%s: bytes %llu, frames %u, CRC errors %u, resyncs %u, unknown ids %u\n", name,
+		(unsigned long long)counters.bytes, counters.frames, counters.crcErrors, counters.resyncs, counters.unknownIds);
+	if (counters.wakeups)
+		fprintf(file, "  wakeups %u, %.1f bytes per wakeup\n", counters.wakeups, (double)counters.bytes / counters.wakeups);
+	fprintf(file, "  %-15s %-10s %10s %9s %9s %9s %9s %9s us\n", "frame", "stage", "count", "p50", "p90", "p99", "p99.9", "max");
+
+	for (size_t type = 0; type < METRICS_FRAME_TYPES; type++)
+	{
+		const char* frameName = type < DIM(frameTypeIds) ? getCrossfireFrameName(frameTypeIds[type]) : "OTHER";
+		for (int stage = 0; stage < STAGE_COUNT; stage++)
+		{
+			const LatencyHistogram& histogram = histograms[type][stage];
+			if (histogram.getCount() == 0)
+				continue;
+
+			fprintf(file, "  %-15s %-10s %10u %9.2f %9.2f %9.2f %9.2f %9.2f\n", frameName, stageNames[stage], histogram.getCount(),
+				histogram.getPercentile(50) / 1e3, histogram.getPercentile(90) / 1e3, histogram.getPercentile(99) / 1e3,
+				histogram.getPercentile(99.9) / 1e3, histogram.getMax() / 1e3);
+		}
+	}
+}
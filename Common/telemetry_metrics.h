@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+
+#include "latency_histogram.h"
+
+struct CrossfireStreamStats;
+
+// Points of the decode path, each measured from the completion of the read
+// which delivered the last byte of the frame
+enum TelemetryStage
+{
+	STAGE_ASSEMBLED,   // Frame complete and copied out of the stream buffer
+	STAGE_CRC_CHECKED, // Checksum verified
+	STAGE_DECODED,     // First value handed to the consumer
+	STAGE_DELIVERED,   // Consumer returned from the end of the frame
+	STAGE_COUNT
+};
+
+#define METRICS_FRAME_TYPES 11 // Telemetry frames the decoder knows and one for all others
+
+struct TelemetryCounters
+{
+	uint64_t bytes;
+	uint32_t wakeups;
+	uint32_t frames;
+	uint32_t crcErrors;
+	uint32_t resyncs;
+	uint32_t unknownIds;
+};
+
+// Per stream counters and per frame type, per stage latency histograms.
+// Written by the thread which processes the stream, read by any thread.
+class TelemetryMetrics
+{
+public:
+	// Times in ns, frames which were not decoded only reach the first stages
+	void recordFrame(uint8_t id, uint64_t readTime, const uint64_t* stageTimes, int stageCount);
+	void publish(const CrossfireStreamStats& stats);
+
+	// The reading thread woke up for the stream, single writer
+	void countWakeup() { wakeups.store(wakeups.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); }
+
+	void getCounters(TelemetryCounters& counters) const;
+	const LatencyHistogram& getHistogram(uint8_t id, TelemetryStage stage) const { return histograms[getFrameType(id)][stage]; }
+
+	// Counters and percentiles of every frame type seen, in us
+	void print(FILE* file, const char* name) const;
+
+private:
+	LatencyHistogram histograms[METRICS_FRAME_TYPES][STAGE_COUNT];
+
+	// Halves, 64 bit atomics are not lock-free on every target
+	std::atomic<uint32_t> bytesLow{ 0 };
+	std::atomic<uint32_t> bytesHigh{ 0 };
+	std::atomic<uint32_t> wakeups{ 0 };
+	std::atomic<uint32_t> frames{ 0 };
+	std::atomic<uint32_t> crcErrors{ 0 };
+	std::atomic<uint32_t> resyncs{ 0 };
+	std::atomic<uint32_t> unknownIds{ 0 };
+
+	static size_t getFrameType(uint8_t id);
+};
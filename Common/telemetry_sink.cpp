@@ -0,0 +1,327 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "telemetry_sink.h"
+#include "telemetry_clock.h"
+
+#include <cstring>
+
+TelemetrySink::TelemetrySink(FILE* file, uint32_t flushInterval) :
+	file(file),
+	flushInterval((uint64_t)flushInterval * 1000)
+{
+	lastFlush = getTelemetryTime();
+}
+
+TelemetrySink::~TelemetrySink()
+{
+	flush();
+}
+
+void TelemetrySink::flush()
+{
+	if (used)
+	{
+		fwrite(buffer, 1, used, file);
+		used = 0;
+	}
+
+	fflush(file);
+	lastFlush = getTelemetryTime();
+}
+
+void TelemetrySink::setSource(const char* name, uint8_t number)
+{
+	sourceName = name;
+	sourceNumber = number;
+}
+
+void TelemetrySink::append(const void* data, size_t length)
+{
+	if (used + length > sizeof(buffer))
+	{
+		fwrite(buffer, 1, used, file);
+		used = 0;
+	}
+
+	memcpy(&buffer[used], data, length);
+	used += length;
+}
+
+void TelemetrySink::append(const char* text)
+{
+	append(text, strlen(text));
+}
+
+void TelemetrySink::append(char c)
+{
+	if (used == sizeof(buffer))
+	{
+		fwrite(buffer, 1, used, file);
+		used = 0;
+	}
+
+	buffer[used++] = c;
+}
+
+void TelemetrySink::appendInt(int64_t value)
+{
+	char digits[20];
+	size_t count = 0;
+	uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+
+	do {
+		digits[count++] = (char)('0' + magnitude % 10);
+		magnitude /= 10;
+	} while (magnitude);
+
+	if (value < 0)
+		append('-');
+
+	while (count)
+		append(digits[--count]);
+}
+
+void TelemetrySink::appendFixed(int64_t value, uint8_t decimals)
+{
+	if (!decimals)
+	{
+		appendInt(value);
+		return;
+	}
+
+	int64_t divider = 1;
+	for (uint8_t i = 0; i < decimals; i++)
+		divider *= 10;
+
+	uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+	if (value < 0)
+		append('-');
+	appendInt(magnitude / divider);
+	append('.');
+
+	// Leading zeros of the fraction
+	uint64_t fraction = magnitude % divider;
+	for (int64_t digit = divider / 10; digit > 1 && fraction < (uint64_t)digit; digit /= 10)
+		append('0');
+	appendInt(fraction);
+}
+
+void TelemetrySink::appendValue(uint8_t index, int32_t value)
+{
+	if (!units)
+	{
+		appendInt(value);
+		return;
+	}
+
+	appendFixed(units->convert(index, value), units->getScale(index).decimals);
+}
+
+void TelemetrySink::beginCrossfireTelemetryFrame(uint8_t id)
+{
+	frameTime = nextTime ? nextTime : getTelemetryTime();
+	frameId = id;
+}
+
+void TelemetrySink::endCrossfireTelemetryFrame(uint8_t id)
+{
+	// Flushing follows the clock, also when frames carry recorded times
+	uint64_t now = nextTime ? getTelemetryTime() : frameTime;
+	if (now - lastFlush >= flushInterval)
+	{
+		flush();
+	}
+	else if (used > sizeof(buffer) - SINK_FRAME_MAX)
+	{
+		// Write before the next frame could be split
+		fwrite(buffer, 1, used, file);
+		used = 0;
+	}
+}
+
+void TextTelemetrySink::beginCrossfireTelemetryFrame(uint8_t id)
+{
+	TelemetrySink::beginCrossfireTelemetryFrame(id);
+	if (sourceName)
+	{
+		append(sourceName);
+		append(": ");
+	}
+	append(getCrossfireFrameName(id));
+	append('\n');
+}
+
+void TextTelemetrySink::processCrossfireTelemetryValue(uint8_t index, int32_t value)
+{
+	append('\t');
+	append(getCrossfireSensor(index).name);
+	append(' ');
+	appendValue(index, value);
+	if (units && *getTelemetryUnitName(units->getScale(index).unit))
+	{
+		append(' ');
+		append(getTelemetryUnitName(units->getScale(index).unit));
+	}
+	append('\n');
+}
+
+void TextTelemetrySink::processCrossfireTelemetryText(uint8_t index, const char* text, uint8_t length)
+{
+	append('\t');
+	append(text, length);
+	append('\n');
+}
+
+void JsonTelemetrySink::beginCrossfireTelemetryFrame(uint8_t id)
+{
+	TelemetrySink::beginCrossfireTelemetryFrame(id);
+	append('{');
+	if (sourceName)
+	{
+		append("\"source\":\"");
+		append(sourceName);
+		append("\",");
+	}
+	append("\"time\":");
+	appendInt(frameTime);
+	append(",\"frame\":\"");
+	append(getCrossfireFrameName(id));
+	append("\",\"sensors\":[");
+	first = true;
+}
+
+void JsonTelemetrySink::appendSensor(uint8_t index)
+{
+	if (!first)
+		append(',');
+	first = false;
+
+	append("{\"index\":");
+	appendInt(index);
+	append(",\"name\":\"");
+	append(getCrossfireSensor(index).name);
+	append("\",\"value\":");
+}
+
+void JsonTelemetrySink::processCrossfireTelemetryValue(uint8_t index, int32_t value)
+{
+	appendSensor(index);
+	appendValue(index, value);
+	append('}');
+}
+
+void JsonTelemetrySink::processCrossfireTelemetryText(uint8_t index, const char* text, uint8_t length)
+{
+	static const char hex[] = "0123456789abcdef";
+
+	appendSensor(index);
+	append('"');
+	for (uint8_t i = 0; i < length; i++)
+	{
+		uint8_t c = (uint8_t)text[i];
+		if (c == '"' || c == '\\')
+		{
+			append('\\');
+			append((char)c);
+		}
+		else if (c < 0x20 || c >= 0x7f)
+		{
+			append("\\u00");
+			append(hex[c >> 4]);
+			append(hex[c & 0xf]);
+		}
+		else
+			append((char)c);
+	}
+	append("\"}");
+}
+
+void JsonTelemetrySink::endCrossfireTelemetryFrame(uint8_t id)
+{
+	append("]}\n");
+	TelemetrySink::endCrossfireTelemetryFrame(id);
+}
+
+void CsvTelemetrySink::beginCrossfireTelemetryFrame(uint8_t id)
+{
+	TelemetrySink::beginCrossfireTelemetryFrame(id);
+	// Sinks sharing a file write one header
+	if (header && sourceNumber == 0)
+		append(sourceName ? "source,time,frame,index,name,value\n" : "time,frame,index,name,value\n");
+	header = false;
+}
+
+void CsvTelemetrySink::appendPrefix(uint8_t index)
+{
+	if (sourceName)
+	{
+		append(sourceName);
+		append(',');
+	}
+	appendInt(frameTime);
+	append(',');
+	append(getCrossfireFrameName(frameId));
+	append(',');
+	appendInt(index);
+	append(',');
+	append(getCrossfireSensor(index).name);
+	append(',');
+}
+
+void CsvTelemetrySink::processCrossfireTelemetryValue(uint8_t index, int32_t value)
+{
+	appendPrefix(index);
+	appendValue(index, value);
+	append('\n');
+}
+
+void CsvTelemetrySink::processCrossfireTelemetryText(uint8_t index, const char* text, uint8_t length)
+{
+	appendPrefix(index);
+	append('"');
+	for (uint8_t i = 0; i < length; i++)
+	{
+		if (text[i] == '"')
+			append('"'); // Quotes are doubled inside a quoted field
+		append(text[i]);
+	}
+	append("\"\n");
+}
+
+void BinaryTelemetrySink::appendRecord(uint8_t index, int32_t value, uint8_t textLength)
+{
+	uint8_t record[BINARY_RECORD_SIZE];
+	for (int i = 0; i < 8; i++)
+		record[i] = (uint8_t)(frameTime >> (8 * i));
+	record[8] = frameId;
+	record[9] = index;
+	record[10] = textLength;
+	record[11] = sourceNumber;
+	for (int i = 0; i < 4; i++)
+		record[12 + i] = (uint8_t)((uint32_t)value >> (8 * i));
+	append(record, sizeof(record));
+}
+
+void BinaryTelemetrySink::processCrossfireTelemetryValue(uint8_t index, int32_t value)
+{
+	appendRecord(index, units ? units->convert(index, value) : value, 0);
+}
+
+void BinaryTelemetrySink::processCrossfireTelemetryText(uint8_t index, const char* text, uint8_t length)
+{
+	appendRecord(index, length, length);
+	append(text, length);
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <cstdio>
+
+#include "crossfire.h"
+#include "telemetry_units.h"
+
+#define SINK_BUFFER_SIZE   65536
+#define SINK_FRAME_MAX     4096  // Room kept for one frame, output is written in whole frames
+
+// Formats telemetry into a large buffer which is written out when it is
+// full or when flushInterval has passed since the last write, so the cost
+// depends on the number of bytes and not on the number of values.
+// flushInterval 0 writes after every frame. Output is written in whole
+// frames, so several sinks can share one file.
+class TelemetrySink : public CrossfireTelemetryHandler
+{
+public:
+	TelemetrySink(FILE* file, uint32_t flushInterval);
+	~TelemetrySink() override;
+
+	void flush();
+
+	// Tags the output when telemetry of several radios goes to one file
+	void setSource(const char* name, uint8_t number);
+
+	// Values in calibrated units instead of raw sensor units, units has to
+	// outlive the sink
+	void setUnits(const TelemetryUnits* units) { this->units = units; }
+
+	// Time of the bytes handed to the stream next, us since epoch, e.g. the
+	// time of a capture record. Frames get the telemetry clock without it.
+	void setTime(uint64_t time) { nextTime = time; }
+
+	// Output follows the output of another sink, e.g. of the part of a
+	// capture before it which was decoded on another core
+	virtual void continueOutput() {}
+
+	void beginCrossfireTelemetryFrame(uint8_t id) override;
+	void endCrossfireTelemetryFrame(uint8_t id) override;
+
+protected:
+	uint64_t frameTime = 0; // us
+	uint64_t nextTime = 0;  // us, 0 stamps frames with the telemetry clock
+	uint8_t frameId = 0;
+	const char* sourceName = nullptr;
+	uint8_t sourceNumber = 0;
+	const TelemetryUnits* units = nullptr;
+
+	void append(const void* data, size_t length);
+	void append(const char* text);
+	void append(char c);
+	void appendInt(int64_t value);
+	void appendFixed(int64_t value, uint8_t decimals);
+
+	// Raw or, with units set, calibrated value with its decimals
+	void appendValue(uint8_t index, int32_t value);
+
+private:
+	FILE* file;
+	uint64_t flushInterval; // us
+	uint64_t lastFlush = 0;
+	size_t used = 0;
+	char buffer[SINK_BUFFER_SIZE];
+};
+
+// Same layout as the original console output
+class TextTelemetrySink : public TelemetrySink
+{
+public:
+	using TelemetrySink::TelemetrySink;
+
+	void beginCrossfireTelemetryFrame(uint8_t id) override;
+	void processCrossfireTelemetryValue(uint8_t index, int32_t value) override;
+	void processCrossfireTelemetryText(uint8_t index, const char* text, uint8_t length) override;
+};
+
+// One JSON object per frame and line
+class JsonTelemetrySink : public TelemetrySink
+{
+public:
+	using TelemetrySink::TelemetrySink;
+
+	void beginCrossfireTelemetryFrame(uint8_t id) override;
+	void processCrossfireTelemetryValue(uint8_t index, int32_t value) override;
+	void processCrossfireTelemetryText(uint8_t index, const char* text, uint8_t length) override;
+	void endCrossfireTelemetryFrame(uint8_t id) override;
+
+private:
+	bool first = true;
+
+	void appendSensor(uint8_t index);
+};
+
+// One row per value: time,frame,index,name,value
+// or source,time,frame,index,name,value with a source set
+class CsvTelemetrySink : public TelemetrySink
+{
+public:
+	using TelemetrySink::TelemetrySink;
+
+	void beginCrossfireTelemetryFrame(uint8_t id) override;
+	void processCrossfireTelemetryValue(uint8_t index, int32_t value) override;
+	void processCrossfireTelemetryText(uint8_t index, const char* text, uint8_t length) override;
+	void continueOutput() override { header = false; }
+
+private:
+	bool header = true;
+
+	void appendPrefix(uint8_t index);
+};
+
+// Fixed size little endian records, one per value:
+//   uint64 time (us), uint8 frame id, uint8 sensor index, uint8 text length,
+//   uint8 source number, int32 value
+// With units set, value is calibrated, with the decimals of TelemetryUnits.
+// Text values follow their record, value holds the text length as well.
+#define BINARY_RECORD_SIZE 16
+
+class BinaryTelemetrySink : public TelemetrySink
+{
+public:
+	using TelemetrySink::TelemetrySink;
+
+	void processCrossfireTelemetryValue(uint8_t index, int32_t value) override;
+	void processCrossfireTelemetryText(uint8_t index, const char* text, uint8_t length) override;
+
+private:
+	void appendRecord(uint8_t index, int32_t value, uint8_t textLength);
+};
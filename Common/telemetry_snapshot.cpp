@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "telemetry_snapshot.h"
+
+#include "telemetry_clock.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+// Frame id which carries each sensor, taken from the frame layouts. The
+// seqlock of that frame guards the sensor. It is not always the id of the
+// sensor definition: LINK_RX_ID carries the TX power and LINK_TX_ID the RX power.
+struct SensorFrames
+{
+	uint8_t ids[UNKNOWN_INDEX];
+};
+
+template <uint8_t id>
+constexpr void addSensorFrames(SensorFrames& frames)
+{
+	for (const CrossfireField& field : CrossfireFrameLayout<id>::fields)
+		frames.ids[field.index] = id;
+}
+
+constexpr SensorFrames makeSensorFrames()
+{
+	SensorFrames frames = {};
+	addSensorFrames<LINK_ID>(frames);
+	addSensorFrames<GPS_ID>(frames);
+	addSensorFrames<LINK_RX_ID>(frames);
+	addSensorFrames<LINK_TX_ID>(frames);
+	addSensorFrames<BATTERY_ID>(frames);
+	addSensorFrames<ATTITUDE_ID>(frames);
+	addSensorFrames<CF_VARIO_ID>(frames);
+	addSensorFrames<BARO_ALT_ID>(frames);
+	for (int i = CHANNEL_FIRST_INDEX; i <= CHANNEL_LAST_INDEX; i++)
+		frames.ids[i] = CHANNELS_ID;
+	frames.ids[FLIGHT_MODE_INDEX] = FLIGHT_MODE_ID;
+	return frames;
+}
+
+constexpr bool isEverySensorCarried(const SensorFrames& frames)
+{
+	for (uint8_t id : frames.ids)
+	{
+		if (id == 0)
+			return false;
+	}
+	return true;
+}
+
+static constexpr SensorFrames sensorFrames = makeSensorFrames();
+static_assert(isEverySensorCarried(sensorFrames), "A sensor is not written by any frame");
+
+uint32_t TelemetrySnapshot::beginRead(uint8_t id) const
+{
+	for (;;)
+	{
+		uint32_t sequence = frameSequence[id].load(std::memory_order_acquire);
+		if (!(sequence & 1))
+			return sequence;
+
+		// The writer is in the middle of a frame, it takes nanoseconds
+		std::this_thread::yield();
+	}
+}
+
+bool TelemetrySnapshot::endRead(uint8_t id, uint32_t sequence) const
+{
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return frameSequence[id].load(std::memory_order_relaxed) == sequence;
+}
+
+void TelemetrySnapshot::readSensor(uint8_t index, TelemetrySample& sample) const
+{
+	const Sensor& sensor = sensors[index];
+	sample.value = sensor.value.load(std::memory_order_relaxed);
+	sample.timestamp = (uint64_t)sensor.timestampHigh.load(std::memory_order_relaxed) << 32 |
+		sensor.timestampLow.load(std::memory_order_relaxed);
+	sample.sequence = sensor.sequence.load(std::memory_order_relaxed);
+}
+
+bool TelemetrySnapshot::read(uint8_t index, TelemetrySample& sample) const
+{
+	return read(&index, &sample, 1);
+}
+
+bool TelemetrySnapshot::read(const uint8_t* indexes, TelemetrySample* samples, size_t count) const
+{
+	if (count == 0)
+		return true;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (indexes[i] >= UNKNOWN_INDEX)
+			return false;
+	}
+
+	// Only sensors of one frame share its sequence
+	uint8_t id = sensorFrames.ids[indexes[0]];
+	for (size_t i = 1; i < count; i++)
+	{
+		if (sensorFrames.ids[indexes[i]] != id)
+			return false;
+	}
+
+	uint32_t sequence;
+	do {
+		sequence = beginRead(id);
+		for (size_t i = 0; i < count; i++)
+			readSensor(indexes[i], samples[i]);
+	} while (!endRead(id, sequence));
+
+	return true;
+}
+
+bool TelemetrySnapshot::readText(uint8_t index, char* result, size_t size, TelemetrySample& sample) const
+{
+	if (index != FLIGHT_MODE_INDEX || size == 0)
+		return false;
+
+	uint32_t words[TELEMETRY_TEXT_SIZE / 4];
+	uint32_t sequence;
+	do {
+		sequence = beginRead(FLIGHT_MODE_ID);
+		readSensor(index, sample);
+		for (size_t i = 0; i < DIM(words); i++)
+			words[i] = text[i].load(std::memory_order_relaxed);
+	} while (!endRead(FLIGHT_MODE_ID, sequence));
+
+	size_t length = std::min<size_t>(sample.value, size - 1);
+	memcpy(result, words, length);
+	result[length] = '\0';
+	return true;
+}
+
+void TelemetrySnapshot::beginCrossfireTelemetryFrame(uint8_t id)
+{
+	frameTimestamp = getTelemetryTime();
+
+	// Single writer, a plain increment is enough to mark the frame as busy
+	frameSequence[id].store(frameSequence[id].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+}
+
+void TelemetrySnapshot::processCrossfireTelemetryValue(uint8_t index, int32_t value)
+{
+	if (index >= UNKNOWN_INDEX)
+		return;
+
+	Sensor& sensor = sensors[index];
+	sensor.value.store(value, std::memory_order_relaxed);
+	sensor.timestampLow.store((uint32_t)frameTimestamp, std::memory_order_relaxed);
+	sensor.timestampHigh.store((uint32_t)(frameTimestamp >> 32), std::memory_order_relaxed);
+	sensor.sequence.store(sensor.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void TelemetrySnapshot::processCrossfireTelemetryText(uint8_t index, const char* value, uint8_t length)
+{
+	if (index != FLIGHT_MODE_INDEX)
+		return;
+
+	uint32_t words[TELEMETRY_TEXT_SIZE / 4] = {};
+	length = std::min<uint8_t>(length, TELEMETRY_TEXT_SIZE);
+	memcpy(words, value, length);
+	for (size_t i = 0; i < DIM(words); i++)
+		text[i].store(words[i], std::memory_order_relaxed);
+
+	// The value of a text sensor is its length
+	processCrossfireTelemetryValue(index, length);
+}
+
+void TelemetrySnapshot::endCrossfireTelemetryFrame(uint8_t id)
+{
+	frameSequence[id].store(frameSequence[id].load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <atomic>
+
+#include "crossfire.h"
+
+#define TELEMETRY_TEXT_SIZE 16
+
+struct TelemetrySample
+{
+	int32_t value;
+	uint64_t timestamp; // us, steady clock
+	uint32_t sequence;  // Number of updates, 0 if the sensor was never received
+};
+
+// Latest value of every sensor, written by the reader thread and read by any
+// number of other threads. Values of one frame are published together under
+// a per frame id seqlock: the writer never waits, readers retry if they
+// overlap with an update.
+class TelemetrySnapshot : public CrossfireTelemetryHandler
+{
+public:
+	// Latest value of a single sensor
+	bool read(uint8_t index, TelemetrySample& sample) const;
+
+	// Values of several sensors taken from the same frame, e.g. latitude,
+	// longitude and altitude of one GPS frame. All sensors have to be sent in
+	// the same frame id, which is not always the id of their definition,
+	// otherwise false is returned.
+	bool read(const uint8_t* indexes, TelemetrySample* samples, size_t count) const;
+
+	// Latest text of a text sensor (flight mode), NUL terminated
+	bool readText(uint8_t index, char* text, size_t size, TelemetrySample& sample) const;
+
+	void beginCrossfireTelemetryFrame(uint8_t id) override;
+	void processCrossfireTelemetryValue(uint8_t index, int32_t value) override;
+	void processCrossfireTelemetryText(uint8_t index, const char* text, uint8_t length) override;
+	void endCrossfireTelemetryFrame(uint8_t id) override;
+
+private:
+	// 64 bit atomics are not lock-free on every target (ESP32), use halves
+	struct Sensor
+	{
+		std::atomic<int32_t> value{ 0 };
+		std::atomic<uint32_t> timestampLow{ 0 };
+		std::atomic<uint32_t> timestampHigh{ 0 };
+		std::atomic<uint32_t> sequence{ 0 };
+	};
+
+	Sensor sensors[UNKNOWN_INDEX];
+	std::atomic<uint32_t> text[TELEMETRY_TEXT_SIZE / 4] = {};
+
+	// Odd while the frame is being written
+	std::atomic<uint32_t> frameSequence[256] = {};
+
+	uint64_t frameTimestamp = 0;
+
+	uint32_t beginRead(uint8_t id) const;
+	bool endRead(uint8_t id, uint32_t sequence) const;
+	void readSensor(uint8_t index, TelemetrySample& sample) const;
+};
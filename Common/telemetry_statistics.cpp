@@ -0,0 +1,252 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "telemetry_statistics.h"
+
+#include "telemetry_clock.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+TelemetryStatistics::TelemetryStatistics(const uint32_t* windows, size_t windowCount) :
+	windowCount(std::min<size_t>(windowCount, MAX_STATISTICS_WINDOWS))
+{
+	for (size_t i = 0; i < this->windowCount; i++)
+		windowLengths[i] = std::max<uint64_t>(windows[i], 1) * 1000;
+
+	memset(slots, 0xff, sizeof(slots));
+}
+
+bool TelemetryStatistics::track(uint8_t index)
+{
+	if (index >= UNKNOWN_INDEX || sensorCount == MAX_STATISTICS_SENSORS)
+		return false;
+
+	if (slots[index] == 0xff)
+	{
+		Sensor& sensor = sensors[sensorCount];
+		sensor.samples = 0;
+		indexes[sensorCount] = index;
+		slots[index] = (uint8_t)sensorCount++;
+	}
+	return true;
+}
+
+// Moves the current bucket forward to the time, dropping buckets which
+// fell out of the window. At most one pass over the ring per sample.
+void TelemetryStatistics::advance(Window& window, uint64_t length, uint64_t time)
+{
+	uint64_t bucketLength = length / STATISTICS_BUCKETS;
+	if (time < window.bucketStart + bucketLength)
+		return;
+
+	if (time >= window.bucketStart + length)
+	{
+		// Nothing in the window is recent enough, start over
+		memset(window.buckets, 0, sizeof(window.buckets));
+		window.count = 0;
+		window.sum = window.sumSquares = 0;
+		window.bucketStart = time - time % bucketLength;
+		return;
+	}
+
+	while (time >= window.bucketStart + bucketLength)
+	{
+		window.current = (window.current + 1) % STATISTICS_BUCKETS;
+		window.bucketStart += bucketLength;
+
+		Bucket& expired = window.buckets[window.current];
+		window.count -= expired.count;
+		window.sum -= expired.sum;
+		window.sumSquares -= expired.sumSquares;
+		memset(&expired, 0, sizeof(expired));
+	}
+
+	// Extremes and the oldest sample of what is left, a fixed number of buckets
+	window.min = INT32_MAX;
+	window.max = INT32_MIN;
+	bool oldest = false;
+	for (size_t i = 1; i <= STATISTICS_BUCKETS; i++)
+	{
+		const Bucket& bucket = window.buckets[(window.current + i) % STATISTICS_BUCKETS];
+		if (bucket.count == 0)
+			continue;
+
+		window.min = std::min(window.min, bucket.min);
+		window.max = std::max(window.max, bucket.max);
+		if (!oldest)
+		{
+			oldest = true;
+			window.oldestTime = bucket.firstTime;
+			window.oldestValue = bucket.firstValue;
+		}
+	}
+}
+
+void TelemetryStatistics::add(Window& window, uint64_t length, uint64_t time, int32_t value, double offset, uint64_t elapsed)
+{
+	advance(window, length, time);
+
+	Bucket& bucket = window.buckets[window.current];
+	if (bucket.count == 0)
+	{
+		bucket.min = bucket.max = value;
+		bucket.firstTime = time;
+		bucket.firstValue = value;
+	}
+	if (window.count == 0)
+	{
+		window.min = window.max = value;
+		window.oldestTime = time;
+		window.oldestValue = value;
+	}
+
+	++bucket.count;
+	bucket.min = std::min(bucket.min, value);
+	bucket.max = std::max(bucket.max, value);
+	bucket.sum += offset;
+	bucket.sumSquares += offset * offset;
+
+	++window.count;
+	window.min = std::min(window.min, value);
+	window.max = std::max(window.max, value);
+	window.sum += offset;
+	window.sumSquares += offset * offset;
+
+	// Irregular sample times: the weight of the new sample depends on the gap
+	float alpha = 1 - expf(-(float)elapsed / length);
+	window.ewma += alpha * ((float)value - window.ewma);
+}
+
+void TelemetryStatistics::publish(const Window& window, Result& result, uint64_t time, int32_t value, int32_t reference)
+{
+	double mean = window.sum / window.count;
+	double variance = std::max(0.0, window.sumSquares / window.count - mean * mean);
+	uint64_t span = time - window.oldestTime;
+
+	result.count.store(window.count, std::memory_order_relaxed);
+	result.min.store(window.min, std::memory_order_relaxed);
+	result.max.store(window.max, std::memory_order_relaxed);
+	result.mean.store((float)(reference + mean), std::memory_order_relaxed);
+	result.stddev.store((float)sqrt(variance), std::memory_order_relaxed);
+	result.ewma.store(window.ewma, std::memory_order_relaxed);
+	result.rate.store(span ? (float)((double)value - window.oldestValue) * 1e6f / span : 0.0f, std::memory_order_relaxed);
+}
+
+void TelemetryStatistics::beginCrossfireTelemetryFrame(uint8_t id)
+{
+	frameTimestamp = getTelemetryTime();
+}
+
+void TelemetryStatistics::processCrossfireTelemetryValue(uint8_t index, int32_t value)
+{
+	if (index >= UNKNOWN_INDEX || slots[index] == 0xff)
+		return;
+
+	Sensor& sensor = sensors[slots[index]];
+	uint64_t time = frameTimestamp;
+
+	if (sensor.samples++ == 0)
+	{
+		sensor.reference = value;
+		sensor.lastTime = time;
+		for (size_t i = 0; i < windowCount; i++)
+		{
+			memset(&sensor.windows[i], 0, sizeof(Window));
+			sensor.windows[i].bucketStart = time - time % (windowLengths[i] / STATISTICS_BUCKETS);
+			sensor.windows[i].ewma = (float)value;
+		}
+	}
+
+	uint64_t elapsed = time - sensor.lastTime;
+	sensor.lastTime = time;
+
+	double offset = (double)value - sensor.reference;
+	for (size_t i = 0; i < windowCount; i++)
+		add(sensor.windows[i], windowLengths[i], time, value, offset, elapsed);
+
+	// Single writer, a plain increment is enough to mark the results as busy
+	sensor.sequence.store(sensor.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	sensor.last.store(value, std::memory_order_relaxed);
+	sensor.timestampLow.store((uint32_t)time, std::memory_order_relaxed);
+	sensor.timestampHigh.store((uint32_t)(time >> 32), std::memory_order_relaxed);
+	for (size_t i = 0; i < windowCount; i++)
+		publish(sensor.windows[i], sensor.results[i], time, value, sensor.reference);
+
+	sensor.sequence.store(sensor.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+bool TelemetryStatistics::read(uint8_t index, size_t window, TelemetryAggregate& aggregate) const
+{
+	if (index >= UNKNOWN_INDEX || slots[index] == 0xff || window >= windowCount)
+		return false;
+
+	const Sensor& sensor = sensors[slots[index]];
+	const Result& result = sensor.results[window];
+
+	uint32_t sequence;
+	for (;;)
+	{
+		sequence = sensor.sequence.load(std::memory_order_acquire);
+		if (sequence & 1)
+		{
+			// The writer is in the middle of an update, it takes nanoseconds
+			std::this_thread::yield();
+			continue;
+		}
+
+		aggregate.count = result.count.load(std::memory_order_relaxed);
+		aggregate.min = result.min.load(std::memory_order_relaxed);
+		aggregate.max = result.max.load(std::memory_order_relaxed);
+		aggregate.mean = result.mean.load(std::memory_order_relaxed);
+		aggregate.stddev = result.stddev.load(std::memory_order_relaxed);
+		aggregate.ewma = result.ewma.load(std::memory_order_relaxed);
+		aggregate.rate = result.rate.load(std::memory_order_relaxed);
+		aggregate.last = sensor.last.load(std::memory_order_relaxed);
+		aggregate.timestamp = (uint64_t)sensor.timestampHigh.load(std::memory_order_relaxed) << 32 |
+			sensor.timestampLow.load(std::memory_order_relaxed);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (sensor.sequence.load(std::memory_order_relaxed) == sequence)
+			break;
+	}
+
+	return sequence != 0;
+}
+
+void TelemetryStatistics::print(FILE* file, const char* name) const
+{
+	fprintf(file, "%s: statistics\n", name);
+	fprintf(file, "  %-6s %8s %8s %8s %8s %10s %10s %10s %10s\n", "sensor", "window", "count", "min", "max", "mean", "stddev", "ewma", "rate/s");
+
+	for (size_t i = 0; i < sensorCount; i++)
+	{
+		for (size_t window = 0; window < windowCount; window++)
+		{
+			TelemetryAggregate aggregate;
+			if (!read(indexes[i], window, aggregate))
+				break;
+
+			fprintf(file, "  %-6s %7.1fs %8u %8d %8d %10.2f %10.2f %10.2f %10.2f\n", crossfireSensors[indexes[i]].name,
+				getWindowLength(window) / 1e3, aggregate.count, aggregate.min, aggregate.max,
+				aggregate.mean, aggregate.stddev, aggregate.ewma, aggregate.rate);
+		}
+	}
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+
+#include "crossfire.h"
+
+#define MAX_STATISTICS_WINDOWS 4
+#define MAX_STATISTICS_SENSORS 16
+#define STATISTICS_BUCKETS     20 // Per window, windows slide in steps of 1/20 of their length
+
+struct TelemetryAggregate
+{
+	uint32_t count;
+	int32_t min;
+	int32_t max;
+	int32_t last;
+	float mean;
+	float stddev;
+	float ewma;        // Time constant is the window length
+	float rate;        // Change per second from the oldest sample in the window
+	uint64_t timestamp; // us, last sample
+};
+
+// Running min, max, mean, standard deviation, EWMA and rate of change of
+// selected sensors over several time windows at once. Every window is a
+// ring of time buckets holding partial sums, so a sample costs O(1) no
+// matter how many samples a window spans, and all memory is part of the
+// object. Aggregates are published after every sample under a per sensor
+// seqlock: the reader thread never waits, queries from other threads do
+// not rescan anything.
+class TelemetryStatistics : public CrossfireTelemetryHandler
+{
+public:
+	// Window lengths in ms, longest last is easiest to read but not required
+	TelemetryStatistics(const uint32_t* windows, size_t windowCount);
+
+	// Sensors have to be selected before samples arrive
+	bool track(uint8_t index);
+
+	size_t getWindowCount() const { return windowCount; }
+	uint32_t getWindowLength(size_t window) const { return windowLengths[window] / 1000; } // ms
+
+	// Aggregate as of the last sample of the sensor, false if it is not tracked or has no samples
+	bool read(uint8_t index, size_t window, TelemetryAggregate& aggregate) const;
+
+	// Every window of every tracked sensor with samples, values in sensor units without precision
+	void print(FILE* file, const char* name) const;
+
+	void beginCrossfireTelemetryFrame(uint8_t id) override;
+	void processCrossfireTelemetryValue(uint8_t index, int32_t value) override;
+
+private:
+	struct Bucket
+	{
+		uint32_t count;
+		int32_t min;
+		int32_t max;
+		double sum;        // Relative to the first sample of the sensor
+		double sumSquares;
+		uint64_t firstTime;
+		int32_t firstValue;
+	};
+
+	struct Window
+	{
+		Bucket buckets[STATISTICS_BUCKETS];
+		size_t current;
+		uint64_t bucketStart;
+		uint32_t count;
+		double sum;
+		double sumSquares;
+		int32_t min;
+		int32_t max;
+		uint64_t oldestTime;  // First sample of the oldest bucket
+		int32_t oldestValue;
+		float ewma;
+	};
+
+	// Published results, 64 bit atomics are not lock-free on every target
+	struct Result
+	{
+		std::atomic<uint32_t> count{ 0 };
+		std::atomic<int32_t> min{ 0 };
+		std::atomic<int32_t> max{ 0 };
+		std::atomic<float> mean{ 0 };
+		std::atomic<float> stddev{ 0 };
+		std::atomic<float> ewma{ 0 };
+		std::atomic<float> rate{ 0 };
+	};
+
+	struct Sensor
+	{
+		Window windows[MAX_STATISTICS_WINDOWS];
+		uint32_t samples;
+		int32_t reference;  // First sample, keeps the sums small
+		uint64_t lastTime;
+
+		std::atomic<uint32_t> sequence{ 0 }; // Odd while results are written
+		std::atomic<int32_t> last{ 0 };
+		std::atomic<uint32_t> timestampLow{ 0 };
+		std::atomic<uint32_t> timestampHigh{ 0 };
+		Result results[MAX_STATISTICS_WINDOWS];
+	};
+
+	uint64_t windowLengths[MAX_STATISTICS_WINDOWS]; // us
+	size_t windowCount;
+	uint8_t slots[UNKNOWN_INDEX]; // Sensor of a telemetry index, 0xff if not tracked
+	uint8_t indexes[MAX_STATISTICS_SENSORS];
+	Sensor sensors[MAX_STATISTICS_SENSORS];
+	size_t sensorCount = 0;
+	uint64_t frameTimestamp = 0;
+
+	void advance(Window& window, uint64_t length, uint64_t time);
+	void add(Window& window, uint64_t length, uint64_t time, int32_t value, double offset, uint64_t elapsed);
+	void publish(const Window& window, Result& result, uint64_t time, int32_t value, int32_t reference);
+};
@@ -0,0 +1,443 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "telemetry_store.h"
+#include "varint.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+// Varint timestamps, then first value, width, packed values and padding per column
+#define STORE_BLOCK_MAX_SIZE (STORE_BLOCK_FRAMES * VARINT_MAX_SIZE + STORE_BLOCK_SENSORS * (STORE_BLOCK_FRAMES * 5 + 16))
+
+static inline uint64_t loadLittleEndian64(const uint8_t* data)
+{
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	uint64_t value;
+	memcpy(&value, data, sizeof(value));
+	return value;
+#else
+	uint64_t value = 0;
+	for (int i = 7; i >= 0; i--)
+		value = value << 8 | data[i];
+	return value;
+#endif
+}
+
+static inline void storeLittleEndian64(uint8_t* data, uint64_t value)
+{
+	for (int i = 0; i < 8; i++)
+		data[i] = (uint8_t)(value >> (8 * i));
+}
+
+static inline uint32_t loadLittleEndian32(const uint8_t* data)
+{
+	return data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+static inline void storeLittleEndian32(uint8_t* data, uint32_t value)
+{
+	for (int i = 0; i < 4; i++)
+		data[i] = (uint8_t)(value >> (8 * i));
+}
+
+static void encodeIndexEntry(const TelemetryStoreColumn& column, uint8_t* entry)
+{
+	storeLittleEndian64(entry, column.offset);
+	storeLittleEndian32(entry + 8, column.valuesOffset);
+	storeLittleEndian32(entry + 12, column.size);
+	storeLittleEndian64(entry + 16, column.firstTime);
+	storeLittleEndian64(entry + 24, column.lastTime);
+	storeLittleEndian64(entry + 32, (uint64_t)column.sum);
+	storeLittleEndian32(entry + 40, (uint32_t)column.minValue);
+	storeLittleEndian32(entry + 44, (uint32_t)column.maxValue);
+	entry[48] = (uint8_t)column.count;
+	entry[49] = (uint8_t)(column.count >> 8);
+	entry[50] = column.index;
+	entry[51] = column.width;
+	entry[52] = column.frameId;
+	memset(entry + 53, 0, STORE_INDEX_ENTRY_SIZE - 53);
+}
+
+TelemetryStoreWriter::TelemetryStoreWriter() :
+	buffer(STORE_BLOCK_MAX_SIZE)
+{
+}
+
+bool TelemetryStoreWriter::open(const char* path)
+{
+	close();
+
+	file = fopen(path, "wb");
+	if (!file)
+		return false;
+
+	uint8_t header[STORE_HEADER_SIZE];
+	memcpy(header, STORE_MAGIC, 7);
+	header[7] = STORE_VERSION;
+
+	offset = sizeof(header);
+	samples = 0;
+	error = 0;
+	frameTime = 0;
+	blocks.clear();
+	columns.clear();
+	for (int16_t& block : blockOf)
+		block = -1;
+
+	return fwrite(header, 1, sizeof(header), file) == sizeof(header);
+}
+
+bool TelemetryStoreWriter::close()
+{
+	if (!file)
+		return true;
+
+	// The blocks after a failed write would not be where the index says
+	if (error)
+	{
+		fclose(file);
+		file = nullptr;
+		return false;
+	}
+
+	bool result = true;
+	for (Block& block : blocks)
+	{
+		if (block.count > 0)
+			result = writeBlock(block) && result;
+	}
+
+	// Queries find the columns of a sensor by binary search
+	std::stable_sort(columns.begin(), columns.end(), [](const TelemetryStoreColumn& a, const TelemetryStoreColumn& b)
+	{
+		return a.index != b.index ? a.index < b.index : a.firstTime < b.firstTime;
+	});
+
+	uint8_t entry[STORE_INDEX_ENTRY_SIZE];
+	for (const TelemetryStoreColumn& column : columns)
+	{
+		encodeIndexEntry(column, entry);
+		result = fwrite(entry, 1, sizeof(entry), file) == sizeof(entry) && result;
+	}
+
+	uint8_t trailer[STORE_TRAILER_SIZE];
+	storeLittleEndian64(trailer, offset);
+	storeLittleEndian64(trailer + 8, columns.size());
+	result = fwrite(trailer, 1, sizeof(trailer), file) == sizeof(trailer) && result;
+
+	result = fclose(file) == 0 && result;
+	file = nullptr;
+	return result;
+}
+
+void TelemetryStoreWriter::beginCrossfireTelemetryFrame(uint8_t id)
+{
+	uint64_t time = nextTime;
+	if (time == 0)
+	{
+		time = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+	}
+
+	// Columns have to stay sorted, a clock step back repeats the last time
+	frameTime = std::max(frameTime, time);
+	frameCount = 0;
+}
+
+void TelemetryStoreWriter::processCrossfireTelemetryValue(uint8_t index, int32_t value)
+{
+	if (index >= UNKNOWN_INDEX || frameCount == STORE_BLOCK_SENSORS)
+		return;
+
+	frameSensors[frameCount] = index;
+	frameValues[frameCount] = value;
+	frameCount++;
+}
+
+void TelemetryStoreWriter::endCrossfireTelemetryFrame(uint8_t id)
+{
+	if (!file || error || frameCount == 0)
+		return;
+
+	// A block per frame id, allocated with the first frame of the id
+	if (blockOf[id] < 0)
+	{
+		blockOf[id] = (int16_t)blocks.size();
+		blocks.emplace_back();
+		blocks.back().frameId = id;
+		blocks.back().count = 0;
+	}
+
+	Block& block = blocks[blockOf[id]];
+	if (block.count > 0 && (block.sensorCount != frameCount || memcmp(block.sensors, frameSensors, frameCount) != 0) &&
+		!writeBlock(block))
+		return;
+
+	if (block.count == 0)
+	{
+		block.sensorCount = frameCount;
+		memcpy(block.sensors, frameSensors, frameCount);
+	}
+
+	block.timestamps[block.count] = frameTime;
+	for (uint8_t i = 0; i < frameCount; i++)
+		block.values[i][block.count] = frameValues[i];
+	samples += frameCount;
+
+	if (++block.count == STORE_BLOCK_FRAMES)
+		writeBlock(block); // A failure is kept in error
+}
+
+bool TelemetryStoreWriter::writeBlock(Block& block)
+{
+	size_t count = block.count;
+	block.count = 0;
+
+	uint8_t* data = buffer.data();
+	size_t used = 0;
+
+	uint64_t previousDelta = 0;
+	for (size_t i = 1; i < count; i++)
+	{
+		uint64_t delta = block.timestamps[i] - block.timestamps[i - 1];
+		if (i == 1)
+			used += writeVarint(&data[used], delta);
+		else
+			used += writeVarint(&data[used], encodeZigzag((int64_t)(delta - previousDelta)));
+		previousDelta = delta;
+	}
+
+	size_t firstColumn = columns.size();
+	for (uint8_t sensor = 0; sensor < block.sensorCount; sensor++)
+	{
+		const int32_t* values = block.values[sensor];
+
+		TelemetryStoreColumn column = {};
+		column.offset = offset;
+		column.valuesOffset = (uint32_t)used;
+		column.firstTime = block.timestamps[0];
+		column.lastTime = block.timestamps[count - 1];
+		column.minValue = column.maxValue = values[0];
+		column.count = (uint16_t)count;
+		column.index = block.sensors[sensor];
+		column.frameId = block.frameId;
+
+		// Zigzag deltas of int32 values need up to 33 bits
+		uint64_t bits = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			column.sum += values[i];
+			column.minValue = std::min(column.minValue, values[i]);
+			column.maxValue = std::max(column.maxValue, values[i]);
+			if (i > 0)
+				bits |= encodeZigzag((int64_t)values[i] - values[i - 1]);
+		}
+
+		uint8_t width = 0;
+		while (bits >> width)
+			width++;
+		column.width = width;
+
+		storeLittleEndian32(&data[used], (uint32_t)values[0]);
+		data[used + 4] = width;
+		used += 5;
+
+		size_t packedSize = ((count - 1) * width + 7) / 8 + 8;
+		memset(&data[used], 0, packedSize);
+		for (size_t i = 1; i < count; i++)
+		{
+			uint64_t position = (i - 1) * width;
+			uint64_t delta = encodeZigzag((int64_t)values[i] - values[i - 1]);
+			uint8_t* word = &data[used + position / 8];
+			storeLittleEndian64(word, loadLittleEndian64(word) | delta << (position % 8));
+		}
+		used += packedSize;
+
+		columns.push_back(column);
+	}
+
+	for (size_t i = firstColumn; i < columns.size(); i++)
+		columns[i].size = (uint32_t)used;
+
+	offset += used;
+	if (fwrite(data, 1, used, file) != used)
+	{
+		if (!error)
+			error = errno ? errno : EIO;
+		return false;
+	}
+	return true;
+}
+
+TelemetryStoreReader::TelemetryStoreReader(const uint8_t* data, size_t size) :
+	data(data),
+	size(size)
+{
+	if (size < STORE_HEADER_SIZE + STORE_TRAILER_SIZE || memcmp(data, STORE_MAGIC, 7) != 0 || data[7] != STORE_VERSION)
+		return;
+
+	const uint8_t* trailer = data + size - STORE_TRAILER_SIZE;
+	uint64_t indexOffset = loadLittleEndian64(trailer);
+	uint64_t count = loadLittleEndian64(trailer + 8);
+	if (indexOffset < STORE_HEADER_SIZE || indexOffset > size - STORE_TRAILER_SIZE ||
+		count != (size - STORE_TRAILER_SIZE - indexOffset) / STORE_INDEX_ENTRY_SIZE)
+		return;
+
+	index = data + indexOffset;
+	columnCount = (size_t)count;
+	valid = true;
+}
+
+TelemetryStoreColumn TelemetryStoreReader::getColumn(size_t column) const
+{
+	const uint8_t* entry = index + column * STORE_INDEX_ENTRY_SIZE;
+
+	TelemetryStoreColumn result;
+	result.offset = loadLittleEndian64(entry);
+	result.valuesOffset = loadLittleEndian32(entry + 8);
+	result.size = loadLittleEndian32(entry + 12);
+	result.firstTime = loadLittleEndian64(entry + 16);
+	result.lastTime = loadLittleEndian64(entry + 24);
+	result.sum = (int64_t)loadLittleEndian64(entry + 32);
+	result.minValue = (int32_t)loadLittleEndian32(entry + 40);
+	result.maxValue = (int32_t)loadLittleEndian32(entry + 44);
+	result.count = entry[48] | entry[49] << 8;
+	result.index = entry[50];
+	result.width = entry[51];
+	result.frameId = entry[52];
+	return result;
+}
+
+bool TelemetryStoreReader::getTimeRange(uint64_t& first, uint64_t& last) const
+{
+	first = UINT64_MAX;
+	last = 0;
+	for (size_t i = 0; i < columnCount; i++)
+	{
+		TelemetryStoreColumn column = getColumn(i);
+		first = std::min(first, column.firstTime);
+		last = std::max(last, column.lastTime);
+	}
+	return columnCount > 0;
+}
+
+// Binary search over the index for the first column of the sensor which
+// ends at or after from
+size_t TelemetryStoreReader::findFirstColumn(uint8_t sensor, uint64_t from) const
+{
+	size_t low = 0, high = columnCount;
+	while (low < high)
+	{
+		size_t middle = low + (high - low) / 2;
+		TelemetryStoreColumn column = getColumn(middle);
+		if (column.index < sensor || (column.index == sensor && column.lastTime < from))
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low;
+}
+
+size_t TelemetryStoreReader::decodeColumn(const TelemetryStoreColumn& column, uint64_t* timestamps, int32_t* values) const
+{
+	size_t count = column.count;
+	if (count == 0 || count > STORE_BLOCK_FRAMES || column.width > 33 ||
+		column.offset > size || column.size > size - column.offset || column.valuesOffset > column.size)
+		return 0;
+
+	const uint8_t* position = data + column.offset;
+	const uint8_t* end = position + column.valuesOffset;
+
+	timestamps[0] = column.firstTime;
+	uint64_t delta = 0;
+	for (size_t i = 1; i < count; i++)
+	{
+		uint64_t encoded;
+		if (!readVarint(position, end, encoded))
+			return 0;
+		delta = i == 1 ? encoded : delta + decodeZigzag(encoded);
+		timestamps[i] = timestamps[i - 1] + delta;
+	}
+
+	position = end;
+	size_t packedSize = ((count - 1) * column.width + 7) / 8 + 8;
+	if (column.size - column.valuesOffset < 5 + packedSize)
+		return 0;
+
+	int32_t value = (int32_t)loadLittleEndian32(position);
+	const uint8_t* packed = position + 5;
+	values[0] = value;
+
+	// Fixed width fields: one unaligned 64 bit load per value, no branches
+	unsigned width = column.width;
+	uint64_t mask = ((uint64_t)1 << width) - 1;
+	for (size_t i = 1; i < count; i++)
+	{
+		uint64_t bit = (uint64_t)(i - 1) * width;
+		uint64_t encoded = loadLittleEndian64(packed + bit / 8) >> (bit % 8) & mask;
+		value = (int32_t)((int64_t)value + decodeZigzag(encoded));
+		values[i] = value;
+	}
+
+	return count;
+}
+
+bool TelemetryStoreReader::summarize(uint8_t sensor, uint64_t from, uint64_t to, TelemetryStoreSummary& summary) const
+{
+	summary = {};
+	summary.minValue = INT32_MAX;
+	summary.maxValue = INT32_MIN;
+
+	uint64_t timestamps[STORE_BLOCK_FRAMES];
+	int32_t values[STORE_BLOCK_FRAMES];
+
+	for (size_t i = findFirstColumn(sensor, from); i < columnCount; i++)
+	{
+		TelemetryStoreColumn column = getColumn(i);
+		if (column.index != sensor || column.firstTime >= to)
+			break;
+
+		if (column.firstTime >= from && column.lastTime < to)
+		{
+			// Whole column in the range, the index has the answer
+			summary.count += column.count;
+			summary.sum += column.sum;
+			summary.minValue = std::min(summary.minValue, column.minValue);
+			summary.maxValue = std::max(summary.maxValue, column.maxValue);
+			summary.indexedColumns++;
+			continue;
+		}
+
+		size_t count = decodeColumn(column, timestamps, values);
+		if (count == 0)
+			return false;
+
+		for (size_t j = 0; j < count; j++)
+		{
+			if (timestamps[j] < from || timestamps[j] >= to)
+				continue;
+			summary.count++;
+			summary.sum += values[j];
+			summary.minValue = std::min(summary.minValue, values[j]);
+			summary.maxValue = std::max(summary.maxValue, values[j]);
+		}
+		summary.decodedColumns++;
+	}
+
+	return true;
+}
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "crossfire.h"
+
+// Store file layout, all numbers little endian
+//   header: "CRSFSTO" magic, version byte
+//   blocks: up to STORE_BLOCK_FRAMES frames of one frame id, in columns
+//     timestamps: varint delta of the second frame, then zigzag varint
+//       delta of deltas, the first timestamp is kept in the index
+//     a column per sensor of the frame: int32 first value, bit width byte,
+//       zigzag deltas to the previous value packed with that many bits
+//       each, 8 bytes of padding
+//   index: one STORE_INDEX_ENTRY_SIZE entry per column, by sensor and time
+//   trailer: uint64 offset of the index, uint64 number of entries
+// Timestamps are us since epoch. Sensors of one frame share their time
+// column, which is most of the data. Text sensors are not stored.
+
+#define STORE_MAGIC            "CRSFSTO"
+#define STORE_VERSION          1
+#define STORE_HEADER_SIZE      8
+#define STORE_TRAILER_SIZE     16
+#define STORE_INDEX_ENTRY_SIZE 56
+#define STORE_BLOCK_FRAMES     1024
+#define STORE_BLOCK_SENSORS    CROSSFIRE_CHANNEL_COUNT // Most values one frame carries
+
+// Index entry of one column, min, max and sum answer aggregates without
+// decoding the column
+struct TelemetryStoreColumn
+{
+	uint64_t offset;       // Of the block, where the timestamps start
+	uint32_t valuesOffset; // Of the column, from the start of the block
+	uint32_t size;         // Of the block
+	uint64_t firstTime;
+	uint64_t lastTime;
+	int64_t sum;
+	int32_t minValue;
+	int32_t maxValue;
+	uint16_t count;
+	uint8_t index;         // CrossfireSensorIndexes
+	uint8_t width;
+	uint8_t frameId;
+};
+
+// Collects the samples of every frame id in columns and writes them out
+// as a compressed block when the block is full, or when a frame carries
+// other sensors than the frames before. The index is written by close(),
+// a store of a process which was killed has no index.
+class TelemetryStoreWriter : public CrossfireTelemetryHandler
+{
+public:
+	TelemetryStoreWriter();
+	~TelemetryStoreWriter() override { close(); }
+
+	bool open(const char* path);
+	bool close();
+
+	// Time of the bytes handed to the stream next, us since epoch, e.g.
+	// the time of a capture record. Frames get the wall clock without it.
+	void setTime(uint64_t time) { nextTime = time; }
+
+	uint64_t getSamples() const { return samples; }
+
+	// errno of the first failed write, 0 if all succeeded. Nothing more is
+	// written after a failure, close() returns false.
+	int getError() const { return error; }
+
+	void beginCrossfireTelemetryFrame(uint8_t id) override;
+	void processCrossfireTelemetryValue(uint8_t index, int32_t value) override;
+	void endCrossfireTelemetryFrame(uint8_t id) override;
+
+private:
+	struct Block
+	{
+		uint8_t frameId;
+		uint8_t sensorCount;
+		uint8_t sensors[STORE_BLOCK_SENSORS];
+		uint16_t count;
+		uint64_t timestamps[STORE_BLOCK_FRAMES];
+		int32_t values[STORE_BLOCK_SENSORS][STORE_BLOCK_FRAMES];
+	};
+
+	FILE* file = nullptr;
+	uint64_t offset = 0;
+	uint64_t samples = 0;
+	uint64_t nextTime = 0;
+	uint64_t frameTime = 0;
+	int error = 0;
+
+	// Values of the frame being decoded
+	uint8_t frameSensors[STORE_BLOCK_SENSORS];
+	int32_t frameValues[STORE_BLOCK_SENSORS];
+	uint8_t frameCount = 0;
+
+	std::vector<Block> blocks;
+	int16_t blockOf[256]; // Frame id to blocks, -1 before the first frame
+	std::vector<TelemetryStoreColumn> columns;
+	std::vector<uint8_t> buffer;
+
+	bool writeBlock(Block& block);
+};
+
+struct TelemetryStoreSummary
+{
+	uint64_t count;
+	int64_t sum;
+	int32_t minValue;
+	int32_t maxValue;
+	uint32_t decodedColumns; // Columns only partly in the range
+	uint32_t indexedColumns; // Columns answered from the index
+};
+
+// Queries a store held in memory, e.g. a mapped file, without copying it
+class TelemetryStoreReader
+{
+public:
+	TelemetryStoreReader(const uint8_t* data, size_t size);
+
+	bool isValid() const { return valid; }
+	size_t getColumnCount() const { return columnCount; }
+	TelemetryStoreColumn getColumn(size_t column) const;
+
+	// First and last timestamp of all sensors, false for an empty store
+	bool getTimeRange(uint64_t& first, uint64_t& last) const;
+
+	// Calls visit(timestamps, values, count) with the samples of a sensor
+	// from <= time < to, in time order and in batches of up to
+	// STORE_BLOCK_FRAMES. Blocks outside the range are not touched.
+	// Returns false if a block is corrupted.
+	template <typename Visitor>
+	bool query(uint8_t index, uint64_t from, uint64_t to, Visitor visit) const;
+
+	// Count, sum, min and max of a sensor from <= time < to
+	bool summarize(uint8_t index, uint64_t from, uint64_t to, TelemetryStoreSummary& summary) const;
+
+	// Returns the number of samples, 0 if the block is corrupted
+	size_t decodeColumn(const TelemetryStoreColumn& column, uint64_t* timestamps, int32_t* values) const;
+
+private:
+	const uint8_t* data;
+	size_t size;
+	const uint8_t* index = nullptr;
+	size_t columnCount = 0;
+	bool valid = false;
+
+	size_t findFirstColumn(uint8_t index, uint64_t from) const;
+};
+
+template <typename Visitor>
+bool TelemetryStoreReader::query(uint8_t index, uint64_t from, uint64_t to, Visitor visit) const
+{
+	uint64_t timestamps[STORE_BLOCK_FRAMES];
+	int32_t values[STORE_BLOCK_FRAMES];
+
+	for (size_t i = findFirstColumn(index, from); i < columnCount; i++)
+	{
+		TelemetryStoreColumn column = getColumn(i);
+		if (column.index != index || column.firstTime >= to)
+			break;
+
+		size_t count = decodeColumn(column, timestamps, values);
+		if (count == 0)
+			return false;
+
+		// Timestamps are sorted, trim the column to the range
+		size_t first = 0, last = count;
+		while (first < last && timestamps[first] < from)
+			first++;
+		while (last > first && timestamps[last - 1] >= to)
+			last--;
+
+		if (first < last)
+			visit(&timestamps[first], &values[first], last - first);
+	}
+
+	return true;
+}
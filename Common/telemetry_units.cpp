@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "telemetry_units.h"
+
+#include <cmath>
+
+// Conversions between units, factors to multiply with
+struct UnitConversion {
+	TelemetryUnit from;
+	TelemetryUnit to;
+	double factor;
+};
+
+static const UnitConversion anyConversions[] = {
+	{ UNIT_RADIANS, UNIT_DEGREE, 180 / 3.14159265358979323846 },
+};
+
+static const UnitConversion imperialConversions[] = {
+	{ UNIT_KMH,               UNIT_MPH,             1 / 1.609344 },
+	{ UNIT_METERS,            UNIT_FEET,            1 / 0.3048 },
+	{ UNIT_METERS_PER_SECOND, UNIT_FEET_PER_SECOND, 1 / 0.3048 },
+	{ UNIT_CELSIUS,           UNIT_FAHRENHEIT,      1.8 }, // Offset is not applied, no sensor reports temperatures
+};
+
+uint8_t getCrossfireSensorDecimals(uint8_t index)
+{
+	if (index == GPS_LATITUDE_INDEX || index == GPS_LONGITUDE_INDEX)
+		return 6;
+	return getCrossfireSensor(index).precision;
+}
+
+const char* getTelemetryUnitName(TelemetryUnit unit)
+{
+	switch (unit)
+	{
+	case UNIT_VOLTS:             return "V";
+	case UNIT_AMPS:              return "A";
+	case UNIT_MILLIAMPS:         return "mA";
+	case UNIT_KTS:               return "kts";
+	case UNIT_METERS_PER_SECOND: return "m/s";
+	case UNIT_FEET_PER_SECOND:   return "ft/s";
+	case UNIT_KMH:               return "km/h";
+	case UNIT_MPH:               return "mph";
+	case UNIT_METERS:            return "m";
+	case UNIT_FEET:              return "ft";
+	case UNIT_CELSIUS:           return "C";
+	case UNIT_FAHRENHEIT:        return "F";
+	case UNIT_PERCENT:           return "%";
+	case UNIT_MAH:               return "mAh";
+	case UNIT_WATTS:             return "W";
+	case UNIT_MILLIWATTS:        return "mW";
+	case UNIT_DB:                return "dB";
+	case UNIT_RPMS:              return "rpm";
+	case UNIT_G:                 return "g";
+	case UNIT_DEGREE:            return "deg";
+	case UNIT_RADIANS:           return "rad";
+	case UNIT_HERTZ:             return "Hz";
+	case UNIT_MS:                return "ms";
+	case UNIT_US:                return "us";
+	case UNIT_KM:                return "km";
+	case UNIT_DBM:               return "dBm";
+	case UNIT_GPS_LATITUDE:
+	case UNIT_GPS_LONGITUDE:     return "deg";
+	default:                     return "";
+	}
+}
+
+static const UnitConversion* findConversion(const UnitConversion* conversions, size_t count, TelemetryUnit unit)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		if (conversions[i].from == unit)
+			return &conversions[i];
+	}
+	return nullptr;
+}
+
+TelemetryUnits::TelemetryUnits(TelemetryUnitSystem system)
+{
+	for (size_t index = 0; index < CROSSFIRE_SENSOR_SLOTS; index++)
+	{
+		TelemetryUnit unit = getCrossfireSensor((uint8_t)index).unit;
+		uint8_t decimals = getCrossfireSensorDecimals((uint8_t)index);
+
+		const UnitConversion* conversion = findConversion(anyConversions, DIM(anyConversions), unit);
+		if (!conversion && system == UNITS_IMPERIAL)
+			conversion = findConversion(imperialConversions, DIM(imperialConversions), unit);
+
+		// Unchanged units keep their precision and are not scaled at all
+		double factor = 1;
+		TelemetryScale& scale = scales[index];
+		scale.unit = unit;
+		scale.decimals = decimals;
+		if (conversion)
+		{
+			scale.unit = conversion->to;
+			scale.decimals = TELEMETRY_SCALE_DECIMALS;
+			factor = conversion->factor * std::pow(10.0, TELEMETRY_SCALE_DECIMALS - decimals);
+		}
+		scale.multiplier = std::llround(factor * (1ll << TELEMETRY_SCALE_SHIFT));
+	}
+}
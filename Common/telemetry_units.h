@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "crossfire.h"
+#include "crossfire_registry.h"
+
+#define TELEMETRY_SCALE_SHIFT    20 // Fraction bits of the scale multipliers
+#define TELEMETRY_SCALE_DECIMALS 3  // Decimals of values whose unit is converted
+
+enum TelemetryUnitSystem {
+	UNITS_METRIC,   // km/h, m, m/s
+	UNITS_IMPERIAL, // mph, ft, ft/s
+};
+
+// Raw value of a sensor to a calibrated unit: value * multiplier >> TELEMETRY_SCALE_SHIFT
+// is the value in unit with decimals decimal places
+struct TelemetryScale {
+	int64_t multiplier;
+	TelemetryUnit unit;
+	uint8_t decimals;
+};
+
+// Decimal places of the raw value of a sensor, the precision of its
+// definition. GPS coordinates come in 10^-6 degree.
+uint8_t getCrossfireSensorDecimals(uint8_t index);
+
+// Symbol of a unit, empty for raw values
+const char* getTelemetryUnitName(TelemetryUnit unit);
+
+// Scale of every sensor, computed once, custom frames have to be registered
+// before. Angles are converted from radians to degrees in both systems.
+class TelemetryUnits
+{
+public:
+	explicit TelemetryUnits(TelemetryUnitSystem system = UNITS_METRIC);
+
+	const TelemetryScale& getScale(uint8_t index) const { return scales[index]; }
+
+	// Rounded to the nearest step of the last decimal
+	int32_t convert(uint8_t index, int32_t value) const
+	{
+		const int64_t half = 1ll << (TELEMETRY_SCALE_SHIFT - 1);
+		return (int32_t)((value * getScale(index).multiplier + half) >> TELEMETRY_SCALE_SHIFT);
+	}
+
+private:
+	TelemetryScale scales[CROSSFIRE_SENSOR_SLOTS];
+};
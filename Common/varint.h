@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// LEB128 variable length integers, used by the capture and store formats
+
+#define VARINT_MAX_SIZE 10
+
+inline size_t writeVarint(uint8_t* dst, uint64_t value)
+{
+	size_t size = 0;
+	while (value >= 0x80) {
+		dst[size++] = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	dst[size++] = (uint8_t)value;
+	return size;
+}
+
+inline bool readVarint(const uint8_t*& position, const uint8_t* end, uint64_t& value)
+{
+	value = 0;
+	for (unsigned shift = 0; position < end && shift < 64; shift += 7) {
+		uint8_t byte = *position++;
+		value |= (uint64_t)(byte & 0x7f) << shift;
+		if (!(byte & 0x80))
+			return true;
+	}
+	return false;
+}
+
+// Maps small negative and positive numbers to small unsigned ones
+inline uint64_t encodeZigzag(int64_t value)
+{
+	return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+inline int64_t decodeZigzag(uint64_t value)
+{
+	return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Example consumer of the shared memory telemetry bus: prints every sample
+// as it is published, or the latest value table once a second
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <getopt.h>
+#include <iostream>
+
+#include "crossfire_registry.h"
+#include "shared_memory.h"
+#include "telemetry_bus.h"
+
+#define READ_BATCH   256
+#define POLL_DELAY   200000 // ns, time to sleep when there is nothing new
+
+static volatile sig_atomic_t running = 1;
+
+static void stop(int)
+{
+	running = 0;
+}
+
+static void sleepNs(long ns)
+{
+	timespec delay = { 0, ns };
+	nanosleep(&delay, nullptr);
+}
+
+static void printSamples(TelemetryBusReader& reader)
+{
+	TelemetryBusSample samples[READ_BATCH];
+	uint64_t lost = 0;
+
+	while (running)
+	{
+		size_t count = reader.read(samples, READ_BATCH);
+		if (count == 0)
+		{
+			// Polling the write position costs no syscall, sleeping bounds the CPU use
+			sleepNs(POLL_DELAY);
+			continue;
+		}
+
+		for (size_t i = 0; i < count; i++)
+		{
+			// The index comes from another process, the registry has a sensor for any
+			const TelemetryBusSample& sample = samples[i];
+			printf("%u %llu %s %s %d\n", sample.source, (unsigned long long)sample.timestamp,
+				getCrossfireFrameName(sample.frameId), getCrossfireSensor(sample.index).name, sample.value);
+		}
+
+		if (reader.getLost() != lost)
+		{
+			fprintf(stderr, "Lost %llu samples\n", (unsigned long long)(reader.getLost() - lost));
+			lost = reader.getLost();
+		}
+		fflush(stdout);
+	}
+}
+
+static void printLatest(TelemetryBusReader& reader)
+{
+	while (running)
+	{
+		for (uint8_t index = 0; index < UNKNOWN_INDEX; index++)
+		{
+			TelemetrySample sample;
+			if (!reader.readLatest(index, sample))
+				continue;
+
+			if (index == FLIGHT_MODE_INDEX)
+			{
+				char text[TELEMETRY_TEXT_SIZE + 1];
+				reader.readText(text, sizeof(text));
+				printf("%-5s %s\n", getCrossfireSensor(index).name, text);
+			}
+			else
+				printf("%-5s %d\n", getCrossfireSensor(index).name, sample.value);
+		}
+		printf("\n");
+		fflush(stdout);
+		sleep(1);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	static const option longOptions[] = {
+		{ "latest", no_argument, nullptr, 'l' },
+		{ "help",   no_argument, nullptr, 'h' },
+		{ nullptr,  0,           nullptr, 0 },
+	};
+
+	bool latest = false;
+	int option;
+	while ((option = getopt_long(argc, argv, "lh", longOptions, nullptr)) != -1)
+	{
+		switch (option)
+		{
+		case 'l': latest = true; break;
+		default:
+			std::cerr << "Usage: " << argv[0] << " [--latest] [name]\n"
+				"  -l, --latest               print the latest value of every sensor once a second\n";
+			return option == 'h' ? 0 : 1;
+		}
+	}
+
+	const char* name = optind < argc ? argv[optind] : "/crsf-telemetry";
+
+	struct sigaction action = {};
+	action.sa_handler = stop;
+	sigaction(SIGINT, &action, nullptr);
+	sigaction(SIGTERM, &action, nullptr);
+
+	SharedMemory memory;
+	if (!memory.open(name))
+	{
+		std::cerr << "Error: Unable to open " << name << ": " << strerror(errno) << std::endl;
+		return 1;
+	}
+
+	TelemetryBusReader reader(memory.data(), memory.size());
+	if (!reader.isValid())
+	{
+		std::cerr << "Error: " << name << " is not a telemetry bus" << std::endl;
+		return 1;
+	}
+
+	if (latest)
+		printLatest(reader);
+	else
+		printSamples(reader);
+
+	return 0;
+}
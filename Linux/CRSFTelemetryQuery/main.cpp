@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Prints the samples or a summary of selected sensors over a time range
+// of a store written by crsf-telemetry-reader --store
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include <iostream>
+#include <vector>
+
+#include "crossfire_registry.h"
+#include "mapped_file.h"
+#include "telemetry_store.h"
+
+static void usage(const char* name)
+{
+	std::cerr << "Usage: " << name << " [options] FILE\n"
+		"  -f, --from SECONDS         start of the range, relative to the first sample\n"
+		"  -t, --to SECONDS           end of the range, relative to the first sample\n"
+		"  -n, --sensor NAME          sensor name or index, can be given more than once,\n"
+		"                             all sensors by default\n"
+		"  -s, --summary              count, min, max and mean instead of the samples\n"
+		"  -h, --help                 show this help\n";
+}
+
+// Names are not unique, GPS selects latitude and longitude. The store
+// keeps the built-in sensors only.
+static bool selectSensors(const char* name, std::vector<uint8_t>& sensors)
+{
+	char* end;
+	long index = strtol(name, &end, 10);
+	if (*end == '\0' && end != name)
+	{
+		if (index < 0 || index >= UNKNOWN_INDEX)
+			return false;
+		sensors.push_back((uint8_t)index);
+		return true;
+	}
+
+	bool found = false;
+	for (uint8_t i = 0; i < UNKNOWN_INDEX; i++)
+	{
+		if (strcmp(getCrossfireSensor(i).name, name) == 0)
+		{
+			sensors.push_back(i);
+			found = true;
+		}
+	}
+	return found;
+}
+
+int main(int argc, char* argv[])
+{
+	static const option longOptions[] = {
+		{ "from",    required_argument, nullptr, 'f' },
+		{ "to",      required_argument, nullptr, 't' },
+		{ "sensor",  required_argument, nullptr, 'n' },
+		{ "summary", no_argument,       nullptr, 's' },
+		{ "help",    no_argument,       nullptr, 'h' },
+		{ nullptr,   0,                 nullptr, 0 },
+	};
+
+	double from = 0, to = -1;
+	bool summary = false;
+	std::vector<uint8_t> sensors;
+
+	int option;
+	while ((option = getopt_long(argc, argv, "f:t:n:sh", longOptions, nullptr)) != -1)
+	{
+		switch (option)
+		{
+		case 'f': from = atof(optarg); break;
+		case 't': to = atof(optarg); break;
+		case 'n':
+			if (!selectSensors(optarg, sensors))
+			{
+				std::cerr << "Error: Unknown sensor " << optarg << std::endl;
+				return 1;
+			}
+			break;
+		case 's': summary = true; break;
+		case 'h': usage(argv[0]); return 0;
+		default:  usage(argv[0]); return 1;
+		}
+	}
+
+	if (optind != argc - 1)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	const char* path = argv[optind];
+	MappedFile file;
+	if (!file.open(path))
+	{
+		std::cerr << "Error: Unable to open " << path << ": " << strerror(errno) << std::endl;
+		return 1;
+	}
+
+	TelemetryStoreReader store(file.data(), file.size());
+	if (!store.isValid())
+	{
+		std::cerr << "Error: " << path << " is not a store or was not closed" << std::endl;
+		return 1;
+	}
+
+	uint64_t first, last;
+	if (!store.getTimeRange(first, last))
+		return 0;
+
+	if (sensors.empty())
+	{
+		for (uint8_t i = 0; i < UNKNOWN_INDEX; i++)
+			sensors.push_back(i);
+	}
+
+	uint64_t begin = first + (uint64_t)(from * 1e6);
+	uint64_t end = to < 0 ? last + 1 : first + (uint64_t)(to * 1e6);
+
+	for (uint8_t index : sensors)
+	{
+		const char* name = getCrossfireSensor(index).name;
+		bool valid;
+
+		if (summary)
+		{
+			TelemetryStoreSummary result;
+			valid = store.summarize(index, begin, end, result);
+			if (valid && result.count > 0)
+			{
+				printf("%-5s count %" PRIu64 " min %d max %d mean %.2f\n", name, result.count,
+					result.minValue, result.maxValue, (double)result.sum / result.count);
+			}
+		}
+		else
+		{
+			valid = store.query(index, begin, end, [&](const uint64_t* timestamps, const int32_t* values, size_t count)
+			{
+				for (size_t i = 0; i < count; i++)
+					printf("%.6f %s %d\n", (timestamps[i] - first) / 1e6, name, values[i]);
+			});
+		}
+
+		if (!valid)
+		{
+			std::cerr << "Error: " << path << " is corrupted" << std::endl;
+			return 1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "device_discovery.h"
+
+#include <cstdio>
+#include <cstring>
+
+// Parameter types, the high bit hides the parameter
+#define PARAMETER_UINT8          0
+#define PARAMETER_INT8           1
+#define PARAMETER_UINT16         2
+#define PARAMETER_INT16          3
+#define PARAMETER_FLOAT          8
+#define PARAMETER_TEXT_SELECTION 9
+#define PARAMETER_STRING         10
+#define PARAMETER_FOLDER         11
+#define PARAMETER_INFO           12
+#define PARAMETER_COMMAND        13
+#define PARAMETER_HIDDEN         0x80
+
+void DeviceDiscovery::start()
+{
+	waiting.clear();
+	sent.clear();
+	chunks.clear();
+	ping = channel.pingDevices(*this, DISCOVERY_TIMEOUT);
+}
+
+void DeviceDiscovery::sendReads()
+{
+	while (!waiting.empty())
+	{
+		const ParameterRead& read = waiting.front();
+		uint16_t request = channel.readParameter(read.device, read.field, read.chunk, *this, DISCOVERY_TIMEOUT);
+		if (!request)
+			return;
+
+		sent[request] = read;
+		waiting.pop_front();
+	}
+}
+
+void DeviceDiscovery::processCrossfireResponse(uint16_t request, const CrossfireFrameView& frame)
+{
+	if (request == ping)
+	{
+		CrossfireDeviceInfo info;
+		if (!parseCrossfireDeviceInfo(frame, info))
+			return;
+
+		fprintf(stderr, "Device 0x%02X: %s, serial %08X, hardware %08X, software %08X, %u parameters\n",
+			info.address, info.name, info.serialNumber, info.hardwareVersion, info.softwareVersion, info.parameterCount);
+
+		// Parameters are numbered from 1, 0 is the root folder
+		for (uint8_t field = 1; field <= info.parameterCount && field != 0; field++)
+			waiting.push_back({ info.address, field, 0 });
+		sendReads();
+		return;
+	}
+
+	auto found = sent.find(request);
+	if (found == sent.end())
+		return;
+
+	// Destination, origin, field, chunks remaining, then a piece of the entry
+	ParameterRead read = found->second;
+	const uint8_t* payload = frame.getPayload();
+	uint8_t length = frame.getPayloadLength();
+	if (length < EXTENDED_HEADER_SIZE + 2)
+		return;
+
+	std::vector<uint8_t>& data = chunks[read.device << 8 | read.field];
+	data.insert(data.end(), payload + 4, payload + length);
+
+	if (payload[3] > 0)
+	{
+		// Next chunk goes first, the entry is not complete before
+		waiting.push_front({ read.device, read.field, (uint8_t)(read.chunk + 1) });
+		return;
+	}
+
+	printParameter(read.device, read.field, data);
+	chunks.erase(read.device << 8 | read.field);
+}
+
+void DeviceDiscovery::endCrossfireRequest(uint16_t request, bool answered)
+{
+	if (request == ping)
+	{
+		if (!answered)
+			fprintf(stderr, "No devices answered\n");
+		ping = 0;
+		return;
+	}
+
+	auto found = sent.find(request);
+	if (found == sent.end())
+		return;
+
+	if (!answered)
+	{
+		fprintf(stderr, "Device 0x%02X: parameter %u did not answer\n", found->second.device, found->second.field);
+		chunks.erase(found->second.device << 8 | found->second.field);
+	}
+	sent.erase(found);
+	sendReads();
+}
+
+static int32_t loadSigned(const uint8_t* data, uint8_t type)
+{
+	switch (type)
+	{
+	case PARAMETER_UINT8:  return data[0];
+	case PARAMETER_INT8:   return (int8_t)data[0];
+	case PARAMETER_UINT16: return (uint16_t)(data[0] << 8 | data[1]);
+	case PARAMETER_INT16:  return (int16_t)(data[0] << 8 | data[1]);
+	default:               return (int32_t)((uint32_t)data[0] << 24 | data[1] << 16 | data[2] << 8 | data[3]);
+	}
+}
+
+void DeviceDiscovery::printParameter(uint8_t device, uint8_t field, const std::vector<uint8_t>& data)
+{
+	// Parent folder, type, name, then the value depending on the type
+	const uint8_t* end = data.data() + data.size();
+	const uint8_t* name = data.data() + 2;
+	const uint8_t* value = data.size() > 2 ? (const uint8_t*)memchr(name, '\0', end - name) : nullptr;
+	if (!value)
+	{
+		fprintf(stderr, "Device 0x%02X: parameter %u is malformed\n", device, field);
+		return;
+	}
+	value++;
+
+	uint8_t type = data[1] & ~PARAMETER_HIDDEN;
+	fprintf(stderr, "Device 0x%02X: %3u %s%s", device, field, (const char*)name, data[1] & PARAMETER_HIDDEN ? " (hidden)" : "");
+
+	size_t left = end - value;
+	switch (type)
+	{
+	case PARAMETER_UINT8:
+	case PARAMETER_INT8:
+		if (left >= 1)
+			fprintf(stderr, " = %d", loadSigned(value, type));
+		break;
+	case PARAMETER_UINT16:
+	case PARAMETER_INT16:
+		if (left >= 2)
+			fprintf(stderr, " = %d", loadSigned(value, type));
+		break;
+	case PARAMETER_FLOAT:
+		// Value, min, max, default, decimal point, step and unit
+		if (left >= 17)
+		{
+			int32_t number = loadSigned(value, type);
+			uint32_t scale = 1;
+			for (uint8_t i = 0; i < value[16] && i < 9; i++)
+				scale *= 10;
+			fprintf(stderr, " = %.*f", value[16], (double)number / scale);
+		}
+		break;
+	case PARAMETER_TEXT_SELECTION:
+	{
+		// Options separated by ';', then the selected one
+		const uint8_t* options = (const uint8_t*)memchr(value, '\0', left);
+		if (options && options + 1 < end)
+		{
+			uint8_t selected = options[1];
+			const char* option = (const char*)value;
+			for (uint8_t i = 0; i < selected && option; i++)
+			{
+				option = strchr(option, ';');
+				if (option)
+					option++;
+			}
+			if (option)
+				fprintf(stderr, " = %.*s", (int)strcspn(option, ";"), option);
+		}
+		break;
+	}
+	case PARAMETER_STRING:
+	case PARAMETER_INFO:
+		if (memchr(value, '\0', left))
+			fprintf(stderr, " = %s", (const char*)value);
+		break;
+	case PARAMETER_FOLDER:
+		fprintf(stderr, " (folder)");
+		break;
+	case PARAMETER_COMMAND:
+		fprintf(stderr, " (command)");
+		break;
+	}
+	fprintf(stderr, "\n");
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <vector>
+
+#include "crossfire_commands.h"
+
+#define DISCOVERY_TIMEOUT 500000 // us a device has to answer
+
+// Finds the devices behind the port and reads all their parameters.
+// Reads of one device are queued together, so they go out in one write
+// and are answered in one round trip, as far as the request table allows.
+class DeviceDiscovery : public CrossfireRequestHandler
+{
+public:
+	explicit DeviceDiscovery(CrossfireCommandChannel& channel) : channel(channel) {}
+
+	// Pings all devices, called when the port is opened
+	void start();
+
+	void processCrossfireResponse(uint16_t request, const CrossfireFrameView& frame) override;
+	void endCrossfireRequest(uint16_t request, bool answered) override;
+
+private:
+	struct ParameterRead
+	{
+		uint8_t device;
+		uint8_t field;
+		uint8_t chunk;
+	};
+
+	CrossfireCommandChannel& channel;
+	uint16_t ping = 0;
+	std::deque<ParameterRead> waiting;      // Not sent yet, the request table is full
+	std::map<uint16_t, ParameterRead> sent;
+	std::map<uint16_t, std::vector<uint8_t>> chunks; // Parameter data by device << 8 | field
+
+	void sendReads();
+	void printParameter(uint8_t device, uint8_t field, const std::vector<uint8_t>& data);
+};
@@ -0,0 +1,622 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <getopt.h>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "crossfire.h"
+#include "parallel_replay.h"
+#include "serial.h"
+#include "shared_memory.h"
+#include "source_worker.h"
+#include "telemetry_bus.h"
+#include "crossfire_registry.h"
+#include "telemetry_filter.h"
+#include "telemetry_sink.h"
+#include "telemetry_source.h"
+#include "telemetry_statistics.h"
+#include "tracker_output.h"
+
+struct Options
+{
+	std::vector<const char*> devices;
+	std::vector<const char*> replayPaths;
+	const char* capturePath = nullptr;
+	const char* busName = nullptr;
+	const char* storePath = nullptr;
+	const char* outputPath = nullptr;
+	const char* format = "text";
+	uint32_t flushInterval = 100; // ms
+	uint32_t threads = 0;         // 0 uses one per core
+	uint32_t baudRate = DEFAULT_BAUD_RATE; // 0 detects the rate
+	uint32_t batchLatency = 0;    // ms, 0 reads every byte as it arrives
+	uint32_t batchBytes = 64;
+	const char* tracker = nullptr;   // home position LAT,LON,ALT
+	const char* trackerServos = nullptr;
+	const char* trackerOutputPath = nullptr;
+	uint32_t trackerRate = 50;    // Hz
+	uint32_t trackerLead = 200;   // ms
+	int32_t metricsInterval = -1; // s, 0 prints only at exit, -1 disables metrics
+	int32_t statisticsInterval = -1; // s, same as metrics
+	bool realtime = false;
+	bool parallel = false;
+	const char* units = nullptr;     // metric or imperial
+	const char* deadbands = nullptr; // NAME=VALUE,...
+	bool changes = false;
+	uint32_t keepalive = 0;       // ms
+	bool deviceInfo = false;
+	bool quiet = false;
+};
+
+static TelemetrySink* createSink(const char* format, FILE* file, uint32_t flushInterval)
+{
+	if (strcmp(format, "text") == 0)
+		return new TextTelemetrySink(file, flushInterval);
+	if (strcmp(format, "json") == 0)
+		return new JsonTelemetrySink(file, flushInterval);
+	if (strcmp(format, "csv") == 0)
+		return new CsvTelemetrySink(file, flushInterval);
+	if (strcmp(format, "binary") == 0)
+		return new BinaryTelemetrySink(file, flushInterval);
+	return nullptr;
+}
+
+static TelemetrySink* createSink(const char* format, FILE* file, uint32_t flushInterval, const TelemetryUnits* units)
+{
+	TelemetrySink* sink = createSink(format, file, flushInterval);
+	if (sink)
+		sink->setUnits(units);
+	return sink;
+}
+
+// Degrees with decimals to the decoded GPS units
+static bool parseTrackerHome(const char* text, TrackerHome& home)
+{
+	double latitude, longitude, altitude = 0;
+	if (sscanf(text, "%lf,%lf,%lf", &latitude, &longitude, &altitude) < 2)
+		return false;
+
+	home.latitude = (int32_t)lround(latitude * 1e6);
+	home.longitude = (int32_t)lround(longitude * 1e6);
+	home.altitude = (int32_t)lround(altitude);
+	return true;
+}
+
+static bool parseTrackerServos(const char* text, TrackerServos& servos)
+{
+	return sscanf(text, "%f,%f,%f", &servos.panCenter, &servos.panRange, &servos.tiltRange) == 3 &&
+		servos.panRange > 0 && servos.tiltRange > 0;
+}
+
+static const char* getBaseName(const char* path)
+{
+	const char* slash = strrchr(path, '/');
+	return slash ? slash + 1 : path;
+}
+
+// Captures one after another, each split over all threads
+static int replayParallel(const Options& options, const TelemetryUnits* units, FILE* output)
+{
+	uint32_t threads = options.threads ? options.threads : std::max(std::thread::hardware_concurrency(), 1u);
+	size_t sourceCount = options.replayPaths.size();
+
+	for (size_t i = 0; i < sourceCount; i++)
+	{
+		const char* path = options.replayPaths[i];
+		std::function<TelemetrySink*(FILE*)> sinkFactory;
+		if (!options.quiet)
+		{
+			sinkFactory = [&](FILE* file)
+			{
+				TelemetrySink* sink = createSink(options.format, file, PARALLEL_FLUSH_INTERVAL, units);
+				if (sourceCount > 1)
+					sink->setSource(getBaseName(path), (uint8_t)i);
+				return sink;
+			};
+		}
+
+		uint64_t start = getTime(CLOCK_MONOTONIC);
+		ParallelReplay replay(path, threads, sinkFactory, output);
+		if (!replay.run())
+			return 1;
+
+		const CrossfireStreamStats& stats = replay.getStats();
+		double seconds = (getTime(CLOCK_MONOTONIC) - start) / 1e6;
+		std::cerr << "Replayed " << path << ", " << stats.bytes << " bytes in " << seconds << " s ("
+			<< (seconds > 0 ? stats.bytes / seconds / 1e6 : 0) << " MB/s)" << std::endl;
+
+		if (sourceCount > 1)
+			std::cerr << path << ": ";
+		std::cerr << "Frames: " << stats.frames << ", CRC errors: " << stats.crcErrors
+			<< ", resyncs: " << stats.resyncs << ", bytes skipped: " << stats.bytesSkipped << std::endl;
+	}
+
+	return 0;
+}
+
+static void usage(const char* name)
+{
+	std::cerr << "Usage: " << name << " [options] [device...]\n"
+		"  -B, --baud RATE|auto       serial baud rate, any rate the UART supports (115200),\n"
+		"                             auto picks the rate with most valid frames\n"
+		"  -w, --batch-latency MS     read the port at most MS after the last read instead of\n"
+		"                             on every byte, fewer wakeups for the price of latency\n"
+		"  -W, --batch-bytes N        with --batch-latency, read early once N bytes (1-255)\n"
+		"                             are waiting, 0 reads only on the timer (64)\n"
+		"  -c, --capture FILE         record the raw stream read from the device,\n"
+		"                             FILE.1, FILE.2... for further devices\n"
+		"  -r, --replay FILE          decode a capture instead of reading a device,\n"
+		"                             can be given more than once\n"
+		"  -t, --realtime             replay with the original timing\n"
+		"  -p, --parallel             decode replays on all threads, one capture after another,\n"
+		"                             with the same output as a sequential replay\n"
+		"  -f, --format FORMAT        telemetry output: text, json, csv or binary\n"
+		"  -o, --output FILE          write telemetry to FILE instead of stdout\n"
+		"  -F, --flush-interval MS    longest time output is buffered, 0 flushes every frame\n"
+		"  -j, --threads N            event loop threads, default one per core\n"
+		"  -T, --tracker LAT,LON,ALT  point an antenna tracker at the first source\n"
+		"  -S, --tracker-servos CENTER,PAN,TILT\n"
+		"                             pan center and range, tilt range in degree (0,360,90)\n"
+		"  -R, --tracker-rate HZ      servo update rate (50)\n"
+		"  -L, --tracker-lead MS      time predicted ahead of the telemetry (200)\n"
+		"  -O, --tracker-output FILE  write servo targets to FILE instead of stdout\n"
+		"  -m, --metrics SECONDS      measure decode latency, print every SECONDS and at exit\n"
+		"  -s, --statistics SECONDS   link health statistics over 1 s, 10 s and 60 s,\n"
+		"                             print every SECONDS and at exit\n"
+		"  -d, --store FILE           write decoded samples to a compressed columnar store,\n"
+		"                             FILE.1, FILE.2... for further sources\n"
+		"  -b, --bus NAME             publish telemetry to the shared memory object NAME,\n"
+		"                             NAME.1, NAME.2... for further sources\n"
+		"  -i, --device-info          list the devices behind each port and their parameters\n"
+		"  -u, --units SYSTEM         output calibrated values in metric or imperial units\n"
+		"                             instead of raw sensor values\n"
+		"  -C, --changes              output only values which changed\n"
+		"  -D, --deadband NAME=VALUE,...\n"
+		"                             output only changes larger than VALUE of sensor NAME,\n"
+		"                             in the units of the sensor, e.g. RxBt=0.2,Sats=1\n"
+		"  -K, --keepalive MS         with --changes or --deadband, output unchanged values\n"
+		"                             again after MS\n"
+		"  -X, --custom-frame ID,NAME,SENSOR:OFFSET:WIDTH[:DECIMALS],...\n"
+		"                             decode a frame id the reader does not know, fields are\n"
+		"                             big endian at OFFSET bytes into the payload, repeatable\n"
+		"  -q, --quiet                do not output telemetry, only statistics\n"
+		"  -h, --help                 show this help\n";
+}
+
+int main(int argc, char* argv[])
+{
+	static const option longOptions[] = {
+		{ "baud",     required_argument, nullptr, 'B' },
+		{ "batch-latency", required_argument, nullptr, 'w' },
+		{ "batch-bytes", required_argument, nullptr, 'W' },
+		{ "capture",  required_argument, nullptr, 'c' },
+		{ "replay",   required_argument, nullptr, 'r' },
+		{ "realtime", no_argument,       nullptr, 't' },
+		{ "parallel", no_argument,       nullptr, 'p' },
+		{ "format",   required_argument, nullptr, 'f' },
+		{ "output",   required_argument, nullptr, 'o' },
+		{ "flush-interval", required_argument, nullptr, 'F' },
+		{ "threads",  required_argument, nullptr, 'j' },
+		{ "tracker",  required_argument, nullptr, 'T' },
+		{ "tracker-servos", required_argument, nullptr, 'S' },
+		{ "tracker-rate", required_argument, nullptr, 'R' },
+		{ "tracker-lead", required_argument, nullptr, 'L' },
+		{ "tracker-output", required_argument, nullptr, 'O' },
+		{ "metrics",  required_argument, nullptr, 'm' },
+		{ "statistics", required_argument, nullptr, 's' },
+		{ "store",    required_argument, nullptr, 'd' },
+		{ "bus",      required_argument, nullptr, 'b' },
+		{ "device-info", no_argument,    nullptr, 'i' },
+		{ "units",    required_argument, nullptr, 'u' },
+		{ "changes",  no_argument,       nullptr, 'C' },
+		{ "deadband", required_argument, nullptr, 'D' },
+		{ "keepalive", required_argument, nullptr, 'K' },
+		{ "custom-frame", required_argument, nullptr, 'X' },
+		{ "quiet",    no_argument,       nullptr, 'q' },
+		{ "help",     no_argument,       nullptr, 'h' },
+		{ nullptr,    0,                 nullptr, 0 },
+	};
+
+	Options options;
+	int option;
+	while ((option = getopt_long(argc, argv, "B:w:W:c:r:tpf:o:F:j:T:S:R:L:O:m:s:d:b:iu:CD:K:X:qh", longOptions, nullptr)) != -1)
+	{
+		switch (option)
+		{
+		case 'B':
+			options.baudRate = strcmp(optarg, "auto") == 0 ? 0 : (uint32_t)strtoul(optarg, nullptr, 10);
+			if (options.baudRate == 0 && strcmp(optarg, "auto") != 0)
+			{
+				std::cerr << "Error: Invalid baud rate " << optarg << std::endl;
+				return 1;
+			}
+			break;
+		case 'w': options.batchLatency = (uint32_t)strtoul(optarg, nullptr, 10); break;
+		case 'W': options.batchBytes = (uint32_t)strtoul(optarg, nullptr, 10); break;
+		case 'c': options.capturePath = optarg; break;
+		case 'r': options.replayPaths.push_back(optarg); break;
+		case 't': options.realtime = true; break;
+		case 'p': options.parallel = true; break;
+		case 'f': options.format = optarg; break;
+		case 'o': options.outputPath = optarg; break;
+		case 'F': options.flushInterval = (uint32_t)strtoul(optarg, nullptr, 10); break;
+		case 'j': options.threads = (uint32_t)strtoul(optarg, nullptr, 10); break;
+		case 'T': options.tracker = optarg; break;
+		case 'S': options.trackerServos = optarg; break;
+		case 'R': options.trackerRate = (uint32_t)strtoul(optarg, nullptr, 10); break;
+		case 'L': options.trackerLead = (uint32_t)strtoul(optarg, nullptr, 10); break;
+		case 'O': options.trackerOutputPath = optarg; break;
+		case 'm': options.metricsInterval = (int32_t)strtol(optarg, nullptr, 10); break;
+		case 's': options.statisticsInterval = (int32_t)strtol(optarg, nullptr, 10); break;
+		case 'd': options.storePath = optarg; break;
+		case 'b': options.busName = optarg; break;
+		case 'i': options.deviceInfo = true; break;
+		case 'u': options.units = optarg; break;
+		case 'C': options.changes = true; break;
+		case 'D': options.deadbands = optarg; break;
+		case 'K': options.keepalive = (uint32_t)strtoul(optarg, nullptr, 10); break;
+		case 'X':
+			// Registered before any sink or decoder exists
+			if (!parseCrossfireCustomFrame(optarg, crossfireRegistry))
+			{
+				std::cerr << "Error: Invalid custom frame " << optarg << std::endl;
+				return 1;
+			}
+			break;
+		case 'q': options.quiet = true; break;
+		case 'h': usage(argv[0]); return 0;
+		default:  usage(argv[0]); return 1;
+		}
+	}
+
+	for (int i = optind; i < argc; i++)
+		options.devices.push_back(argv[i]);
+
+	bool filter = options.changes || options.deadbands;
+	if (options.parallel && (!options.devices.empty() || options.replayPaths.empty() || options.realtime || filter ||
+		options.tracker || options.metricsInterval >= 0 || options.statisticsInterval >= 0 || options.busName || options.storePath))
+	{
+		std::cerr << "Error: --parallel only decodes replays, without realtime, changes, deadband, tracker, metrics, statistics, bus or store" << std::endl;
+		return 1;
+	}
+
+	// Shared by all sinks, the scale of every sensor is computed once
+	std::unique_ptr<TelemetryUnits> units;
+	if (options.units)
+	{
+		if (strcmp(options.units, "metric") != 0 && strcmp(options.units, "imperial") != 0)
+		{
+			std::cerr << "Error: Unknown units " << options.units << std::endl;
+			return 1;
+		}
+		units.reset(new TelemetryUnits(strcmp(options.units, "imperial") == 0 ? UNITS_IMPERIAL : UNITS_METRIC));
+	}
+
+	if (options.batchBytes > 255)
+	{
+		std::cerr << "Error: --batch-bytes is at most 255" << std::endl;
+		return 1;
+	}
+
+	if (options.devices.empty() && options.replayPaths.empty())
+		options.devices.push_back("/dev/ttyACM0");
+
+	FILE* output = stdout;
+	if (options.outputPath && !(output = fopen(options.outputPath, "wb")))
+	{
+		std::cerr << "Error: Unable to create " << options.outputPath << ": " << strerror(errno) << std::endl;
+		return 1;
+	}
+
+	if (options.parallel)
+	{
+		std::unique_ptr<TelemetrySink> probe(createSink(options.format, output, options.flushInterval));
+		if (!probe)
+		{
+			std::cerr << "Error: Unknown output format " << options.format << std::endl;
+			return 1;
+		}
+		int result = replayParallel(options, units.get(), output);
+		if (output != stdout)
+			fclose(output);
+		return result;
+	}
+
+	TrackerHome home;
+	TrackerServos servos;
+	if (options.tracker && !parseTrackerHome(options.tracker, home))
+	{
+		std::cerr << "Error: Invalid tracker position " << options.tracker << std::endl;
+		return 1;
+	}
+	if (options.trackerServos && !parseTrackerServos(options.trackerServos, servos))
+	{
+		std::cerr << "Error: Invalid tracker servos " << options.trackerServos << std::endl;
+		return 1;
+	}
+
+	FILE* trackerOutput = stdout;
+	if (options.trackerOutputPath && !(trackerOutput = fopen(options.trackerOutputPath, "w")))
+	{
+		std::cerr << "Error: Unable to create " << options.trackerOutputPath << ": " << strerror(errno) << std::endl;
+		return 1;
+	}
+
+	// Every source has its own sink, they only share the output file.
+	// Sinks write whole frames, so lines of different sources do not mix.
+	size_t sourceCount = options.devices.size() + options.replayPaths.size();
+	std::vector<std::unique_ptr<TelemetrySink>> sinks;
+	std::vector<std::string> captureNames;
+	std::vector<std::unique_ptr<TelemetrySource>> sources;
+
+	for (size_t i = 0; i < sourceCount; i++)
+	{
+		bool replay = i >= options.devices.size();
+		const char* path = replay ? options.replayPaths[i - options.devices.size()] : options.devices[i];
+
+		TelemetrySink* sink = nullptr;
+		if (!options.quiet)
+		{
+			sink = createSink(options.format, output, options.flushInterval, units.get());
+			if (!sink)
+			{
+				std::cerr << "Error: Unknown output format " << options.format << std::endl;
+				return 1;
+			}
+
+			// Single source output keeps the original layout
+			if (sourceCount > 1)
+				sink->setSource(getBaseName(path), (uint8_t)i);
+			sinks.emplace_back(sink);
+		}
+
+		if (replay)
+		{
+			sources.emplace_back(new CaptureSource(path, sink, options.realtime));
+			continue;
+		}
+
+		const char* capturePath = options.capturePath;
+		if (capturePath && i > 0)
+		{
+			captureNames.push_back(std::string(capturePath) + "." + std::to_string(i));
+			capturePath = captureNames.back().c_str();
+		}
+		SerialSource* source = new SerialSource(path, sink, capturePath, options.baudRate);
+		if (options.deviceInfo)
+			source->enableDeviceDiscovery();
+		if (options.batchLatency)
+			source->setReadBatch((uint8_t)options.batchBytes, options.batchLatency * 1000);
+		sources.emplace_back(source);
+	}
+
+	if (options.metricsInterval >= 0)
+	{
+		for (auto& source : sources)
+			source->enableMetrics();
+	}
+
+	// Only the output is filtered, bus, store, statistics and tracker see every value
+	std::vector<std::unique_ptr<TelemetryFilter>> filters;
+	if (filter && !options.quiet)
+	{
+		for (size_t i = 0; i < sourceCount; i++)
+		{
+			filters.emplace_back(new TelemetryFilter(*sinks[i]));
+			if (options.changes)
+				filters.back()->setDeadbandAll(0);
+			if (options.deadbands && !parseTelemetryDeadbands(options.deadbands, *filters.back()))
+			{
+				std::cerr << "Error: Invalid deadband " << options.deadbands << std::endl;
+				return 1;
+			}
+			filters.back()->setKeepalive(options.keepalive * 1000);
+			sources[i]->setSinkFilter(*filters.back());
+		}
+	}
+
+	// Allocated once here, nothing is allocated per sample
+	std::vector<std::unique_ptr<TelemetryStatistics>> statistics;
+	if (options.statisticsInterval >= 0)
+	{
+		static const uint32_t windows[] = { 1000, 10000, 60000 };
+		static const uint8_t linkHealth[] = {
+			RX_RSSI1_INDEX, RX_QUALITY_INDEX, RX_SNR_INDEX, TX_QUALITY_INDEX, TX_SNR_INDEX, TX_FPS_INDEX, BATT_VOLTAGE_INDEX,
+		};
+
+		for (auto& source : sources)
+		{
+			statistics.emplace_back(new TelemetryStatistics(windows, DIM(windows)));
+			for (uint8_t index : linkHealth)
+				statistics.back()->track(index);
+			source->addHandler(*statistics.back());
+		}
+	}
+
+	std::vector<std::unique_ptr<TelemetryStoreWriter>> stores;
+	if (options.storePath)
+	{
+		for (size_t i = 0; i < sourceCount; i++)
+		{
+			std::string path = i ? std::string(options.storePath) + "." + std::to_string(i) : options.storePath;
+			stores.emplace_back(new TelemetryStoreWriter());
+			if (!stores.back()->open(path.c_str()))
+			{
+				std::cerr << "Error: Unable to create " << path << ": " << strerror(errno) << std::endl;
+				return 1;
+			}
+			sources[i]->setStore(*stores.back());
+		}
+	}
+
+	// Consumer processes map the bus, the producer never waits for them
+	std::vector<std::string> busNames;
+	std::vector<std::unique_ptr<SharedMemory>> busMemory;
+	std::vector<std::unique_ptr<TelemetryBusWriter>> busWriters;
+	if (options.busName)
+	{
+		for (size_t i = 0; i < sourceCount; i++)
+		{
+			busNames.push_back(i ? std::string(options.busName) + "." + std::to_string(i) : options.busName);
+			busMemory.emplace_back(new SharedMemory());
+			if (!busMemory.back()->create(busNames.back().c_str(), getTelemetryBusSize(TELEMETRY_BUS_CAPACITY)))
+			{
+				std::cerr << "Error: Unable to create shared memory " << busNames.back() << ": " << strerror(errno) << std::endl;
+				return 1;
+			}
+
+			busWriters.emplace_back(new TelemetryBusWriter(busMemory.back()->data(), TELEMETRY_BUS_CAPACITY, (uint8_t)i));
+			sources[i]->addHandler(*busWriters.back());
+		}
+	}
+
+	// Sources are dealt out to the workers round robin
+	uint32_t threads = options.threads ? options.threads : std::max(std::thread::hardware_concurrency(), 1u);
+	size_t workerCount = std::min<size_t>(threads, sourceCount);
+	if (sourceCount > workerCount * MAX_WORKER_SOURCES)
+	{
+		std::cerr << "Error: Too many sources for " << workerCount << " threads" << std::endl;
+		return 1;
+	}
+
+	std::vector<std::unique_ptr<SourceWorker>> workers;
+	for (size_t i = 0; i < workerCount; i++)
+		workers.emplace_back(new SourceWorker(options.quiet ? 0 : options.flushInterval));
+	for (size_t i = 0; i < sourceCount; i++)
+		workers[i % workerCount]->add(*sources[i]);
+
+	// Signals are taken by this thread only, the workers are stopped explicitly
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+	int result = 0;
+	for (auto& worker : workers)
+	{
+		if (!worker->start())
+		{
+			result = 1;
+			break;
+		}
+	}
+
+	// Reads the latest values, so it never holds up the reader
+	std::unique_ptr<TrackerOutput> tracker;
+	if (result == 0 && options.tracker)
+	{
+		tracker.reset(new TrackerOutput(sources[0]->getSnapshot(), home, servos, trackerOutput));
+		tracker->getTracker().setLead(options.trackerLead * 1000);
+		if (!tracker->start(options.trackerRate))
+			result = 1;
+	}
+
+	if (result == 0)
+	{
+		timespec pollInterval = { 0, 100000000 };
+		uint64_t nextMetrics = getTime(CLOCK_MONOTONIC) + options.metricsInterval * 1000000ull;
+		uint64_t nextStatistics = getTime(CLOCK_MONOTONIC) + options.statisticsInterval * 1000000ull;
+		for (;;)
+		{
+			if (std::all_of(workers.begin(), workers.end(), [](const std::unique_ptr<SourceWorker>& worker) { return worker->isDone(); }))
+				break;
+
+			if (sigtimedwait(&signals, nullptr, &pollInterval) > 0)
+				break;
+
+			// Histograms are read while the workers keep writing them
+			if (options.metricsInterval > 0 && getTime(CLOCK_MONOTONIC) >= nextMetrics)
+			{
+				for (auto& source : sources)
+					source->getMetrics()->print(stderr, source->getPath());
+				nextMetrics += options.metricsInterval * 1000000ull;
+			}
+
+			if (options.statisticsInterval > 0 && getTime(CLOCK_MONOTONIC) >= nextStatistics)
+			{
+				for (size_t i = 0; i < statistics.size(); i++)
+					statistics[i]->print(stderr, sources[i]->getPath());
+				nextStatistics += options.statisticsInterval * 1000000ull;
+			}
+		}
+	}
+
+	tracker.reset();
+	if (trackerOutput != stdout)
+		fclose(trackerOutput);
+
+	for (auto& worker : workers)
+		worker->stop();
+	workers.clear();
+
+	sinks.clear();
+	for (auto& store : stores)
+	{
+		if (!store->close())
+			std::cerr << "Error: Unable to write store: " << strerror(store->getError() ? store->getError() : errno) << std::endl;
+	}
+	for (const std::string& name : busNames)
+		SharedMemory::remove(name.c_str());
+	if (output != stdout)
+		fclose(output);
+
+	for (size_t i = 0; i < statistics.size(); i++)
+		statistics[i]->print(stderr, sources[i]->getPath());
+
+	for (size_t i = 0; i < filters.size(); i++)
+	{
+		if (sourceCount > 1)
+			std::cerr << sources[i]->getPath() << ": ";
+		std::cerr << "Values: " << filters[i]->getValuesIn() << ", output: " << filters[i]->getValuesOut() << std::endl;
+	}
+
+	for (auto& source : sources)
+	{
+		if (source->getMetrics())
+			source->getMetrics()->print(stderr, source->getPath());
+
+		const CrossfireStreamStats& stats = source->getStats();
+		if (sourceCount > 1)
+			std::cerr << source->getPath() << ": ";
+		std::cerr << "Frames: " << stats.frames << ", CRC errors: " << stats.crcErrors
+			<< ", resyncs: " << stats.resyncs << ", bytes skipped: " << stats.bytesSkipped << std::endl;
+
+		// Candidates for --custom-frame
+		if (stats.unknownIds)
+		{
+			std::cerr << "Unknown frame ids:";
+			for (size_t id = 0; id < 256; id++)
+			{
+				uint32_t count = source->getUnknownFrames((uint8_t)id);
+				if (count)
+					fprintf(stderr, " 0x%02X x%u", (unsigned)id, count);
+			}
+			std::cerr << std::endl;
+		}
+	}
+	return result;
+}
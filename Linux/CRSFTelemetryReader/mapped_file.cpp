@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "mapped_file.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool MappedFile::open(const char* path)
+{
+	close();
+
+	int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0)
+	{
+		int error = errno;
+		::close(fd);
+		errno = error;
+		return false;
+	}
+
+	if (info.st_size == 0)
+	{
+		::close(fd);
+		return true; // Nothing to map, an empty file is still valid
+	}
+
+	void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	int error = errno;
+	::close(fd); // The mapping keeps the file referenced
+
+	if (mapping == MAP_FAILED)
+	{
+		errno = error;
+		return false;
+	}
+
+	// Captures are decoded front to back, let the kernel read ahead aggressively
+	madvise(mapping, info.st_size, MADV_SEQUENTIAL);
+	madvise(mapping, info.st_size, MADV_WILLNEED);
+
+	address = (const uint8_t*)mapping;
+	length = info.st_size;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (address)
+		munmap((void*)address, length);
+
+	address = nullptr;
+	length = 0;
+}
@@ -0,0 +1,293 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "parallel_replay.h"
+#include "capture.h"
+#include "crossfire_parallel.h"
+#include "crossfire_sync.h"
+#include "mapped_file.h"
+#include "telemetry_dispatcher.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Output of one chunk, written out once the chunks before it are
+struct ChunkOutput
+{
+	char* data = nullptr;
+	size_t size = 0;
+	CrossfireStreamStats stats;
+
+	~ChunkOutput() { free(data); }
+};
+
+// End of a capture record in the joined stream and its time
+struct RecordEnd
+{
+	size_t end;
+	uint64_t timestamp;
+};
+
+// Bytes the sequential stream needs before it delivers a frame. It waits
+// at every sync byte until the frame announced there is complete, even if
+// its CRC fails then, so a frame behind such a candidate is delivered with
+// the record which completed the candidate rather than the frame.
+struct StreamWatermark
+{
+	size_t position = 0;	// Offset the walk has checked up to
+	size_t needed = 0;		// Bytes needed by the walk so far
+
+	void walk(const uint8_t* data, size_t size, size_t end)
+	{
+		for (; position < end && position + 1 < size; position++)
+		{
+			if (!isCrossfireSync(data[position]))
+				continue;
+
+			uint8_t len = data[position + 1];
+			size_t candidate = position + 2;
+			if (len >= MIN_FRAME_LEN && len <= MAX_FRAME_LEN)
+				candidate += len;
+			needed = std::max(needed, candidate);
+		}
+	}
+
+	size_t deliver(const uint8_t* data, size_t size, size_t offset, size_t frameSize)
+	{
+		walk(data, size, offset);
+		position = offset + frameSize;
+		needed = std::max(needed, position);
+		return needed;
+	}
+
+	// The watermark after the frames of a scan, from one which is at least
+	// a candidate ahead of the last so nothing earlier can reach past it
+	void skipScan(const uint8_t* data, size_t size, const CrossfireChunkScan& scan)
+	{
+		if (scan.frames.empty())
+			return;
+
+		size_t first = scan.frames.size() - 1;
+		while (first > 0 && scan.frames.back() - scan.frames[first] < MAX_FRAME_SIZE)
+			first--;
+		if (first > 0 && scan.frames[first] > position)
+		{
+			position = scan.frames[first];
+			needed = 0;
+		}
+		for (size_t i = first; i < scan.frames.size(); i++)
+			deliver(data, size, scan.frames[i], data[scan.frames[i] + 1] + 2);
+	}
+
+	void consume(size_t length)
+	{
+		position = position > length ? position - length : 0;
+		needed = needed > length ? needed - length : 0;
+	}
+};
+
+// Stamps each frame with the time of the record the sequential replay
+// delivers it with, as that one pushes the records one by one
+class RecordTimeHandler : public CrossfireTelemetryHandler
+{
+public:
+	RecordTimeHandler(const std::vector<uint8_t>& data, const std::vector<RecordEnd>& records,
+		const StreamWatermark& watermark, TelemetrySink& sink) :
+		data(data),
+		records(records),
+		watermark(watermark),
+		sink(sink)
+	{
+	}
+
+	void processCrossfireFrame(const CrossfireFrameView& frame) override
+	{
+		size_t needed = watermark.deliver(data.data(), data.size(), frame.getData() - data.data(), frame.getSize());
+		auto record = std::upper_bound(records.begin(), records.end(), needed - 1,
+			[](size_t offset, const RecordEnd& record) { return offset < record.end; });
+		if (record != records.end())
+			sink.setTime(record->timestamp);
+	}
+
+	void processCrossfireTelemetryValue(uint8_t /*index*/, int32_t /*value*/) override {}
+
+private:
+	const std::vector<uint8_t>& data;
+	const std::vector<RecordEnd>& records;
+	StreamWatermark watermark;
+	TelemetrySink& sink;
+};
+
+template <typename Body>
+static void runParallel(size_t count, Body body)
+{
+	std::vector<std::thread> workers;
+	for (size_t i = 1; i < count; i++)
+		workers.emplace_back(body, i);
+	body(0);
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+ParallelReplay::ParallelReplay(const char* path, uint32_t threads, std::function<TelemetrySink*(FILE*)> createSink, FILE* output) :
+	path(path),
+	threads(threads),
+	createSink(createSink),
+	output(output)
+{
+}
+
+bool ParallelReplay::run()
+{
+	MappedFile file;
+	if (!file.open(path))
+	{
+		std::cerr << "Error: Unable to open " << path << ": " << strerror(errno) << std::endl;
+		return false;
+	}
+
+	CaptureReader reader(file.data(), file.size());
+	if (!reader.isValid())
+	{
+		std::cerr << "Error: " << path << " is not a capture file" << std::endl;
+		return false;
+	}
+
+	// Records are joined into one contiguous stream, the bytes the last
+	// round did not get to are carried over to the next
+	std::vector<uint8_t> data;
+	std::vector<RecordEnd> records;
+	std::vector<CrossfireChunkScan> scans(threads);
+	std::vector<ChunkOutput> outputs(threads);
+	std::vector<StreamWatermark> watermarks(threads);
+	bool synchronized = true;
+	bool first = true;
+	bool final = false;
+	CaptureRecord record;
+
+	while (!final)
+	{
+		size_t roundSize = (size_t)threads * PARALLEL_CHUNK_SIZE + MAX_FRAME_SIZE;
+		while (data.size() < roundSize && !final)
+		{
+			if (reader.next(record))
+			{
+				data.insert(data.end(), record.data, record.data + record.length);
+				records.push_back({ data.size(), record.timestamp });
+				stats.bytes += record.length;
+			}
+			else
+				final = true;
+		}
+
+		if (final && !reader.isValid())
+			std::cerr << "Warning: " << path << " is truncated" << std::endl;
+
+		// Frames starting before the end of the last chunk are complete,
+		// unless the capture ends there
+		size_t scanEnd = final ? data.size() : data.size() - (MAX_FRAME_SIZE - 1);
+		size_t chunks = std::max<size_t>(1, std::min<size_t>(threads, scanEnd / (PARALLEL_CHUNK_SIZE / 4)));
+		for (size_t i = 0; i < chunks; i++)
+		{
+			scans[i].begin = scanEnd * i / chunks;
+			scans[i].end = scanEnd * (i + 1) / chunks;
+		}
+
+		runParallel(chunks, [&](size_t i)
+		{
+			scanCrossfireChunk(data.data(), data.size(), final, i == 0 ? synchronized : true, scans[i]);
+		});
+
+		reconcileCrossfireScans(data.data(), data.size(), final, scans.data(), chunks);
+		for (size_t i = 1; i < chunks; i++)
+		{
+			watermarks[i] = watermarks[i - 1];
+			watermarks[i].skipScan(data.data(), data.size(), scans[i - 1]);
+		}
+
+		runParallel(chunks, [&](size_t i)
+		{
+			ChunkOutput& chunk = outputs[i];
+			chunk.stats = CrossfireStreamStats();
+
+			FILE* memory = nullptr;
+			std::unique_ptr<TelemetrySink> sink;
+			std::unique_ptr<RecordTimeHandler> recordTime;
+			TelemetryDispatcher dispatcher;
+			if (createSink && (memory = open_memstream(&chunk.data, &chunk.size)))
+			{
+				sink.reset(createSink(memory));
+				if (!first || i > 0)
+					sink->continueOutput();
+				recordTime.reset(new RecordTimeHandler(data, records, watermarks[i], *sink));
+				dispatcher.add(*recordTime);
+				dispatcher.add(*sink);
+			}
+
+			decodeCrossfireFrames(data.data(), scans[i], dispatcher, chunk.stats);
+
+			// The sink writes what it still buffers when it is destroyed
+			sink.reset();
+			if (memory)
+				fclose(memory);
+		});
+
+		for (size_t i = 0; i < chunks; i++)
+		{
+			ChunkOutput& chunk = outputs[i];
+			if (chunk.size > 0)
+				fwrite(chunk.data, 1, chunk.size, output);
+			free(chunk.data);
+			chunk.data = nullptr;
+			chunk.size = 0;
+
+			stats.frames += scans[i].stats.frames;
+			stats.crcErrors += scans[i].stats.crcErrors;
+			stats.resyncs += scans[i].stats.resyncs;
+			stats.bytesSkipped += scans[i].stats.bytesSkipped;
+			stats.unknownIds += chunk.stats.unknownIds;
+		}
+
+		const CrossfireChunkScan& last = scans[chunks - 1];
+		size_t consumed = std::min(last.exit, data.size());
+
+		// The next round starts where the walk of the last chunk stopped
+		StreamWatermark& watermark = watermarks[0];
+		watermark = watermarks[chunks - 1];
+		watermark.skipScan(data.data(), data.size(), last);
+		watermark.walk(data.data(), data.size(), consumed);
+		watermark.consume(consumed);
+		data.erase(data.begin(), data.begin() + consumed);
+
+		// Records which ended in the consumed bytes are done
+		size_t done = 0;
+		while (done < records.size() && records[done].end <= consumed)
+			done++;
+		records.erase(records.begin(), records.begin() + done);
+		for (RecordEnd& record : records)
+			record.end -= consumed;
+		synchronized = last.synchronized;
+		first = false;
+	}
+
+	fflush(output);
+	return true;
+}
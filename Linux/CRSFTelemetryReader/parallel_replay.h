@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+
+#include "crossfire_stream.h"
+#include "telemetry_sink.h"
+
+#define PARALLEL_CHUNK_SIZE     (4 * 1024 * 1024) // Bytes of a capture one core decodes at a time
+#define PARALLEL_FLUSH_INTERVAL 3600000           // ms, sinks write to memory only when their buffer is full
+
+// Decodes a capture as fast as possible on several cores, e.g. to
+// re-process recorded flights. Output and counters are the same as those
+// of a sequential replay, frames come out in stream order. Each round
+// copies one chunk per thread out of the capture records, the chunks are
+// scanned, reconciled and decoded into memory in parallel and the output
+// is written in order, so memory stays bounded for captures of any size.
+class ParallelReplay
+{
+public:
+	// createSink makes a sink writing to the given file, nullptr for no output
+	ParallelReplay(const char* path, uint32_t threads, std::function<TelemetrySink*(FILE*)> createSink, FILE* output);
+
+	bool run();
+
+	const CrossfireStreamStats& getStats() const { return stats; }
+
+private:
+	const char* path;
+	uint32_t threads;
+	std::function<TelemetrySink*(FILE*)> createSink;
+	FILE* output;
+	CrossfireStreamStats stats;
+};
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "serial.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+// termios2 takes the rate as a number instead of a Bxxx constant, it can
+// not be mixed with the glibc termios.h
+#include <asm/termbits.h>
+
+const uint32_t AUTO_BAUD_RATES[] = {
+	420000, 400000, 416666, 115200, 460800, 921600, 1870000, 2250000, 3750000, 5250000,
+};
+const size_t AUTO_BAUD_RATE_COUNT = sizeof(AUTO_BAUD_RATES) / sizeof(AUTO_BAUD_RATES[0]);
+
+int openSerialPort(const char* path, uint32_t baudRate, bool writable)
+{
+	int fd = open(path, (writable ? O_RDWR : O_RDONLY) | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	termios2 tty;
+	if (ioctl(fd, TCGETS2, &tty) != 0)
+	{
+		int error = errno;
+		close(fd);
+		errno = error;
+		return -1;
+	}
+
+	// Raw mode, same as cfmakeraw()
+	tty.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON);
+	tty.c_oflag &= ~OPOST;
+	tty.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+	tty.c_cflag &= ~(CSIZE | PARENB);
+	tty.c_cflag |= CS8;
+	tty.c_cc[VMIN] = 1;
+	tty.c_cc[VTIME] = 0;
+
+	tty.c_cflag |= CLOCAL | CREAD; // Ignore modem lines, enable receiver
+	tty.c_cflag &= ~(CSTOPB | PARENB | CRTSCTS); // 1 stop bit, no parity, no flow control
+
+	tty.c_cflag &= ~CBAUD;
+	tty.c_cflag |= BOTHER;
+	tty.c_ispeed = baudRate;
+	tty.c_ospeed = baudRate;
+
+	if (ioctl(fd, TCSETS2, &tty) != 0)
+	{
+		int error = errno;
+		close(fd);
+		errno = error;
+		return -1;
+	}
+
+	ioctl(fd, TCFLSH, TCIFLUSH);
+	return fd;
+}
+
+bool setSerialBaudRate(int fd, uint32_t baudRate)
+{
+	termios2 tty;
+	if (ioctl(fd, TCGETS2, &tty) != 0)
+		return false;
+
+	tty.c_cflag &= ~CBAUD;
+	tty.c_cflag |= BOTHER;
+	tty.c_ispeed = baudRate;
+	tty.c_ospeed = baudRate;
+
+	// Bytes in the buffer were read at the old rate
+	if (ioctl(fd, TCSETS2, &tty) != 0)
+		return false;
+	ioctl(fd, TCFLSH, TCIFLUSH);
+	return true;
+}
+
+bool setSerialReadBatch(int fd, uint8_t minBytes)
+{
+	termios2 tty;
+	if (ioctl(fd, TCGETS2, &tty) != 0)
+		return false;
+
+	// Without VTIME the line discipline reports the port ready at VMIN bytes
+	tty.c_cc[VMIN] = minBytes ? minBytes : 1;
+	tty.c_cc[VTIME] = 0;
+	return ioctl(fd, TCSETS2, &tty) == 0;
+}
@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#define DEFAULT_BAUD_RATE 115200 // Ignored by USB VCP
+
+// Rates tried when the baud rate is detected, most common first
+extern const uint32_t AUTO_BAUD_RATES[];
+extern const size_t AUTO_BAUD_RATE_COUNT;
+
+// Opens the device in raw non-blocking mode, 8N1, for reading and if
+// writable is set also for writing.
+// Returns the file descriptor or -1 with errno set.
+int openSerialPort(const char* path, uint32_t baudRate = DEFAULT_BAUD_RATE, bool writable = false);
+
+// Any rate the UART can divide down to, not only the standard ones.
+// Drops the bytes received so far.
+bool setSerialBaudRate(int fd, uint32_t baudRate);
+
+// Readiness is only signalled once minBytes (at most 255) are waiting,
+// 1 signals every byte. Reads still return whatever is there.
+bool setSerialReadBatch(int fd, uint8_t minBytes);
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "shared_memory.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool SharedMemory::create(const char* name, size_t size)
+{
+	close();
+
+	// A fresh object, consumers of a previous run keep their old mapping
+	shm_unlink(name);
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if (fd < 0)
+		return false;
+
+	if (ftruncate(fd, size) != 0)
+	{
+		int error = errno;
+		::close(fd);
+		shm_unlink(name);
+		errno = error;
+		return false;
+	}
+
+	void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	int error = errno;
+	::close(fd);
+
+	if (mapping == MAP_FAILED)
+	{
+		shm_unlink(name);
+		errno = error;
+		return false;
+	}
+
+	address = (uint8_t*)mapping;
+	length = size;
+	return true;
+}
+
+bool SharedMemory::open(const char* name)
+{
+	close();
+
+	int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0)
+	{
+		int error = errno;
+		::close(fd);
+		errno = error;
+		return false;
+	}
+
+	void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	int error = errno;
+	::close(fd);
+
+	if (mapping == MAP_FAILED)
+	{
+		errno = error;
+		return false;
+	}
+
+	address = (uint8_t*)mapping;
+	length = info.st_size;
+	return true;
+}
+
+void SharedMemory::remove(const char* name)
+{
+	shm_unlink(name);
+}
+
+void SharedMemory::close()
+{
+	if (address)
+		munmap(address, length);
+
+	address = nullptr;
+	length = 0;
+}
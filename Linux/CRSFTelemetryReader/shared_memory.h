@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// POSIX shared memory object mapped read-write by the producer and
+// read-only by consumers
+class SharedMemory
+{
+public:
+	SharedMemory() = default;
+	SharedMemory(const SharedMemory&) = delete;
+	SharedMemory& operator=(const SharedMemory&) = delete;
+	~SharedMemory() { close(); }
+
+	// Creates or replaces the object, zero filled. Returns false with errno set.
+	bool create(const char* name, size_t size);
+
+	// Maps an existing object read-only. Returns false with errno set.
+	bool open(const char* name);
+
+	void close();
+
+	// Existing mappings stay valid, new consumers can not open the object any more
+	static void remove(const char* name);
+
+	uint8_t* data() const { return address; }
+	size_t size() const { return length; }
+
+private:
+	uint8_t* address = nullptr;
+	size_t length = 0;
+};
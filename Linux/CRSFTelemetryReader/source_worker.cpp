@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "source_worker.h"
+#include "telemetry_clock.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#define MAX_EVENTS 16
+
+SourceWorker::SourceWorker(uint32_t flushInterval) :
+	flushInterval(flushInterval)
+{
+}
+
+SourceWorker::~SourceWorker()
+{
+	stop();
+	join();
+
+	if (stopFd >= 0)
+		close(stopFd);
+	if (epollFd >= 0)
+		close(epollFd);
+}
+
+bool SourceWorker::add(TelemetrySource& source)
+{
+	if (sourceCount >= MAX_WORKER_SOURCES)
+		return false;
+
+	sources[sourceCount++] = &source;
+	return true;
+}
+
+bool SourceWorker::start()
+{
+	epollFd = epoll_create1(EPOLL_CLOEXEC);
+	stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (epollFd < 0 || stopFd < 0)
+	{
+		std::cerr << "Error: Unable to create epoll instance: " << strerror(errno) << std::endl;
+		return false;
+	}
+
+	// The only descriptor without a source
+	epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.ptr = nullptr;
+	epoll_ctl(epollFd, EPOLL_CTL_ADD, stopFd, &event);
+
+	for (size_t i = 0; i < sourceCount; i++)
+	{
+		if (!sources[i]->start(epollFd))
+			return false;
+	}
+
+	thread = std::thread(&SourceWorker::run, this);
+	return true;
+}
+
+void SourceWorker::stop()
+{
+	if (stopFd >= 0)
+	{
+		uint64_t one = 1;
+		write(stopFd, &one, sizeof(one));
+	}
+}
+
+void SourceWorker::join()
+{
+	if (thread.joinable())
+		thread.join();
+}
+
+bool SourceWorker::isFinished() const
+{
+	for (size_t i = 0; i < sourceCount; i++)
+	{
+		if (!sources[i]->isFinished())
+			return false;
+	}
+	return true;
+}
+
+void SourceWorker::flush()
+{
+	for (size_t i = 0; i < sourceCount; i++)
+	{
+		if (sources[i]->getSink())
+			sources[i]->getSink()->flush();
+	}
+}
+
+void SourceWorker::run()
+{
+	uint64_t interval = (uint64_t)flushInterval * 1000; // us
+	uint64_t lastFlush = getTelemetryTime();
+
+	while (!isFinished())
+	{
+		// Wake up for output which waits in the sinks, also while the links
+		// are quiet or their frames are filtered out
+		int timeout = -1;
+		if (interval)
+		{
+			uint64_t elapsed = getTelemetryTime() - lastFlush;
+			timeout = elapsed >= interval ? 0 : (int)((interval - elapsed + 999) / 1000);
+		}
+
+		epoll_event ready[MAX_EVENTS];
+		int count = epoll_wait(epollFd, ready, MAX_EVENTS, timeout);
+		if (count < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			std::cerr << "Error: epoll_wait failed: " << strerror(errno) << std::endl;
+			break;
+		}
+
+		bool stopped = false;
+		for (int i = 0; i < count; i++)
+		{
+			TelemetrySource* source = (TelemetrySource*)ready[i].data.ptr;
+			if (source)
+				source->handle(epollFd);
+			else
+				stopped = true;
+		}
+
+		if (stopped)
+			break;
+
+		// After every batch, so a busy link does not hold back the others
+		uint64_t now = getTelemetryTime();
+		if (interval && now - lastFlush >= interval)
+		{
+			flush();
+			lastFlush = now;
+		}
+	}
+
+	done = true;
+}
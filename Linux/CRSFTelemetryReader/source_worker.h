@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include "telemetry_source.h"
+
+#define MAX_WORKER_SOURCES 32
+
+// Event loop thread serving a share of the sources. Every worker has its
+// own epoll set, so sources on different workers never share a lock and a
+// busy radio only delays the sources of its own worker.
+class SourceWorker
+{
+public:
+	explicit SourceWorker(uint32_t flushInterval);
+	~SourceWorker();
+
+	bool add(TelemetrySource& source);
+
+	bool start();
+	void stop();
+	void join();
+
+	// All sources are finished or the worker was stopped
+	bool isDone() const { return done; }
+
+private:
+	uint32_t flushInterval; // ms, 0 waits without a timeout
+	int epollFd = -1;
+	int stopFd = -1;
+	TelemetrySource* sources[MAX_WORKER_SOURCES];
+	size_t sourceCount = 0;
+	std::atomic<bool> done{ false };
+	std::thread thread;
+
+	void run();
+	bool isFinished() const;
+	void flush();
+};
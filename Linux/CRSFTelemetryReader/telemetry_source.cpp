@@ -0,0 +1,450 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "telemetry_source.h"
+#include "device_discovery.h"
+#include "serial.h"
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#define RECONNECT_DELAY   1000000 // us
+#define AUTO_BAUD_WINDOW  250000  // us each rate is listened to
+#define REPLAY_BATCH_SIZE 65536   // Bytes replayed before other sources get their turn
+
+uint64_t getTime(clockid_t clock)
+{
+	timespec now;
+	clock_gettime(clock, &now);
+	return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static bool watch(int epollFd, int fd, TelemetrySource* source)
+{
+	epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.ptr = source;
+	return epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+// One shot timer at an absolute CLOCK_MONOTONIC time in us, 0 disarms
+static void setTimer(int timer, uint64_t time)
+{
+	itimerspec spec = {};
+	spec.it_value.tv_sec = time / 1000000;
+	spec.it_value.tv_nsec = (time % 1000000) * 1000;
+	timerfd_settime(timer, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+// Returns false if the timer has not expired, e.g. it was rearmed meanwhile
+static bool clearTimer(int timer)
+{
+	uint64_t expirations;
+	return ::read(timer, &expirations, sizeof(expirations)) == sizeof(expirations);
+}
+
+TelemetrySource::TelemetrySource(const char* path, TelemetrySink* sink) :
+	path(path),
+	sink(sink),
+	stream(dispatcher)
+{
+	// Latest values for threads which do not want to wait for the reader
+	dispatcher.add(snapshot);
+	if (sink)
+		dispatcher.add(*sink);
+}
+
+void TelemetrySource::enableMetrics()
+{
+	metrics.reset(new TelemetryMetrics());
+	stream.setMetrics(metrics.get());
+}
+
+bool TelemetrySource::setStore(TelemetryStoreWriter& writer)
+{
+	if (!dispatcher.add(writer))
+		return false;
+
+	store = &writer;
+	return true;
+}
+
+SerialSource::SerialSource(const char* path, TelemetrySink* sink, const char* capturePath, uint32_t baudRate) :
+	TelemetrySource(path, sink),
+	capturePath(capturePath),
+	baudRate(baudRate)
+{
+}
+
+SerialSource::~SerialSource()
+{
+	// Pending requests end before their handler is gone
+	if (commands)
+		commands->reset();
+	if (fd >= 0)
+		close(fd);
+	if (retryTimer >= 0)
+		close(retryTimer);
+	if (batchTimer >= 0)
+		close(batchTimer);
+}
+
+bool SerialSource::start(int epollFd)
+{
+	// Record times are monotonic, shifted so that they read as wall clock
+	uint64_t startTime = getTime(CLOCK_REALTIME);
+	clockOffset = startTime - getTime(CLOCK_MONOTONIC);
+
+	if (capturePath)
+	{
+		if (!capture.open(capturePath, startTime))
+		{
+			std::cerr << "Error: Unable to create " << capturePath << ": " << strerror(errno) << std::endl;
+			return false;
+		}
+	}
+
+	retryTimer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (retryTimer < 0 || !watch(epollFd, retryTimer, this))
+	{
+		std::cerr << "Error: Unable to create timer: " << strerror(errno) << std::endl;
+		return false;
+	}
+
+	if (batchLatency)
+	{
+		batchTimer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		if (batchTimer < 0 || !watch(epollFd, batchTimer, this))
+		{
+			std::cerr << "Error: Unable to create timer: " << strerror(errno) << std::endl;
+			return false;
+		}
+	}
+
+	open(epollFd);
+	return true;
+}
+
+void SerialSource::setReadBatch(uint8_t minBytes, uint32_t latency)
+{
+	batchBytes = minBytes;
+	batchLatency = latency;
+}
+
+void SerialSource::enableDeviceDiscovery()
+{
+	commands.reset(new CrossfireCommandChannel());
+	discovery.reset(new DeviceDiscovery(*commands));
+	dispatcher.add(*commands);
+}
+
+void SerialSource::open(int epollFd)
+{
+	detecting = baudRate == 0;
+	fd = openSerialPort(path, detecting ? AUTO_BAUD_RATES[0] : baudRate, commands != nullptr);
+	if (fd < 0)
+	{
+		std::cerr << "Error: Unable to open " << path << ": " << strerror(errno) << std::endl;
+		setTimer(retryTimer, getTime(CLOCK_MONOTONIC) + RECONNECT_DELAY); // Wait for the radio to come back
+		return;
+	}
+
+	stream.reset();
+
+	// Without a byte count only the batch timer reads the port
+	if (batchLatency && batchBytes && !setSerialReadBatch(fd, batchBytes))
+		std::cerr << "Error: Unable to batch reads of " << path << ": " << strerror(errno) << std::endl;
+
+	if ((!batchLatency || batchBytes) && !watch(epollFd, fd, this))
+	{
+		std::cerr << "Error: Unable to watch " << path << ": " << strerror(errno) << std::endl;
+		disconnect(epollFd);
+		return;
+	}
+	scheduleRead();
+
+	if (detecting)
+	{
+		// Every rate is listened to for a while, the one with most valid frames wins
+		probe = 0;
+		bestProbe = 0;
+		bestFrames = 0;
+		probeFrames = stream.getStats().frames;
+		setTimer(retryTimer, getTime(CLOCK_MONOTONIC) + AUTO_BAUD_WINDOW);
+		return;
+	}
+
+	startCommands();
+	if (commands && !write())
+		disconnect(epollFd);
+}
+
+// Discovery starts once the rate is known
+void SerialSource::startCommands()
+{
+	if (discovery)
+		discovery->start();
+}
+
+// Returns false when the device is gone
+bool SerialSource::nextBaudRate()
+{
+	uint64_t frames = stream.getStats().frames - probeFrames;
+	if (frames > bestFrames)
+	{
+		bestFrames = frames;
+		bestProbe = probe;
+	}
+
+	if (++probe == AUTO_BAUD_RATE_COUNT)
+	{
+		// Nothing at any rate, e.g. the receiver has no link yet
+		if (bestFrames == 0)
+			probe = 0;
+		else
+		{
+			detecting = false;
+			std::cerr << path << ": " << AUTO_BAUD_RATES[bestProbe] << " baud, "
+				<< bestFrames * 1000000 / AUTO_BAUD_WINDOW << " frames/s" << std::endl;
+			if (!setSerialBaudRate(fd, AUTO_BAUD_RATES[bestProbe]))
+				return false;
+			stream.reset();
+			startCommands();
+			return !commands || write();
+		}
+	}
+
+	// Bytes of an unfinished frame were read at the old rate
+	if (!setSerialBaudRate(fd, AUTO_BAUD_RATES[probe]))
+		return false;
+	stream.reset();
+	probeFrames = stream.getStats().frames;
+	setTimer(retryTimer, getTime(CLOCK_MONOTONIC) + AUTO_BAUD_WINDOW);
+	return true;
+}
+
+void SerialSource::disconnect(int epollFd)
+{
+	// Closing the descriptor also removes it from the epoll set
+	close(fd);
+	fd = -1;
+	capture.flush();
+	if (commands)
+		commands->reset();
+	if (batchTimer >= 0)
+		setTimer(batchTimer, 0);
+	setTimer(retryTimer, getTime(CLOCK_MONOTONIC) + RECONNECT_DELAY);
+}
+
+// Reads everything available until the device would block.
+// Returns false when the device is gone.
+bool SerialSource::read()
+{
+	for (;;)
+	{
+		size_t length;
+		uint8_t* buf = stream.writeBuffer(length);
+
+		ssize_t bytesRead = ::read(fd, buf, length);
+		if (bytesRead > 0)
+		{
+			if (capturePath || store)
+			{
+				uint64_t time = clockOffset + getTime(CLOCK_MONOTONIC);
+				if (capturePath)
+					capture.write(time, buf, bytesRead);
+				if (store)
+					store->setTime(time);
+			}
+
+			// Incomplete frames are kept by the stream until the next read
+			stream.commit(bytesRead);
+			stream.process();
+			continue;
+		}
+
+		if (bytesRead < 0 && errno == EINTR)
+			continue;
+
+		if (bytesRead < 0 && errno == EAGAIN)
+			return true;
+
+		return false; // EOF or I/O error, e.g. cable unplugged
+	}
+}
+
+// The next read happens at the latest batchLatency from now
+void SerialSource::scheduleRead()
+{
+	if (batchLatency)
+		setTimer(batchTimer, getTime(CLOCK_MONOTONIC) + batchLatency);
+}
+
+// Writes the queued frames and arms the timer for the next request timeout.
+// Frames which do not fit into the device buffer are written next time.
+// Returns false when the device is gone.
+bool SerialSource::write()
+{
+	size_t length;
+	const uint8_t* buf = commands->getWriteBuffer(length);
+	while (length > 0)
+	{
+		ssize_t written = ::write(fd, buf, length);
+		if (written < 0 && errno == EINTR)
+			continue;
+		if (written < 0 && errno == EAGAIN)
+			break;
+		if (written < 0)
+			return false;
+
+		commands->consumeWrite(written);
+		buf = commands->getWriteBuffer(length);
+	}
+
+	setTimer(retryTimer, commands->getNextTimeout());
+	return true;
+}
+
+void SerialSource::handle(int epollFd)
+{
+	if (fd < 0)
+	{
+		if (clearTimer(retryTimer))
+			open(epollFd);
+		return;
+	}
+
+	if (metrics)
+		metrics->countWakeup();
+
+	// Everything that arrived since the last read is decoded in one pass
+	bool connected = read();
+	if (batchLatency)
+	{
+		clearTimer(batchTimer);
+		scheduleRead();
+	}
+
+	if (connected && detecting)
+	{
+		if (clearTimer(retryTimer))
+			connected = nextBaudRate();
+	}
+	else if (connected && commands)
+	{
+		// Answers may have queued further requests
+		clearTimer(retryTimer);
+		commands->expire(getTime(CLOCK_MONOTONIC));
+		connected = write();
+	}
+
+	if (!connected)
+	{
+		std::cerr << "Error: " << path << " disconnected" << std::endl;
+		disconnect(epollFd);
+	}
+}
+
+CaptureSource::CaptureSource(const char* path, TelemetrySink* sink, bool realtime) :
+	TelemetrySource(path, sink),
+	realtime(realtime),
+	reader(nullptr, 0)
+{
+}
+
+CaptureSource::~CaptureSource()
+{
+	if (timer >= 0)
+		close(timer);
+}
+
+bool CaptureSource::start(int epollFd)
+{
+	if (!file.open(path))
+	{
+		std::cerr << "Error: Unable to open " << path << ": " << strerror(errno) << std::endl;
+		return false;
+	}
+
+	reader = CaptureReader(file.data(), file.size());
+	if (!reader.isValid())
+	{
+		std::cerr << "Error: " << path << " is not a capture file" << std::endl;
+		return false;
+	}
+
+	// Regular files can not be watched by epoll, a timer drives the replay
+	timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (timer < 0 || !watch(epollFd, timer, this))
+	{
+		std::cerr << "Error: Unable to create timer: " << strerror(errno) << std::endl;
+		return false;
+	}
+
+	replayStart = getTime(CLOCK_MONOTONIC);
+	schedule();
+	return true;
+}
+
+void CaptureSource::schedule()
+{
+	if (!pending && !(pending = reader.next(record)))
+	{
+		if (!reader.isValid())
+			std::cerr << "Warning: " << path << " is truncated" << std::endl;
+
+		double seconds = (getTime(CLOCK_MONOTONIC) - replayStart) / 1e6;
+		std::cerr << "Replayed " << path << ", " << bytes << " bytes in " << seconds << " s ("
+			<< (seconds > 0 ? bytes / seconds / 1e6 : 0) << " MB/s)" << std::endl;
+
+		finished = true;
+		close(timer); // Also removes it from the epoll set
+		timer = -1;
+		return;
+	}
+
+	// Due relative to the start of the capture, or right away
+	setTimer(timer, realtime ? replayStart + (record.timestamp - reader.getStartTime()) : 1);
+}
+
+void CaptureSource::handle(int epollFd)
+{
+	clearTimer(timer);
+
+	uint64_t now = getTime(CLOCK_MONOTONIC);
+	size_t batch = 0;
+
+	while (pending && batch < REPLAY_BATCH_SIZE)
+	{
+		if (realtime && replayStart + (record.timestamp - reader.getStartTime()) > now)
+			break;
+
+		if (sink)
+			sink->setTime(record.timestamp);
+		if (store)
+			store->setTime(record.timestamp);
+		stream.push(record.data, record.length);
+		bytes += record.length;
+		batch += record.length;
+		pending = reader.next(record);
+	}
+
+	schedule();
+}
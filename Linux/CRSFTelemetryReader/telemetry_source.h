@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include "capture.h"
+#include "crossfire_commands.h"
+#include "crossfire_stream.h"
+#include "mapped_file.h"
+#include "telemetry_dispatcher.h"
+#include "telemetry_filter.h"
+#include "telemetry_metrics.h"
+#include "telemetry_sink.h"
+#include "telemetry_snapshot.h"
+#include "telemetry_store.h"
+
+class DeviceDiscovery;
+
+uint64_t getTime(clockid_t clock);
+
+// A radio or a capture with its own decoder state and latest values.
+// Sources are driven by a SourceWorker: they register their descriptors
+// with the worker's epoll set and are called back when one is ready.
+class TelemetrySource
+{
+public:
+	TelemetrySource(const char* path, TelemetrySink* sink);
+	virtual ~TelemetrySource() = default;
+
+	// Registers descriptors, returns false if the source can not be used at all
+	virtual bool start(int epollFd) = 0;
+
+	// Called when one of the registered descriptors is ready
+	virtual void handle(int epollFd) = 0;
+
+	// Replay reached the end, a serial port is never finished
+	virtual bool isFinished() const { return false; }
+
+	const char* getPath() const { return path; }
+	TelemetrySink* getSink() { return sink; }
+	TelemetrySnapshot& getSnapshot() { return snapshot; }
+	const CrossfireStreamStats& getStats() const { return stream.getStats(); }
+	uint32_t getUnknownFrames(uint8_t id) const { return stream.getUnknownFrames(id); }
+
+	// Extra handlers, e.g. statistics, have to be added before the source is started
+	bool addHandler(CrossfireTelemetryHandler& handler) { return dispatcher.add(handler); }
+
+	// Filter in front of the sink, created with the sink as its output. The
+	// other handlers still get every value. Also only before the source is started.
+	bool setSinkFilter(TelemetryFilter& filter) { return sink && dispatcher.replace(*sink, filter); }
+
+	// Latency histograms and counters, also only before the source is started
+	void enableMetrics();
+	const TelemetryMetrics* getMetrics() const { return metrics.get(); }
+
+	// Columnar store of the decoded samples, also only before the source is started.
+	// The source tells the store when the bytes it decodes were read.
+	bool setStore(TelemetryStoreWriter& writer);
+
+protected:
+	const char* path;
+	TelemetrySink* sink;
+	TelemetrySnapshot snapshot;
+	TelemetryDispatcher dispatcher;
+	CrossfireStream stream;
+	std::unique_ptr<TelemetryMetrics> metrics;
+	TelemetryStoreWriter* store = nullptr;
+};
+
+// Serial port, reopened after the radio is disconnected.
+// A baud rate of 0 detects the rate each time the port is opened.
+class SerialSource : public TelemetrySource
+{
+public:
+	SerialSource(const char* path, TelemetrySink* sink, const char* capturePath, uint32_t baudRate);
+	~SerialSource() override;
+
+	bool start(int epollFd) override;
+	void handle(int epollFd) override;
+
+	// Opens the port for writing too and lists the devices with their
+	// parameters each time it is opened. Only before the source is started.
+	void enableDeviceDiscovery();
+
+	// Fewer wakeups for the price of latency: the port is read when
+	// minBytes are waiting, 0 never, or latency us after the last read.
+	// Only before the source is started.
+	void setReadBatch(uint8_t minBytes, uint32_t latency);
+
+private:
+	const char* capturePath;
+	uint32_t baudRate;
+	CaptureWriter capture;
+	uint64_t clockOffset = 0; // Monotonic to wall clock
+	int fd = -1;
+	int retryTimer = -1; // Fires when it is time to reopen the port, to try the next rate, or a request times out
+	bool detecting = false;
+	size_t probe = 0;        // Index of the rate tried in AUTO_BAUD_RATES
+	size_t bestProbe = 0;
+	uint64_t probeFrames = 0; // Frame counter when the rate was set
+	uint64_t bestFrames = 0;
+	uint8_t batchBytes = 1;
+	uint32_t batchLatency = 0; // us, 0 reads as soon as anything arrives
+	int batchTimer = -1;
+	std::unique_ptr<CrossfireCommandChannel> commands;
+	std::unique_ptr<DeviceDiscovery> discovery;
+
+	void open(int epollFd);
+	void disconnect(int epollFd);
+	void startCommands();
+	bool nextBaudRate();
+	bool read();
+	bool write();
+	void scheduleRead();
+};
+
+// Capture file replayed as fast as possible, or with the original timing
+class CaptureSource : public TelemetrySource
+{
+public:
+	CaptureSource(const char* path, TelemetrySink* sink, bool realtime);
+	~CaptureSource() override;
+
+	bool start(int epollFd) override;
+	void handle(int epollFd) override;
+	bool isFinished() const override { return finished; }
+
+private:
+	bool realtime;
+	bool finished = false;
+	MappedFile file;
+	CaptureReader reader;
+	CaptureRecord record = {};
+	bool pending = false; // record is read but not pushed yet
+	int timer = -1;       // Paces the replay so other sources get their turn
+	uint64_t replayStart = 0;
+	uint64_t bytes = 0;
+
+	void schedule();
+};
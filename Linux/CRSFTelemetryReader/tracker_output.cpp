@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "tracker_output.h"
+
+#include "telemetry_clock.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+TrackerOutput::TrackerOutput(const TelemetrySnapshot& snapshot, const TrackerHome& home, const TrackerServos& servos, FILE* file) :
+	snapshot(snapshot),
+	tracker(home),
+	servos(servos),
+	file(file)
+{
+}
+
+TrackerOutput::~TrackerOutput()
+{
+	stop();
+
+	if (timer >= 0)
+		close(timer);
+	if (stopFd >= 0)
+		close(stopFd);
+}
+
+bool TrackerOutput::start(uint32_t rate)
+{
+	if (rate == 0)
+	{
+		std::cerr << "Error: Tracker rate has to be at least 1 Hz" << std::endl;
+		return false;
+	}
+
+	timer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (timer < 0 || stopFd < 0)
+	{
+		std::cerr << "Error: Unable to create tracker timer: " << strerror(errno) << std::endl;
+		return false;
+	}
+
+	// tv_nsec has to stay below one second, 1 Hz is a whole second
+	uint64_t period = 1000000000ull / rate;
+	itimerspec spec = {};
+	spec.it_interval.tv_sec = (time_t)(period / 1000000000ull);
+	spec.it_interval.tv_nsec = (long)(period % 1000000000ull);
+	spec.it_value = spec.it_interval;
+	if (timerfd_settime(timer, 0, &spec, nullptr) < 0)
+	{
+		std::cerr << "Error: Unable to start tracker timer: " << strerror(errno) << std::endl;
+		return false;
+	}
+
+	thread = std::thread(&TrackerOutput::run, this);
+	return true;
+}
+
+void TrackerOutput::stop()
+{
+	if (!thread.joinable())
+		return;
+
+	uint64_t one = 1;
+	write(stopFd, &one, sizeof(one));
+	thread.join();
+}
+
+void TrackerOutput::run()
+{
+	pollfd fds[2] = { { timer, POLLIN, 0 }, { stopFd, POLLIN, 0 } };
+
+	for (;;)
+	{
+		if (poll(fds, 2, -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		if (fds[1].revents)
+			break;
+
+		uint64_t expirations;
+		if (read(timer, &expirations, sizeof(expirations)) != sizeof(expirations))
+			continue;
+
+		tracker.update(snapshot);
+
+		TrackerTarget target;
+		if (!tracker.getTarget(getTelemetryTime(), target))
+			continue;
+
+		uint16_t pan, tilt;
+		AntennaTracker::getServoPulses(target, servos, pan, tilt);
+
+		// A servo driver reading a pipe wants every line as soon as possible
+		fprintf(file, "%u %u %.2f %.2f %.1f %u\n", pan, tilt, target.azimuth, target.elevation, target.distance, (unsigned)(target.age / 1000));
+		fflush(file);
+	}
+}
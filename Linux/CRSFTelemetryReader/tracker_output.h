@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <thread>
+
+#include "antenna_tracker.h"
+
+// Writes servo targets at a fixed rate, independent of when telemetry
+// arrives. Each line is "pan tilt azimuth elevation distance age" with
+// pulses in us, angles in degree, distance in m and age in ms.
+class TrackerOutput
+{
+public:
+	TrackerOutput(const TelemetrySnapshot& snapshot, const TrackerHome& home, const TrackerServos& servos, FILE* file);
+	~TrackerOutput();
+
+	AntennaTracker& getTracker() { return tracker; }
+
+	bool start(uint32_t rate); // Hz
+	void stop();
+
+private:
+	const TelemetrySnapshot& snapshot;
+	AntennaTracker tracker;
+	TrackerServos servos;
+	FILE* file;
+	int timer = -1;
+	int stopFd = -1;
+	std::thread thread;
+
+	void run();
+};
@@ -0,0 +1,532 @@
+/*
+ * Copyright (C) Rustam Iskenderov
+ *
+ * License GPLv2: http://www.gnu.org/licenses/gpl-2.0.html
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Virtual radio on a pseudo terminal: sends generated telemetry at any
+// rate, with injected faults, or replays a capture. The reader opens the
+// printed device like a real serial port. With --soak the reader's
+// telemetry bus is read back to count lost frames and measure latency.
+
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <getopt.h>
+#include <iostream>
+#include <memory>
+#include <strings.h>
+#include <termios.h>
+#include <unistd.h>
+#include <vector>
+
+#include "capture.h"
+#include "crc8.h"
+#include "crossfire.h"
+#include "frame_generator.h"
+#include "latency_histogram.h"
+#include "mapped_file.h"
+#include "shared_memory.h"
+#include "telemetry_bus.h"
+#include "telemetry_clock.h"
+
+#define TICK          1000   // us between writes
+#define BATCH_SIZE    65536  // Bytes written at most per tick
+#define MARKER_SLOTS  65536  // Send times of soak markers, a power of two
+#define SOAK_SETTLE   500000 // us for the reader to open the port after it created the bus
+#define SOAK_DRAIN    500000 // us for the reader to catch up at the end
+#define READ_BATCH    256
+
+static volatile sig_atomic_t running = 1;
+
+static void stop(int)
+{
+	running = 0;
+}
+
+struct Options
+{
+	double rate = 150;          // frames/s
+	std::vector<uint8_t> frames; // Sent in turn, empty sends a typical ELRS mix
+	double noise = 0;           // % of frames preceded by a few random bytes
+	double truncate = 0;        // % of frames cut short
+	double crc = 0;             // % of frames with a flipped bit
+	double burst = 0;           // % of frames preceded by a burst of random bytes
+	uint32_t burstLength = 256;
+	const char* replayPath = nullptr;
+	double speed = 1;           // Replay time factor
+	bool loop = false;
+	const char* soakBus = nullptr;
+	const char* link = nullptr; // Symlink to the pty
+	uint32_t duration = 0;      // s, 0 runs until interrupted
+	uint32_t seed = 1;
+};
+
+struct Counters
+{
+	uint64_t frames = 0;    // Written intact
+	uint64_t corrupted = 0; // Written with a fault
+	uint64_t noise = 0;     // Random bytes written
+	uint64_t overruns = 0;  // Bytes the pty did not take, the reader is not keeping up
+};
+
+static uint32_t xorshift(uint32_t& state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+static bool chance(uint32_t& state, double percent)
+{
+	return percent > 0 && xorshift(state) % 1000000 < percent * 10000;
+}
+
+static void sleepUntil(uint64_t time)
+{
+	timespec until = { (time_t)(time / 1000000), (long)(time % 1000000) * 1000 };
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, nullptr) == EINTR && running)
+		;
+}
+
+// Frame id from a name such as GPS_ID or gps, or a number
+static bool parseFrameId(const char* text, uint8_t& id)
+{
+	char* end;
+	unsigned long number = strtoul(text, &end, 0);
+	if (*text && !*end)
+	{
+		id = (uint8_t)number;
+		return number < 256;
+	}
+
+	for (unsigned i = 0; i < 256; i++)
+	{
+		const char* name = getCrossfireFrameName((uint8_t)i);
+		size_t length = strlen(name) - 3; // Without _ID
+		if (strcmp(name, "UNKNOWN") != 0 && (strcasecmp(text, name) == 0 || (strlen(text) == length && strncasecmp(text, name, length) == 0)))
+		{
+			id = (uint8_t)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool parseFrames(char* text, std::vector<uint8_t>& frames)
+{
+	for (char* name = strtok(text, ","); name; name = strtok(nullptr, ","))
+	{
+		uint8_t id;
+		uint8_t frame[MAX_FRAME_SIZE];
+		if (!parseFrameId(name, id) || CrossfireFrameGenerator().generate(id, frame) == 0)
+		{
+			std::cerr << "Error: Can not generate " << name << " frames" << std::endl;
+			return false;
+		}
+		frames.push_back(id);
+	}
+	return !frames.empty();
+}
+
+// Pty whose other end is the virtual serial port
+static int openPseudoTerminal(int& slave)
+{
+	int master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+		return -1;
+
+	// Kept open, so writes do not fail between two readers, and raw, so
+	// nothing is echoed or translated before the reader sets the port up
+	slave = open(ptsname(master), O_RDWR | O_NOCTTY | O_CLOEXEC);
+	termios tty;
+	if (slave < 0 || tcgetattr(slave, &tty) != 0)
+		return -1;
+	cfmakeraw(&tty);
+	if (tcsetattr(slave, TCSANOW, &tty) != 0)
+		return -1;
+	return master;
+}
+
+// Battery frames carry a sequence number as the used capacity in soak
+// tests, the reader's bus tells when each one was decoded
+class SoakTest
+{
+public:
+	bool open(const char* name)
+	{
+		if (!memory.open(name))
+			return false;
+		reader = TelemetryBusReader(memory.data(), memory.size());
+		startFrames = reader.getFrames();
+		return reader.isValid();
+	}
+
+	bool isOpen() const { return reader.isValid(); }
+
+	// Stamps the frame with the next sequence number
+	void mark(uint8_t* frame, uint64_t time)
+	{
+		uint32_t sequence = nextSequence++ & 0xFFFFFF;
+		frame[7] = (uint8_t)(sequence >> 16);
+		frame[8] = (uint8_t)(sequence >> 8);
+		frame[9] = (uint8_t)sequence;
+		frame[frame[1] + 1] = crc8(&frame[2], frame[1] - 1);
+		sendTimes[sequence % MARKER_SLOTS] = time;
+	}
+
+	void poll()
+	{
+		TelemetryBusSample samples[READ_BATCH];
+		size_t count;
+		while ((count = reader.read(samples, READ_BATCH)) > 0)
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				if (samples[i].index != BATT_CAPACITY_INDEX)
+					continue;
+
+				// A corrupted frame may pass the CRC check by chance
+				uint32_t sequence = (uint32_t)samples[i].value;
+				uint32_t age = (nextSequence - sequence) & 0xFFFFFF;
+				uint64_t sent = sendTimes[sequence % MARKER_SLOTS];
+				if (age == 0 || age > MARKER_SLOTS || samples[i].timestamp < sent)
+					continue;
+				latency.record((samples[i].timestamp - sent) * 1000);
+				++markers;
+			}
+		}
+	}
+
+	void print(const Counters& counters)
+	{
+		int64_t lost = (int64_t)counters.frames - (uint32_t)(reader.getFrames() - startFrames);
+		fprintf(stderr, "Soak: %llu frames sent, %lld lost, %llu markers, latency p50 %.1f us, p99 %.1f us, max %.1f us",
+			(unsigned long long)counters.frames, (long long)lost, (unsigned long long)markers,
+			latency.getPercentile(50) / 1e3, latency.getPercentile(99) / 1e3, latency.getMax() / 1e3);
+		if (reader.getLost())
+			fprintf(stderr, ", %llu bus samples overwritten", (unsigned long long)reader.getLost());
+		fprintf(stderr, "\n");
+	}
+
+private:
+	SharedMemory memory;
+	TelemetryBusReader reader{ nullptr, 0 };
+	uint32_t startFrames = 0;
+	uint32_t nextSequence = 0;
+	uint64_t markers = 0;
+	uint64_t sendTimes[MARKER_SLOTS] = {};
+	LatencyHistogram latency;
+};
+
+// Appends the frame with the faults drawn for it, returns the bytes written to batch
+static size_t appendFrame(const Options& options, uint32_t& state, const uint8_t* frame, size_t length,
+	uint8_t* batch, Counters& counters)
+{
+	size_t used = 0;
+	if (chance(state, options.burst) && options.burstLength <= BATCH_SIZE / 2)
+	{
+		for (uint32_t i = 0; i < options.burstLength; i++)
+			batch[used++] = (uint8_t)xorshift(state);
+		counters.noise += options.burstLength;
+	}
+	if (chance(state, options.noise))
+	{
+		uint32_t count = 1 + xorshift(state) % 8;
+		for (uint32_t i = 0; i < count; i++)
+			batch[used++] = (uint8_t)xorshift(state);
+		counters.noise += count;
+	}
+
+	memcpy(batch + used, frame, length);
+	bool corrupted = false;
+	if (chance(state, options.crc))
+	{
+		// Anything after the header, the frame keeps its length
+		batch[used + 2 + xorshift(state) % (length - 2)] ^= (uint8_t)(1 << xorshift(state) % 8);
+		corrupted = true;
+	}
+	if (chance(state, options.truncate))
+	{
+		length = 2 + xorshift(state) % (length - 2);
+		corrupted = true;
+	}
+
+	if (corrupted)
+		++counters.corrupted;
+	else
+		++counters.frames;
+	return used + length;
+}
+
+// Writes as much of the batch as the pty takes
+static void writeBatch(int master, const uint8_t* batch, size_t length, Counters& counters)
+{
+	ssize_t written = write(master, batch, length);
+	if (written < (ssize_t)length)
+		counters.overruns += length - (written > 0 ? written : 0);
+}
+
+static void drain(int master)
+{
+	uint8_t buffer[256];
+	while (read(master, buffer, sizeof(buffer)) > 0)
+		;
+}
+
+static int generate(const Options& options, int master, SoakTest* soak)
+{
+	static uint8_t batch[BATCH_SIZE + MAX_FRAME_SIZE];
+	CrossfireFrameGenerator generator(options.seed);
+	uint32_t state = options.seed ? options.seed : 1;
+	Counters counters;
+	uint64_t start = getTelemetryTime();
+	uint64_t next = start;
+	uint64_t nextReport = start + 1000000;
+	uint64_t due = 0;
+	size_t turn = 0;
+
+	while (running && (!options.duration || next - start < options.duration * 1000000ull))
+	{
+		drain(master);
+		uint64_t now = getTelemetryTime();
+		uint64_t total = (uint64_t)((now - start) * options.rate / 1e6);
+
+		size_t used = 0;
+		while (due < total && used < BATCH_SIZE - options.burstLength - 8)
+		{
+			uint8_t frame[MAX_FRAME_SIZE];
+			size_t length;
+			if (options.frames.empty())
+				length = generator.generateMix(frame, MAX_FRAME_SIZE);
+			else
+				length = generator.generate(options.frames[turn++ % options.frames.size()], frame);
+
+			if (soak && frame[2] == BATTERY_ID)
+				soak->mark(frame, now);
+			used += appendFrame(options, state, frame, length, batch + used, counters);
+			++due;
+		}
+		if (used)
+			writeBatch(master, batch, used, counters);
+
+		if (soak)
+			soak->poll();
+
+		if (now >= nextReport)
+		{
+			fprintf(stderr, "Sent %llu frames, %llu corrupted, %llu noise bytes, %llu bytes not taken by the pty\n",
+				(unsigned long long)counters.frames, (unsigned long long)counters.corrupted,
+				(unsigned long long)counters.noise, (unsigned long long)counters.overruns);
+			if (soak)
+				soak->print(counters);
+			nextReport += 1000000;
+		}
+
+		next += TICK;
+		sleepUntil(next);
+	}
+
+	if (soak)
+	{
+		sleepUntil(getTelemetryTime() + SOAK_DRAIN);
+		soak->poll();
+		soak->print(counters);
+	}
+	return 0;
+}
+
+static int replay(const Options& options, int master)
+{
+	MappedFile file;
+	if (!file.open(options.replayPath))
+	{
+		std::cerr << "Error: Unable to open " << options.replayPath << ": " << strerror(errno) << std::endl;
+		return 1;
+	}
+
+	static uint8_t noise[BATCH_SIZE];
+	uint32_t state = options.seed ? options.seed : 1;
+	Counters counters;
+	uint64_t end = options.duration ? getTelemetryTime() + options.duration * 1000000ull : UINT64_MAX;
+	do
+	{
+		CaptureReader reader(file.data(), file.size());
+		if (!reader.isValid())
+		{
+			std::cerr << "Error: " << options.replayPath << " is not a capture file" << std::endl;
+			return 1;
+		}
+
+		// Reads are sent with their original spacing, scaled by speed
+		uint64_t start = getTelemetryTime();
+		CaptureRecord record;
+		while (running && getTelemetryTime() < end && reader.next(record))
+		{
+			sleepUntil(start + (uint64_t)((record.timestamp - reader.getStartTime()) / options.speed));
+			drain(master);
+
+			// Records are not split into frames, faults go between them
+			if (chance(state, options.burst) || chance(state, options.noise))
+			{
+				uint32_t count = chance(state, options.burst) ? options.burstLength : 1 + xorshift(state) % 8;
+				for (uint32_t i = 0; i < count && i < BATCH_SIZE; i++)
+					noise[i] = (uint8_t)xorshift(state);
+				writeBatch(master, noise, count < BATCH_SIZE ? count : BATCH_SIZE, counters);
+			}
+			writeBatch(master, record.data, record.length, counters);
+		}
+	} while (running && options.loop && getTelemetryTime() < end);
+
+	if (counters.overruns)
+		std::cerr << counters.overruns << " bytes not taken by the pty" << std::endl;
+	return 0;
+}
+
+static void usage(const char* name)
+{
+	std::cerr << "Usage: " << name << " [options]\n"
+		"  -r, --rate FRAMES          frames per second (150)\n"
+		"  -f, --frames ID,...        frames sent in turn, e.g. link,gps,battery or 0x14,\n"
+		"                             default is the mix of an ELRS link\n"
+		"  -n, --noise PERCENT        frames preceded by 1 to 8 random bytes\n"
+		"  -t, --truncate PERCENT     frames cut short\n"
+		"  -e, --crc PERCENT          frames with a flipped bit\n"
+		"  -b, --burst PERCENT        frames preceded by a burst of random bytes\n"
+		"  -B, --burst-length BYTES   length of a burst (256)\n"
+		"  -p, --replay FILE          send a capture with its original timing instead\n"
+		"  -x, --speed FACTOR         replay faster or slower (1)\n"
+		"  -l, --loop                 replay the capture again and again\n"
+		"  -s, --soak NAME            read the bus NAME the reader publishes to, count lost\n"
+		"                             frames and measure the latency of battery frames\n"
+		"  -d, --duration SECONDS     stop after SECONDS\n"
+		"  -L, --link PATH            symlink PATH to the pseudo terminal\n"
+		"  -S, --seed N               random seed (1)\n"
+		"  -h, --help                 show this help\n";
+}
+
+int main(int argc, char* argv[])
+{
+	static const option longOptions[] = {
+		{ "rate",     required_argument, nullptr, 'r' },
+		{ "frames",   required_argument, nullptr, 'f' },
+		{ "noise",    required_argument, nullptr, 'n' },
+		{ "truncate", required_argument, nullptr, 't' },
+		{ "crc",      required_argument, nullptr, 'e' },
+		{ "burst",    required_argument, nullptr, 'b' },
+		{ "burst-length", required_argument, nullptr, 'B' },
+		{ "replay",   required_argument, nullptr, 'p' },
+		{ "speed",    required_argument, nullptr, 'x' },
+		{ "loop",     no_argument,       nullptr, 'l' },
+		{ "soak",     required_argument, nullptr, 's' },
+		{ "duration", required_argument, nullptr, 'd' },
+		{ "link",     required_argument, nullptr, 'L' },
+		{ "seed",     required_argument, nullptr, 'S' },
+		{ "help",     no_argument,       nullptr, 'h' },
+		{ nullptr,    0,                 nullptr, 0 },
+	};
+
+	Options options;
+	int option;
+	while ((option = getopt_long(argc, argv, "r:f:n:t:e:b:B:p:x:ls:d:L:S:h", longOptions, nullptr)) != -1)
+	{
+		switch (option)
+		{
+		case 'r': options.rate = atof(optarg); break;
+		case 'f':
+			if (!parseFrames(optarg, options.frames))
+				return 1;
+			break;
+		case 'n': options.noise = atof(optarg); break;
+		case 't': options.truncate = atof(optarg); break;
+		case 'e': options.crc = atof(optarg); break;
+		case 'b': options.burst = atof(optarg); break;
+		case 'B': options.burstLength = (uint32_t)strtoul(optarg, nullptr, 10); break;
+		case 'p': options.replayPath = optarg; break;
+		case 'x': options.speed = atof(optarg); break;
+		case 'l': options.loop = true; break;
+		case 's': options.soakBus = optarg; break;
+		case 'd': options.duration = (uint32_t)strtoul(optarg, nullptr, 10); break;
+		case 'L': options.link = optarg; break;
+		case 'S': options.seed = (uint32_t)strtoul(optarg, nullptr, 10); break;
+		case 'h': usage(argv[0]); return 0;
+		default:  usage(argv[0]); return 1;
+		}
+	}
+
+	if (options.rate <= 0 || options.speed <= 0 || options.burstLength > BATCH_SIZE / 2)
+	{
+		std::cerr << "Error: Rate and speed have to be positive, bursts at most " << BATCH_SIZE / 2 << " bytes" << std::endl;
+		return 1;
+	}
+	if (options.soakBus && options.replayPath)
+	{
+		std::cerr << "Error: --soak needs generated frames, not a replay" << std::endl;
+		return 1;
+	}
+
+	struct sigaction action = {};
+	action.sa_handler = stop;
+	sigaction(SIGINT, &action, nullptr);
+	sigaction(SIGTERM, &action, nullptr);
+
+	int slave;
+	int master = openPseudoTerminal(slave);
+	if (master < 0)
+	{
+		std::cerr << "Error: Unable to create a pseudo terminal: " << strerror(errno) << std::endl;
+		return 1;
+	}
+
+	const char* path = ptsname(master);
+	if (options.link)
+	{
+		unlink(options.link);
+		if (symlink(path, options.link) != 0)
+		{
+			std::cerr << "Error: Unable to create " << options.link << ": " << strerror(errno) << std::endl;
+			return 1;
+		}
+	}
+	printf("%s\n", path);
+	fflush(stdout);
+
+	int result;
+	if (options.replayPath)
+		result = replay(options, master);
+	else
+	{
+		std::unique_ptr<SoakTest> soak;
+		if (options.soakBus)
+		{
+			// The reader creates the bus, then opens the port
+			std::cerr << "Waiting for the reader to publish to " << options.soakBus << std::endl;
+			soak.reset(new SoakTest());
+			while (running && !soak->open(options.soakBus))
+				sleepUntil(getTelemetryTime() + 100000);
+			sleepUntil(getTelemetryTime() + SOAK_SETTLE);
+		}
+		result = generate(options, master, soak.get());
+	}
+
+	if (options.link)
+		unlink(options.link);
+	close(slave);
+	close(master);
+	return result;
+}
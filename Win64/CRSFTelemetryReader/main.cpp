@@ -17,19 +17,27 @@
  */
 
 #include <Windows.h>
+#include <cstdlib>
 #include <iostream>
 
 #include "crossfire.h"
+#include "crossfire_stream.h"
+#include "telemetry_sink.h"
 
 LPCTSTR pcCommPortWin32DevicePath = TEXT("\\\\.\\COM14");
 
-void processCrossfireTelemetryValue(uint8_t index, int32_t value)
-{
-	const CrossfireSensor& sensor = crossfireSensors[index];
-	std::cout << '\t' << sensor.name << " " << value << std::endl;
-}
+// Usage: CRSFTelemetryReader [baud rate] [batch latency ms]
+// Any baud rate the driver supports. With a batch latency every read
+// returns what arrived within that time, fewer wakeups for more latency.
+int main(int argc, char* argv[]) {
+	DWORD baudRate = argc > 1 ? strtoul(argv[1], NULL, 10) : 115200; // Ignored by USB VCP
+	DWORD batchLatency = argc > 2 ? strtoul(argv[2], NULL, 10) : 0;
+	if (baudRate == 0)
+	{
+		std::cerr << "Error: Invalid baud rate " << argv[1] << std::endl;
+		return 1;
+	}
 
-int main() {
 	HANDLE hSerial;
 	DCB dcbSerialParams = { 0 };
 	COMMTIMEOUTS timeouts = { 0 };
@@ -54,7 +62,7 @@ int main() {
 		return 1;
 	}
 
-	dcbSerialParams.BaudRate = CBR_9600; // Set baud rate to 9600
+	dcbSerialParams.BaudRate = baudRate; // CBR_ constants or any other rate
 	dcbSerialParams.ByteSize = 8; // 8 data bits
 	dcbSerialParams.StopBits = ONESTOPBIT; // 1 stop bit
 	dcbSerialParams.Parity = NOPARITY; // No parity
@@ -66,9 +74,19 @@ int main() {
 	}
 
 	// Set timeouts
-	timeouts.ReadIntervalTimeout = 50;
-	timeouts.ReadTotalTimeoutConstant = 50;
-	timeouts.ReadTotalTimeoutMultiplier = 10;
+	if (batchLatency)
+	{
+		// Only the total timeout counts, the buffer fills or the time is up
+		timeouts.ReadIntervalTimeout = 0;
+		timeouts.ReadTotalTimeoutConstant = batchLatency;
+		timeouts.ReadTotalTimeoutMultiplier = 0;
+	}
+	else
+	{
+		timeouts.ReadIntervalTimeout = 50;
+		timeouts.ReadTotalTimeoutConstant = 50;
+		timeouts.ReadTotalTimeoutMultiplier = 10;
+	}
 	timeouts.WriteTotalTimeoutConstant = 50;
 	timeouts.WriteTotalTimeoutMultiplier = 10;
 
@@ -79,139 +97,25 @@ int main() {
 		return 1;
 	}
 
-	// Read data from the serial port	
-	DWORD bytesRead;
-	uint8_t buf[1024];
-	if (!ReadFile(hSerial, buf, sizeof(buf), &bytesRead, NULL))
-	{
-		std::cerr << "Error: Unable to read from serial port" << std::endl;
-		CloseHandle(hSerial);
-		return 1;
-	}
-
-	CloseHandle(hSerial);
+	TextTelemetrySink sink(stdout, 100);
+	CrossfireStream stream(sink);
 
-	uint32_t idx = 0;
-	while (idx < bytesRead)
+	// Read data from the serial port until it fails or gets disconnected
+	for (;;)
 	{
-		uint8_t* rxBuffer = buf + idx;
-
-		// rxBuffer structure
-		// 0 - RADIO_ADDRESS
-		// 1 - len
-		// 2 - id
-		// (len + 1) - crc, crc8(&rxBuffer[2], len - 1);
-
-		if (rxBuffer[0] != RADIO_ADDRESS)
-		{
-			++idx;
-			continue;
-		}
-
-		int len = rxBuffer[1];
+		size_t length;
+		uint8_t* buf = stream.writeBuffer(length);
 
-		if (len < MIN_FRAME_LEN)
+		DWORD bytesRead;
+		if (!ReadFile(hSerial, buf, (DWORD)length, &bytesRead, NULL))
 		{
-			std::cerr << "Error: incorrent length" << std::endl;
-			break;
+			std::cerr << "Error: Unable to read from serial port" << std::endl;
+			CloseHandle(hSerial);
+			return 1;
 		}
 
-		int32_t value;
-
-		switch (rxBuffer[2])
-		{
-		case LINK_ID:
-			std::cout << "LINK_ID" << std::endl;
-
-			for (unsigned int i = 0; i <= TX_SNR_INDEX; i++) {
-				if (getCrossfireTelemetryValue<1>(3 + i, value, rxBuffer)) {
-					if (i == TX_POWER_INDEX) {
-						static const int32_t power_values[] = { 0,    10,   25,  100, 500,
-															   1000, 2000, 250, 50 };
-						value =
-							((unsigned)value < DIM(power_values) ? power_values[value] : 0);
-					}
-					processCrossfireTelemetryValue(i, value);
-				}
-			}
-
-			break;
-		case GPS_ID:
-			std::cout << "GPS_ID" << std::endl;
-
-			if (getCrossfireTelemetryValue<4>(3, value, rxBuffer))
-				processCrossfireTelemetryValue(GPS_LATITUDE_INDEX, value / 10);
-			if (getCrossfireTelemetryValue<4>(7, value, rxBuffer))
-				processCrossfireTelemetryValue(GPS_LONGITUDE_INDEX, value / 10);
-			if (getCrossfireTelemetryValue<2>(11, value, rxBuffer))
-				processCrossfireTelemetryValue(GPS_GROUND_SPEED_INDEX, value);
-			if (getCrossfireTelemetryValue<2>(13, value, rxBuffer))
-				processCrossfireTelemetryValue(GPS_HEADING_INDEX, value);
-			if (getCrossfireTelemetryValue<2>(15, value, rxBuffer))
-				processCrossfireTelemetryValue(GPS_ALTITUDE_INDEX, value - 1000);
-			if (getCrossfireTelemetryValue<1>(17, value, rxBuffer))
-				processCrossfireTelemetryValue(GPS_SATELLITES_INDEX, value);
-
-			break;
-		case LINK_RX_ID:
-			std::cout << "LINK_RX_ID" << std::endl;
-
-			if (getCrossfireTelemetryValue<1>(4, value, rxBuffer))
-				processCrossfireTelemetryValue(RX_RSSI_PERC_INDEX, value);
-			if (getCrossfireTelemetryValue<1>(7, value, rxBuffer))
-				processCrossfireTelemetryValue(TX_RF_POWER_INDEX, value);
-			break;
-
-		case LINK_TX_ID:
-			std::cout << "LINK_TX_ID" << std::endl;
-
-			if (getCrossfireTelemetryValue<1>(4, value, rxBuffer))
-				processCrossfireTelemetryValue(TX_RSSI_PERC_INDEX, value);
-			if (getCrossfireTelemetryValue<1>(7, value, rxBuffer))
-				processCrossfireTelemetryValue(RX_RF_POWER_INDEX, value);
-			if (getCrossfireTelemetryValue<1>(8, value, rxBuffer))
-				processCrossfireTelemetryValue(TX_FPS_INDEX, value * 10);
-			break;
-
-		case BATTERY_ID:
-			std::cout << "BATTERY_ID" << std::endl;
-
-			if (getCrossfireTelemetryValue<2>(3, value, rxBuffer))
-				processCrossfireTelemetryValue(BATT_VOLTAGE_INDEX, value);
-			if (getCrossfireTelemetryValue<2>(5, value, rxBuffer))
-				processCrossfireTelemetryValue(BATT_CURRENT_INDEX, value);
-			if (getCrossfireTelemetryValue<3>(7, value, rxBuffer))
-				processCrossfireTelemetryValue(BATT_CAPACITY_INDEX, value);
-			if (getCrossfireTelemetryValue<1>(10, value, rxBuffer))
-				processCrossfireTelemetryValue(BATT_REMAINING_INDEX, value);
-			break;
-
-		case ATTITUDE_ID:
-			std::cout << "ATTITUDE_ID" << std::endl;
-
-			if (getCrossfireTelemetryValue<2>(3, value, rxBuffer))
-				processCrossfireTelemetryValue(ATTITUDE_PITCH_INDEX, value / 10);
-			if (getCrossfireTelemetryValue<2>(5, value, rxBuffer))
-				processCrossfireTelemetryValue(ATTITUDE_ROLL_INDEX, value / 10);
-			if (getCrossfireTelemetryValue<2>(7, value, rxBuffer))
-				processCrossfireTelemetryValue(ATTITUDE_YAW_INDEX, value / 10);
-			break;
-
-		case FLIGHT_MODE_ID:
-		{
-			const CrossfireSensor& sensor = crossfireSensors[FLIGHT_MODE_INDEX];
-			auto textLength = std::min<int>(16, rxBuffer[1]);
-			rxBuffer[textLength] = '\0';
-
-			std::cout << "FLIGHT_MODE_ID" << std::endl;
-			std::cout << '\t' << (const char*)rxBuffer + 3 << std::endl;
-
-			break;
-		}
-		}
-
-		idx += len + 2; // +1 for crc, +1 for address
+		// Incomplete frames are kept by the stream until the next read
+		stream.commit(bytesRead);
+		stream.process();
 	}
-
-	return 0;
 }